@@ -4,80 +4,118 @@
 #include <string.h>
 
 #include "decode.h"
+#include "cfg.h"
+#include "heat.h"
 
-int print_bblocks(instr_t list[], int count) {
+/**
+ * Prints "  <bblock of from> -> <dest>", attributes & newline are up to caller
+ */
+static void print_edge(FILE *out, const instr_t *from, const label_t *dest, addr_t dest_addr) {
+  fprintf(out, "  ");
+  print_label(out, &from->label, from->addr);
+  fprintf(out, " -> ");
+  print_label(out, dest, dest_addr);
+}
+
+/**
+ * heat => fill bblocks by sample count & prefix instr. with it, NULL to omit
+ */
+int print_bblocks(FILE *out, instr_t list[], int count, const heat_t *heat) {
   int bblock_count = 0;
 
   for (int i = 0; i < count; i++) {
-    if (list[i].label[0] != '\0') {
+    if (has_label(&list[i])) {
       if (bblock_count > 0)
-        printf("\"]\n"); // Closing
+        fprintf(out, "\"]\n"); // Closing
       bblock_count++;
-      printf("  %s [width=4 shape=rectangle fontname=Monospace fontsize=11 label=\"",
-              list[i].label); // Opening
-      printf("%s:\\l", list[i].label); // Label
+
+      uint64_t hits = heat != NULL ? heat_block(heat, list, count, i) : 0;
+      int level = heat != NULL ? heat_level(heat, hits) : -1;
+      fprintf(out, "  ");
+      print_label(out, &list[i].label, list[i].addr);
+      fprintf(out, " [width=4 shape=rectangle fontname=Monospace fontsize=11 ");
+      if (level >= 0)
+        fprintf(out, "style=filled fillcolor=\"%s\" %s", heat_color(level),
+                level >= HEAT_LEVELS * 2 / 3 ? "fontcolor=white " : "");
+      fprintf(out, "label=\""); // Opening
+
+      print_label(out, &list[i].label, list[i].addr); // Label
+      if (hits > 0)
+        fprintf(out, ": %lu hits (%.1f%%)\\l", hits, 100.0 * hits / heat->total);
+      else
+        fprintf(out, ":\\l");
     }
 
-    char addr_buf[16];
-    snprintf(addr_buf, 16, "0x%x", list[i].addr);
+    if (heat != NULL) {
+      uint64_t hits = heat_instr(heat, &list[i]);
+      if (hits > 0)
+        fprintf(out, "%8lu", hits);
+      else
+        fprintf(out, "%8s", "");
+    }
+
+    char addr_buf[24];
+    snprintf(addr_buf, sizeof(addr_buf), "0x%lx", list[i].addr);
 
-    printf("   %s:%*s %-5s %-20s %s%s\\l",
+    fprintf(out, "   %s:%*s %-5s %-20s ",
             addr_buf,
-            (int)(7 - strlen(addr_buf)), "", // padding
+            (int)(strlen(addr_buf) < 7 ? 7 - strlen(addr_buf) : 0), "", // padding
             list[i].mnemo_opcode,
-            list[i].mnemo_operand,
-            list[i].mnemo_notes[0] != '\0' ? "# " : "",
-            list[i].mnemo_notes);
+            list[i].mnemo_operand);
+    print_instr_note(out, &list[i]);
+    fprintf(out, "\\l");
   }
 
   if (bblock_count > 0)
-    printf("\"]\n"); // Closing
+    fprintf(out, "\"]\n"); // Closing
 
   return bblock_count;
 }
 
-void print_arrows(instr_t list[], int count) {
+void print_arrows(FILE *out, instr_t list[], int count) {
   int prev_bblock_i = 0;
 
   for (int i = 0; i < count; i++) {
-    if (list[i].label[0] != '\0')
+    if (has_label(&list[i]))
       prev_bblock_i = i; // save last bblock beg. index
 
     // this bblock -> some other bblock
-    if (!list[i].has_ext_opcode) {
-      switch (list[i].opcode) {
-        case OP_JB:
-        case OP_JE:
-        case OP_JNE:
-        case OP_JMP_E9:
-        case OP_JMP_EB:
-        case OP_CALL:
-PRINT_JUMP_ARROW:
-          if (list[i].mnemo_cf_label[0] != '\0') {
-            printf("  %s -> %s [fontname=Monospace fontsize=10 label=\"%s\\l\"]\n",
-                    list[prev_bblock_i].label,
-                    list[i].mnemo_cf_label,
-                    list[i].mnemo_opcode);
-          }
-          break;
-      }
-    } else {
-      switch (list[i].opcode) {
-        case OP_EXT_JB:
-        case OP_EXT_JE:
-        case OP_EXT_JNE:
-          goto PRINT_JUMP_ARROW;
-      }
+    flow_t flow = get_instr_flow(&list[i]);
+    if ((flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL)
+        && (list[i].flags & INSTR_CF_LABEL)) {
+      print_edge(out, &list[prev_bblock_i], &list[i].cf_label, get_instr_dest(&list[i]));
+      fprintf(out, " [fontname=Monospace fontsize=10 label=\"%s\\l\"]\n", list[i].mnemo_opcode);
     }
 
     // this bblock -> next
     if (i < count - 1
-        && list[i + 1].label[0] != '\0'
-        && list[i].opcode != OP_JMP_E9    // Ignore prev bblocks ending with JMP/RET,
-        && list[i].opcode != OP_JMP_EB    // those can't fall to this bblock
-        && list[i].opcode != OP_RET_C2
-        && list[i].opcode != OP_RET_C3) {
-      printf("  %s -> %s\n", list[prev_bblock_i].label, list[i + 1].label);
+        && has_label(&list[i + 1])
+        && flow != FLOW_JMP    // Ignore prev bblocks ending with JMP/RET,
+        && flow != FLOW_IJMP   // those can't fall to this bblock
+        && flow != FLOW_RET) {
+      print_edge(out, &list[prev_bblock_i], &list[i + 1].label, list[i + 1].addr);
+      fprintf(out, "\n");
+    }
+  }
+}
+
+void print_jtab_arrows(FILE *out, instr_t list[], int count, jtab_t jtabs[], int n_jtabs) {
+  for (int i = 0; i < n_jtabs; i++) {
+    int j = find_instr(list, count, jtabs[i].addr);
+    if (j < 0)
+      continue;
+
+    // Find bblock of jmp *
+    while (j > 0 && !has_label(&list[j]))
+      j--;
+
+    for (int k = 0; k < jtabs[i].n_targets; k++) {
+      int t = find_instr(list, count, jtabs[i].targets[k]);
+      if (t < 0 || !has_label(&list[t]))
+        continue;
+
+      print_edge(out, &list[j], &list[t].label, list[t].addr);
+      fprintf(out, " [fontname=Monospace fontsize=10 label=\"case %d\\l\"]\n", k);
     }
   }
 }
@@ -1,7 +1,12 @@
-#ifndef CFG_H
-#define CFG_H
-
-int print_bblocks(instr_t list[], int count);
-void print_arrows(instr_t list[], int count);
-
-#endif
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdio.h>
+
+#include "jtab.h"
+
+int print_bblocks(FILE *out, instr_t list[], int count, const struct heat *heat);
+void print_arrows(FILE *out, instr_t list[], int count);
+void print_jtab_arrows(FILE *out, instr_t list[], int count, jtab_t jtabs[], int n_jtabs);
+
+#endif
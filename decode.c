@@ -2,9 +2,13 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 
 #include "decode.h"
+#include "xref.h"
+#include "heat.h"
 
 // GPR mnemonics, index = encoding
 static const char * const GPR_64b[] = {
@@ -20,6 +24,79 @@ static const char * const GPR_32b[] = {
   "r12d", "r13d", "r14d", "r15d"
 };
 
+// Operand layout flags
+#define OPF_VALID 0b01
+#define OPF_MODRM 0b10
+
+/**
+ * Operand layout of known opcodes, shared by decode_single() and decode_length()
+ *  imm  = size of immediate/rel. offset in bits
+ *  regs = mask of valid ModRM.reg /digit extensions (0 = any)
+ */
+typedef struct {
+  byte_t flags;
+  byte_t imm;
+  byte_t flow;
+  byte_t regs;
+} op_info_t;
+
+static const op_info_t OP_INFO[256] = {
+  [OP_ADD_01]  = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 0 },
+  [OP_ADD_03]  = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 0 },
+  [OP_ADD]     = { OPF_VALID,             32, FLOW_NONE, 0 },
+  [OP_XOR]     = { OPF_VALID,             32, FLOW_NONE, 0 },
+  [OP_CMP_39]  = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 0 },
+  [OP_CMP_3D]  = { OPF_VALID,             32, FLOW_NONE, 0 },
+  [OP_PUSH_50] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_PUSH_51] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_PUSH_52] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_PUSH_53] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_PUSH_54] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_PUSH_55] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_PUSH_56] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_PUSH_57] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_POP_58]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_POP_59]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_POP_5A]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_POP_5B]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_POP_5C]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_POP_5D]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_POP_5E]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_POP_5F]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_MOVSXD]  = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 0 },
+  [OP_PUSH_68] = { OPF_VALID,             32, FLOW_NONE, 0 },
+  [OP_PUSH_6A] = { OPF_VALID,              8, FLOW_NONE, 0 },
+  [OP_JB]      = { OPF_VALID,              8, FLOW_JCC,  0 },
+  [OP_JE]      = { OPF_VALID,              8, FLOW_JCC,  0 },
+  [OP_JNE]     = { OPF_VALID,              8, FLOW_JCC,  0 },
+  [OP_JA]      = { OPF_VALID,              8, FLOW_JCC,  0 },
+  [OP_MOV_89]  = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 0 },
+  [OP_MOV_8B]  = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 0 },
+  [OP_LEA]     = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 0 },
+  [OP_8F]      = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 1 << 0 },
+  [OP_NOP]     = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_RET_C2]  = { OPF_VALID,             16, FLOW_RET,  0 },
+  [OP_RET_C3]  = { OPF_VALID,              0, FLOW_RET,  0 },
+  [OP_INT3]    = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_CALL]    = { OPF_VALID,             32, FLOW_CALL, 0 },
+  [OP_JMP_E9]  = { OPF_VALID,             32, FLOW_JMP,  0 },
+  [OP_JMP_EB]  = { OPF_VALID,              8, FLOW_JMP,  0 },
+  [OP_F7]      = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 1 << 4 },
+  [OP_FF]      = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 1 << 2 | 1 << 4 | 1 << 6 },
+};
+
+static const op_info_t OP_EXT_INFO[256] = {
+  [OP_EXT_JB]      = { OPF_VALID,             32, FLOW_JCC,  0 },
+  [OP_EXT_JE]      = { OPF_VALID,             32, FLOW_JCC,  0 },
+  [OP_EXT_JNE]     = { OPF_VALID,             32, FLOW_JCC,  0 },
+  [OP_EXT_JA]      = { OPF_VALID,             32, FLOW_JCC,  0 },
+  [OP_EXT_NOP]     = { OPF_VALID | OPF_MODRM,  0, FLOW_NONE, 0 },
+  [OP_EXT_PUSH_FS] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_EXT_POP_FS]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_EXT_PUSH_GS] = { OPF_VALID,              0, FLOW_NONE, 0 },
+  [OP_EXT_POP_GS]  = { OPF_VALID,              0, FLOW_NONE, 0 },
+};
+
 /**
  * Decodes immediate signed value from sequence of bytes
  */
@@ -49,12 +126,21 @@ static long long dec_imm(byte_t bytes[], int *pos, int imm_size) {
 
 /**
  * Decodes ModRM fields from byte
+ *  If SIB byte follows (r/m = 100 and mod != 11), decodes it too
  */
 static bool dec_modrm(byte_t bytes[], int *pos, instr_t *instr) {
   instr->modrm.mod = (bytes[*pos] & 0b11000000) >> 6;
   instr->modrm.reg = (bytes[*pos] & 0b00111000) >> 3;
   instr->modrm.rm  = (bytes[*pos] & 0b00000111);
   (*pos)++;
+
+  instr->has_sib = instr->modrm.mod != 0b11 && instr->modrm.rm == 0b100;
+  if (instr->has_sib) {
+    instr->sib.scale = (bytes[*pos] & 0b11000000) >> 6;
+    instr->sib.index = (bytes[*pos] & 0b00111000) >> 3;
+    instr->sib.base  = (bytes[*pos] & 0b00000111);
+    (*pos)++;
+  }
   return true;
 }
 
@@ -123,13 +209,15 @@ static const char *get_opcode_register(instr_t *instr) {
  * Returns expected displacement size in bits based on ModRM byte
  *
  * ModRM.mod =
- *  0b00 : no displacement (disp32 if r/m is 101 => disp32(%rip))
+ *  0b00 : no displacement (disp32 if r/m is 101 => disp32(%rip),
+ *                          or SIB.base is 101 => no base)
  *  0b01 : disp8
  *  0b10 : disp32
  */
 static int get_modrm_disp(instr_t *instr) {
   switch (instr->modrm.mod) {
-    case 0b00: return instr->modrm.rm == 0b101 ? 32 : 0;
+    case 0b00: return instr->modrm.rm == 0b101
+                        || (instr->has_sib && instr->sib.base == 0b101) ? 32 : 0;
     case 0b01: return 8;
     case 0b10: return 32;
     case 0b11: break; // invalid / direct
@@ -137,6 +225,35 @@ static int get_modrm_disp(instr_t *instr) {
   return 0;
 }
 
+/**
+ * Formats ModRM memory operand (mod != 0b11) into buf
+ *  disp(%base), disp(%base,%index,scale) or disp(,%index,scale)
+ */
+static const char *format_modrm_mem(instr_t *instr, char buf[], size_t size) {
+  const char *sign = instr->value < 0 ? "-" : "";
+  unsigned int disp = instr->value < 0 ? -instr->value : instr->value;
+
+  if (!instr->has_sib) {
+    snprintf(buf, size, "%s0x%x(%%%s)", sign, disp, get_modrm_rm_register(instr, true));
+    return buf;
+  }
+
+  byte_t index = instr->sib.index | (instr->has_rex && instr->rex.x ? 0b1000 : 0);
+  byte_t base = instr->sib.base | (instr->has_rex && instr->rex.b ? 0b1000 : 0);
+  bool has_index = index != 0b100; // %rsp => no index
+  bool has_base = !(instr->modrm.mod == 0b00 && instr->sib.base == 0b101);
+
+  if (has_index && has_base)
+    snprintf(buf, size, "%s0x%x(%%%s,%%%s,%d)", sign, disp, GPR_64b[base], GPR_64b[index], 1 << instr->sib.scale);
+  else if (has_index)
+    snprintf(buf, size, "%s0x%x(,%%%s,%d)", sign, disp, GPR_64b[index], 1 << instr->sib.scale);
+  else if (has_base)
+    snprintf(buf, size, "%s0x%x(%%%s)", sign, disp, GPR_64b[base]);
+  else
+    snprintf(buf, size, "%s0x%x", sign, disp);
+  return buf;
+}
+
 static void format_mnemonic(instr_t *instr, const char *opcode, const char *format, ...) {
   va_list args;
   va_start(args, format);
@@ -155,6 +272,7 @@ static void format_mnemonic(instr_t *instr, const char *opcode, const char *form
  *  return => number of bytes decoded
  */
 static int decode_single(instr_t *instr, byte_t bytes[]) {
+  char mem[MNEMO_OPERAND_LEN];
   int pos = 0;
 
   // Check REX byte
@@ -166,8 +284,37 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
   // Check opcode
   instr->opcode = bytes[pos++];
 
+  if (!((instr->has_ext_opcode ? OP_EXT_INFO : OP_INFO)[instr->opcode].flags & OPF_VALID))
+    goto UNK_OPCODE;
+
   if (!instr->has_ext_opcode) {
     switch (instr->opcode) {
+      case OP_ADD_01: // add reg/mem64,reg64
+        instr->has_modrm = dec_modrm(bytes, &pos, instr);
+        if (instr->modrm.mod == 0b11) {
+          format_mnemonic(instr, "add", "%%%s, %%%s",
+                          get_modrm_reg_register(instr, false),
+                          get_modrm_rm_register(instr, false));
+        } else {
+          instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
+          format_mnemonic(instr, "add", "%%%s, %s",
+                          get_modrm_reg_register(instr, false),
+                          format_modrm_mem(instr, mem, sizeof(mem)));
+        }
+        break;
+      case OP_ADD_03: // add reg64,reg/mem64
+        instr->has_modrm = dec_modrm(bytes, &pos, instr);
+        if (instr->modrm.mod == 0b11) {
+          format_mnemonic(instr, "add", "%%%s, %%%s",
+                          get_modrm_rm_register(instr, false),
+                          get_modrm_reg_register(instr, false));
+        } else {
+          instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
+          format_mnemonic(instr, "add", "%s, %%%s",
+                          format_modrm_mem(instr, mem, sizeof(mem)),
+                          get_modrm_reg_register(instr, false));
+        }
+        break;
       case OP_ADD: // add eax/rax imm32
         instr->value = dec_imm(bytes, &pos, 32);
         format_mnemonic(instr, "add",
@@ -188,11 +335,9 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
                           get_modrm_rm_register(instr, false));
         } else {
           instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
-          format_mnemonic(instr, "cmp", "%%%s, %s0x%x(%%%s)",
+          format_mnemonic(instr, "cmp", "%%%s, %s",
                           get_modrm_reg_register(instr, false),
-                          (instr->value < 0 ? "-" : ""),
-                          (instr->value < 0 ? -instr->value : instr->value),
-                          get_modrm_rm_register(instr, true));
+                          format_modrm_mem(instr, mem, sizeof(mem)));
         }
         break;
       case OP_CMP_3D: // cmp eax/rax imm32
@@ -247,6 +392,25 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
                         (instr->value < 0 ? "-" : "+"),
                         (instr->value < 0 ? -instr->value : instr->value));
         break;
+      case OP_JA: // ja rel8off
+        instr->value = dec_imm(bytes, &pos, 8);
+        format_mnemonic(instr, "ja", "$rip%s0x%x",
+                        (instr->value < 0 ? "-" : "+"),
+                        (instr->value < 0 ? -instr->value : instr->value));
+        break;
+      case OP_MOVSXD: // movslq reg64,reg/mem32
+        instr->has_modrm = dec_modrm(bytes, &pos, instr);
+        if (instr->modrm.mod == 0b11) {
+          format_mnemonic(instr, instr->rex.w ? "movslq" : "movsxd", "%%%s, %%%s",
+                          GPR_32b[instr->modrm.rm | (instr->rex.b ? 0b1000 : 0)],
+                          get_modrm_reg_register(instr, false));
+        } else {
+          instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
+          format_mnemonic(instr, instr->rex.w ? "movslq" : "movsxd", "%s, %%%s",
+                          format_modrm_mem(instr, mem, sizeof(mem)),
+                          get_modrm_reg_register(instr, false));
+        }
+        break;
       case OP_MOV_89: // mov reg/mem64,reg64
         instr->has_modrm = dec_modrm(bytes, &pos, instr);
         if (instr->modrm.mod == 0b11) {
@@ -255,11 +419,9 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
                           get_modrm_rm_register(instr, false));
         } else {
           instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
-          format_mnemonic(instr, "mov", "%%%s, %s0x%x(%%%s)",
+          format_mnemonic(instr, "mov", "%%%s, %s",
                           get_modrm_reg_register(instr, false),
-                          (instr->value < 0 ? "-" : ""),
-                          (instr->value < 0 ? -instr->value : instr->value),
-                          get_modrm_rm_register(instr, true));
+                          format_modrm_mem(instr, mem, sizeof(mem)));
         }
         break;
       case OP_MOV_8B: // mov reg64,reg/mem64
@@ -270,13 +432,20 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
                           get_modrm_reg_register(instr, false));
         } else {
           instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
-          format_mnemonic(instr, "mov", "%s0x%x(%%%s), %%%s",
-                          (instr->value < 0 ? "-" : ""),
-                          (instr->value < 0 ? -instr->value : instr->value),
-                          get_modrm_rm_register(instr, true),
+          format_mnemonic(instr, "mov", "%s, %%%s",
+                          format_modrm_mem(instr, mem, sizeof(mem)),
                           get_modrm_reg_register(instr, false));
         }
         break;
+      case OP_LEA: // lea reg64,mem
+        instr->has_modrm = dec_modrm(bytes, &pos, instr);
+        if (instr->modrm.mod == 0b11)
+          goto UNK_OPCODE; // no register source
+        instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
+        format_mnemonic(instr, "lea", "%s, %%%s",
+                        format_modrm_mem(instr, mem, sizeof(mem)),
+                        get_modrm_reg_register(instr, false));
+        break;
       case OP_8F:
         instr->has_modrm = dec_modrm(bytes, &pos, instr);
         switch (instr->modrm.reg) {
@@ -285,10 +454,8 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
               format_mnemonic(instr, "pop", "%%%s", get_modrm_rm_register(instr, true));
             } else {
               instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
-              format_mnemonic(instr, "pop", "%s0x%x(%%%s)",
-                              (instr->value < 0 ? "-" : ""),
-                              (instr->value < 0 ? -instr->value : instr->value),
-                              get_modrm_rm_register(instr, true));
+              format_mnemonic(instr, "pop", "%s",
+                              format_modrm_mem(instr, mem, sizeof(mem)));
             }
             break;
           default:
@@ -334,10 +501,8 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
               format_mnemonic(instr, "mul", "%%%s", get_modrm_rm_register(instr, false));
             } else {
               instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
-              format_mnemonic(instr, "mul", "%s0x%x(%%%s)",
-                              (instr->value < 0 ? "-" : ""),
-                              (instr->value < 0 ? -instr->value : instr->value),
-                              get_modrm_rm_register(instr, true));
+              format_mnemonic(instr, "mul", "%s",
+                              format_modrm_mem(instr, mem, sizeof(mem)));
             }
             break;
           default:
@@ -352,10 +517,17 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
               format_mnemonic(instr, "call", "*%%%s", get_modrm_rm_register(instr, true));
             } else {
               instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
-              format_mnemonic(instr, "call", "*%s0x%x(%%%s)",
-                              (instr->value < 0 ? "-" : ""),
-                              (instr->value < 0 ? -instr->value : instr->value),
-                              get_modrm_rm_register(instr, true));
+              format_mnemonic(instr, "call", "*%s",
+                              format_modrm_mem(instr, mem, sizeof(mem)));
+            }
+            break;
+          case 4: // jmp reg/mem64
+            if (instr->modrm.mod == 0b11) {
+              format_mnemonic(instr, "jmp", "*%%%s", get_modrm_rm_register(instr, true));
+            } else {
+              instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
+              format_mnemonic(instr, "jmp", "*%s",
+                              format_modrm_mem(instr, mem, sizeof(mem)));
             }
             break;
           case 6: // push reg/mem64
@@ -363,10 +535,8 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
               format_mnemonic(instr, "push", "%%%s", get_modrm_rm_register(instr, true));
             } else {
               instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
-              format_mnemonic(instr, "push", "%s0x%x(%%%s)",
-                              (instr->value < 0 ? "-" : ""),
-                              (instr->value < 0 ? -instr->value : instr->value),
-                              get_modrm_rm_register(instr, true));
+              format_mnemonic(instr, "push", "%s",
+                              format_modrm_mem(instr, mem, sizeof(mem)));
             }
             break;
           default:
@@ -396,16 +566,20 @@ static int decode_single(instr_t *instr, byte_t bytes[]) {
                           (instr->value < 0 ? "-" : "+"),
                           (instr->value < 0 ? -instr->value : instr->value));
         break;
+      case OP_EXT_JA: // ja/jnbe rel32off
+        instr->value = dec_imm(bytes, &pos, 32);
+        format_mnemonic(instr, "ja", "$rip%s0x%x",
+                          (instr->value < 0 ? "-" : "+"),
+                          (instr->value < 0 ? -instr->value : instr->value));
+        break;
       case OP_EXT_NOP: // nop reg/mem64
         instr->has_modrm = dec_modrm(bytes, &pos, instr);
         if (instr->modrm.mod == 0b11) {
           format_mnemonic(instr, "nop", "%%%s", get_modrm_rm_register(instr, false));
         } else {
           instr->value = dec_imm(bytes, &pos, get_modrm_disp(instr));
-          format_mnemonic(instr, "nop", "%s0x%x(%%%s)",
-                          (instr->value < 0 ? "-" : ""),
-                          (instr->value < 0 ? -instr->value : instr->value),
-                          get_modrm_rm_register(instr, true));
+          format_mnemonic(instr, "nop", "%s",
+                          format_modrm_mem(instr, mem, sizeof(mem)));
         }
         break;
       case OP_EXT_PUSH_FS: // push fs
@@ -433,114 +607,419 @@ UNK_OPCODE:
 }
 
 /**
- * Returns instr_t from array where addr is within instr.addr - instr.addr+len range
+ * Decodes length of single instruction, starting at bytes[0]
+ *  Skips all operand formatting, uses only OP_INFO tables
+ *  flow => control flow type, rel => rel. offset of branch (if any)
+ *  return => number of bytes of instr., 0 if truncated
+ */
+int decode_length(const byte_t bytes[], size_t len, flow_t *flow, long long *rel) {
+  size_t pos = 0;
+
+  *flow = FLOW_NONE;
+  *rel = 0;
+
+  // REX & 0F escape
+  if (pos < len && (bytes[pos] & 0xF0) == 0x40)
+    pos++;
+  bool ext = pos < len && bytes[pos] == 0x0F;
+  if (ext)
+    pos++;
+  if (pos >= len)
+    return 0;
+
+  const op_info_t *info = ext ? &OP_EXT_INFO[bytes[pos]] : &OP_INFO[bytes[pos]];
+  pos++;
+
+  if (!(info->flags & OPF_VALID))
+    return pos; // unknown, skip
+
+  if (info->flags & OPF_MODRM) {
+    if (pos >= len)
+      return 0;
+    byte_t modrm = bytes[pos++];
+
+    // Unknown /digit extension, skip ModRM (+SIB) like decode_single() does
+    if (info->regs != 0 && !(info->regs & (1 << ((modrm >> 3) & 0b111)))) {
+      if ((modrm >> 6) != 0b11 && (modrm & 0b111) == 0b100)
+        pos++;
+      return pos <= len ? pos : 0;
+    }
+
+    // jmp reg/mem64
+    if (!ext && bytes[pos - 2] == OP_FF && ((modrm >> 3) & 0b111) == 4)
+      *flow = FLOW_IJMP;
+
+    // SIB
+    byte_t base = modrm & 0b111;
+    if ((modrm >> 6) != 0b11 && (modrm & 0b111) == 0b100) {
+      if (pos >= len)
+        return 0;
+      base = bytes[pos++] & 0b111;
+    }
+
+    switch (modrm >> 6) {
+      case 0b00: pos += (modrm & 0b111) == 0b101 || base == 0b101 ? 4 : 0; break;
+      case 0b01: pos += 1; break;
+      case 0b10: pos += 4; break;
+    }
+  }
+
+  pos += info->imm / 8;
+  if (pos > len)
+    return 0;
+
+  if (info->flow == FLOW_JCC || info->flow == FLOW_JMP || info->flow == FLOW_CALL) {
+    const byte_t *imm = &bytes[pos - info->imm / 8];
+    *rel = info->imm == 8 ? (int8_t)imm[0] :
+              (int32_t)(imm[0] | imm[1] << 8 | imm[2] << 16 | (uint32_t)imm[3] << 24);
+  }
+  if (*flow == FLOW_NONE)
+    *flow = info->flow;
+
+  return pos;
+}
+
+/**
+ * Linear-sweep instr. boundaries using decode_length()
+ *  mask[] = bitmap of (len + 63) / 64 words, bit i set if instr. begins at bytes[i]
+ */
+void decode_boundaries(const byte_t bytes[], size_t len, uint64_t mask[]) {
+  size_t pos = 0;
+
+  memset(mask, 0, (len + 63) / 64 * sizeof(uint64_t));
+
+  while (pos < len) {
+    flow_t flow;
+    long long rel;
+    int n = decode_length(&bytes[pos], len - pos, &flow, &rel);
+    if (n == 0)
+      break; // truncated
+
+    mask[pos / 64] |= 1ULL << (pos % 64);
+    pos += n;
+  }
+}
+
+/**
+ * Returns destination of rel. branch/call (or rip-relative operand)
+ */
+addr_t get_instr_dest(const instr_t *instr) {
+  return instr->addr + instr->len + instr->value;
+}
+
+/**
+ * Checks for disp32(%rip) memory operand, get_instr_dest() is its address
+ */
+bool is_instr_rip_relative(const instr_t *instr) {
+  return instr->has_modrm && instr->modrm.mod == 0b00 && instr->modrm.rm == 0b101;
+}
+
+/**
+ * Returns control flow type of decoded instr.
+ */
+flow_t get_instr_flow(const instr_t *instr) {
+  if (!instr->has_ext_opcode && instr->opcode == OP_FF && instr->modrm.reg == 4)
+    return FLOW_IJMP; // jmp reg/mem64
+  return (instr->has_ext_opcode ? OP_EXT_INFO : OP_INFO)[instr->opcode].flow;
+}
+
+/**
+ * Binary search in list sorted by addr
+ *  return => index of first instr. starting at addr or after it, count if none
+ */
+static int lower_bound_instr(instr_t list[], int count, addr_t addr) {
+  int lo = 0, hi = count;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (list[mid].addr < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Returns first instr_t of array sorted by addr, where addr is within instr.addr - instr.addr+len range
+ *  Only instr. starting less than MAX_INSTR_LEN bytes before addr can cover it
  *  NULL if not found
  */
-instr_t *get_instr_by_addr(instr_t instr[], int count, long long addr) {
-  for (int j = 0; j < count; j++) {
-    if (instr[j].addr <= addr && instr[j].addr + instr[j].len > addr) { // found
+instr_t *get_instr_by_addr(instr_t instr[], int count, addr_t addr) {
+  addr_t from = addr >= MAX_INSTR_LEN - 1 ? addr - (MAX_INSTR_LEN - 1) : 0;
+  for (int j = lower_bound_instr(instr, count, from); j < count && instr[j].addr <= addr; j++) {
+    if (instr[j].addr + instr[j].len > addr) // found
       return &instr[j];
-    }
   }
 
   return NULL;
 }
 
 /**
- * Decodes all instructions
+ * Binary search for instr. starting at addr, list must be sorted by addr
+ *  return => index, -1 if not found
+ */
+int find_instr(instr_t list[], int count, addr_t addr) {
+  int i = lower_bound_instr(list, count, addr);
+  return i < count && list[i].addr == addr ? i : -1;
+}
+
+/**
+ * Allocates empty address index for region vaddr - vaddr+len
+ *  return => 0 on success
+ */
+int index_init(addr_index_t *index, addr_t vaddr, size_t len) {
+  index->vaddr = vaddr;
+  index->len = len;
+  index->relocs = NULL;
+  index->slot = (int *)malloc(len * sizeof(int));
+  if (index->slot == NULL) {
+    printf("Could not allocate memory for address index!\n");
+    return 1;
+  }
+
+  memset(index->slot, 0xFF, len * sizeof(int)); // -1
+  return 0;
+}
+
+void index_free(addr_index_t *index) {
+  free(index->slot);
+  index->slot = NULL;
+}
+
+/**
+ * Indexes instr[from] - instr[to - 1]
+ *  Bytes already covered by another instr. are kept
+ */
+void index_add(addr_index_t *index, instr_t instr[], int from, int to) {
+  for (int i = from; i < to; i++) {
+    for (size_t j = 0; j < instr[i].len; j++) {
+      size_t off = instr[i].addr + j - index->vaddr;
+      if (off < index->len && index->slot[off] < 0)
+        index->slot[off] = i;
+    }
+  }
+}
+
+/**
+ * Returns index of instr. covering addr, -1 if none
+ */
+int index_lookup(const addr_index_t *index, addr_t addr) {
+  if (addr < index->vaddr || addr - index->vaddr >= index->len)
+    return -1;
+  return index->slot[addr - index->vaddr];
+}
+
+/**
+ * Sorts instr[] by addr through the index, without comparisons
+ *  Each instr. must own the slot of its first byte, as decode() leaves it
+ *  O(len + count), every instr. is moved once, index is updated
+ *  return => 0 on success, 1 if some instr. is not indexed (nothing moved)
+ */
+int index_sort(addr_index_t *index, instr_t instr[], int count) {
+  int *order = (int *)malloc((count > 0 ? count : 1) * sizeof(int)); // order[k] = old pos. of k-th
+  int *rank = (int *)malloc((count > 0 ? count : 1) * sizeof(int));  // rank[old pos.] = k
+  if (order == NULL || rank == NULL) {
+    printf("Could not allocate memory for sorting!\n");
+    goto ERR_FREE;
+  }
+
+  int n = 0;
+  for (size_t off = 0; off < index->len; off++) {
+    int i = index->slot[off];
+    if (i >= 0 && instr[i].addr - index->vaddr == off && n < count) {
+      rank[i] = n;
+      order[n++] = i;
+    }
+  }
+  if (n != count)
+    goto ERR_FREE;
+
+  for (size_t off = 0; off < index->len; off++) {
+    if (index->slot[off] >= 0)
+      index->slot[off] = rank[index->slot[off]];
+  }
+
+  // Follow permutation cycles, k-th position takes instr[order[k]]
+  for (int k = 0; k < count; k++) {
+    if (order[k] == k)
+      continue;
+
+    instr_t tmp = instr[k];
+    int j = k;
+    while (order[j] != k) {
+      int from = order[j];
+      instr[j] = instr[from];
+      order[j] = j;
+      j = from;
+    }
+    instr[j] = tmp;
+    order[j] = j;
+  }
+
+  free(order);
+  free(rank);
+  return 0;
+
+ERR_FREE:
+  free(order);
+  free(rank);
+  return 1;
+}
+
+/**
+ * Returns num. of bytes covered by decoded instr.
+ */
+size_t index_covered(const addr_index_t *index) {
+  size_t covered = 0;
+  for (size_t off = 0; off < index->len; off++)
+    covered += index->slot[off] >= 0;
+  return covered;
+}
+
+/**
+ * return => first relocation of field within [from, to), -1 if none
+ */
+int reloc_lookup(const reloc_index_t *relocs, addr_t from, addr_t to) {
+  int lo = 0, hi = relocs->n_relocs;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (relocs->relocs[mid].addr < from)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < relocs->n_relocs && relocs->relocs[lo].addr < to ? lo : -1;
+}
+
+/**
+ * Sets hex bytes string of instr. from its first instr.len bytes
+ */
+static void set_hex_bytes(instr_t *instr, const byte_t bytes[]) {
+  int str_pos = 0;
+  for (size_t i = 0; i < instr->len; i++) {
+    str_pos += snprintf(instr->hex_bytes + str_pos,
+                        HEX_BYTES_LEN - str_pos, "%s%02x",
+                        (i > 0 ? " " : ""), bytes[i]);
+  }
+}
+
+/**
+ * Decodes single instr. at bytes[pos] (no label), bytes[] mapped at vaddr
+ *  sub_addr => function entry address to which this instr. belongs
+ *  return => num. of bytes consumed
+ */
+size_t decode_instr(instr_t *instr, byte_t bytes[], addr_t vaddr, size_t pos, addr_t sub_addr) {
+  memset(instr, 0, sizeof(instr_t));
+
+  // Decode single instr.
+  instr->addr = vaddr + pos; // store begin rel. addr
+  size_t len = decode_single(instr, &bytes[pos]); // decode
+  instr->len = len; // store byte size
+  instr->sub_addr = sub_addr;
+
+  set_hex_bytes(instr, &bytes[pos]);
+  return len;
+}
+
+/**
+ * decode_instr() of bytes[pos] with rel32/disp32(%rip) relocations applied, as linked
+ *  bytes[] = whole region mapped at vaddr, hex bytes stay those of file
+ *  return => num. of bytes consumed
+ */
+size_t decode_instr_reloc(instr_t *instr, byte_t bytes[], addr_t vaddr, size_t pos, addr_t sub_addr,
+                          const reloc_index_t *relocs) {
+  size_t ilen = decode_instr(instr, bytes, vaddr, pos, sub_addr);
+  int r = reloc_lookup(relocs, instr->addr, instr->addr + ilen);
+  flow_t flow = get_instr_flow(instr);
+  if (r < 0 || (flow != FLOW_JCC && flow != FLOW_JMP && flow != FLOW_CALL && !is_instr_rip_relative(instr)))
+    return ilen;
+
+  // Patch copy of instr. bytes, fields must lie within it
+  byte_t linked[MAX_INSTR_LEN];
+  memcpy(linked, &bytes[pos], ilen);
+  for (; r < relocs->n_relocs && relocs->relocs[r].addr + 4 <= instr->addr + ilen; r++) {
+    const reloc_t *rel = &relocs->relocs[r];
+    if (!rel->pc_rel)
+      continue;
+    int32_t disp = (int32_t)(rel->target + rel->addend - rel->addr);
+    memcpy(&linked[rel->addr - instr->addr], &disp, sizeof(int32_t));
+  }
+
+  decode_instr(instr, linked, vaddr + pos, 0, sub_addr);
+  set_hex_bytes(instr, &bytes[pos]);
+  return ilen;
+}
+
+/**
+ * Decodes all instructions, starting at start addr
+ *  bytes[] = whole region of len bytes, mapped at vaddr
+ *  Recursive mode never leaves the region
+ *  index = address index of instr[] (NULL => search of instr[], linear mode only)
  *  return => total num. of decoded instr. in instr[] array
  */
-int decode(instr_t instr[], int instr_pos, byte_t bytes[], unsigned int vaddr, int len, decode_mode_t mode, unsigned int sub_addr) {
-  int count = instr_pos, pos = 0;
+int decode(instr_t instr[], int instr_pos, byte_t bytes[], addr_t vaddr, size_t len, addr_t start, decode_mode_t mode, addr_t sub_addr, addr_index_t *index) {
+  int count = instr_pos;
+  size_t pos = start - vaddr;
   bool label_pending = true;
 
-  //printf("decode %d addr 0x%X\n", count, vaddr);
+  //printf("decode %d addr 0x%X\n", count, start);
 
   // Name functions/bblocks
   if (sub_addr == 0) {
-    sub_addr = vaddr;
+    sub_addr = start;
   }
 
   // Decode all, one by one
   while (pos < len) {
     // Do not decode already decoded instr/BB.
-    if (get_instr_by_addr(instr, count, vaddr + pos))
+    if (index != NULL ? index_lookup(index, vaddr + pos) >= 0
+                      : get_instr_by_addr(instr, count, vaddr + pos) != NULL)
       return count;
  
-    memset(&instr[count], 0, sizeof(instr_t));
-
-    // Decode single instr.
-    instr[count].addr = vaddr + pos; // store begin rel. addr
-    pos += decode_single(&instr[count], &bytes[pos]); // decode
-    instr[count].len = (vaddr + pos) - instr[count].addr; // store byte size
-    instr[count].sub_addr = sub_addr; // store function entry address to which this instr. belongs
-
-    // Set hex bytes string
-    int str_pos = 0;
-    for (int i = instr[count].addr; i < vaddr + pos; i++) {
-      str_pos += snprintf(instr[count].hex_bytes + str_pos,
-                          HEX_BYTES_LEN - str_pos, "%s%02x",
-                          (i > instr[count].addr ? " " : ""), bytes[i - vaddr]);
-    }
+    if (index != NULL && index->relocs != NULL && index->relocs->n_relocs > 0)
+      pos += decode_instr_reloc(&instr[count], bytes, vaddr, pos, sub_addr, index->relocs);
+    else
+      pos += decode_instr(&instr[count], bytes, vaddr, pos, sub_addr);
+    if (index != NULL)
+      index_add(index, instr, count, count + 1);
 
-    // Set label to new block
+    // Set label to new block, sub_<entry> or sub_<entry>_<addr>
     if (label_pending) {
-      if (sub_addr == instr[count].addr) {
-        // New entry point
-        snprintf(instr[count].label, LABEL_LEN, "sub_%x", sub_addr);
-      } else {
-        // bblock
-        snprintf(instr[count].label, LABEL_LEN, "sub_%x_%x", sub_addr, instr[count].addr);
-      }
+      set_label(&instr[count], NULL, sub_addr);
       label_pending = false;
     }
 
     // Mark end of block, if any
-    if (!instr[count].has_ext_opcode) {
-      switch (instr[count].opcode) {
-        case OP_JB:
-        case OP_JE:
-        case OP_JNE:
-        case OP_JMP_EB:
-        case OP_JMP_E9:
-          if (mode == DECODE_RECURSIVE) {
-            // Recursively decode jump case
-            long long dest = instr[count].addr + instr[count].len + instr[count].value;
-            count = decode(instr, count + 1, &bytes[dest - vaddr], dest, len-pos, mode, sub_addr) - 1;
-          }
-          // finish decoding fall-through case (incl. JMP, meh)
-          label_pending = true;
-          break;
-        case OP_CALL:
-          if (mode == DECODE_RECURSIVE) {
-            // Recursively decode call, reset sub_addr
-            long long dest = instr[count].addr + instr[count].len + instr[count].value;
-            count = decode(instr, count + 1, &bytes[dest - vaddr], dest, len-pos, mode, 0) - 1;
-          }
-          // finish decoding current block (but don't create new label/bb)
-          break;
-        case OP_RET_C2:
-        case OP_RET_C3:
-          if (mode == DECODE_RECURSIVE) {
-            return count + 1; // Nothing else to do
-          }
-          label_pending = true;
-          break;
-      }
-    } else {
-      switch (instr[count].opcode) {
-        case OP_EXT_JB:
-        case OP_EXT_JE:
-        case OP_EXT_JNE:
-          if (mode == DECODE_RECURSIVE) {
-            // Recursively decode jump case
-            long long dest = instr[count].addr + instr[count].len + instr[count].value;
-            count = decode(instr, count + 1, &bytes[dest - vaddr], dest, len-pos, mode, sub_addr) - 1;
-          }
-          // finish decoding fall-through case
-          label_pending = true;
-          break;
-      }
+    switch (get_instr_flow(&instr[count])) {
+      case FLOW_JCC:
+      case FLOW_JMP:
+        if (mode != DECODE_LINEAR) {
+          // Recursively decode jump case
+          addr_t dest = get_instr_dest(&instr[count]);
+          if (dest >= vaddr && dest - vaddr < len)
+            count = decode(instr, count + 1, bytes, vaddr, len, dest, mode, sub_addr, index) - 1;
+        }
+        // finish decoding fall-through case (incl. JMP, meh)
+        label_pending = true;
+        break;
+      case FLOW_CALL:
+        if (mode == DECODE_RECURSIVE) {
+          // Recursively decode call, reset sub_addr
+          addr_t dest = get_instr_dest(&instr[count]);
+          if (dest >= vaddr && dest - vaddr < len)
+            count = decode(instr, count + 1, bytes, vaddr, len, dest, mode, 0, index) - 1;
+        }
+        // finish decoding current block (but don't create new label/bb)
+        break;
+      case FLOW_RET:
+      case FLOW_IJMP: // targets resolved later, if at all
+        if (mode != DECODE_LINEAR) {
+          return count + 1; // Nothing else to do
+        }
+        label_pending = true;
+        break;
+      default:
+        break;
     }
 
     count++;
@@ -549,42 +1028,84 @@ int decode(instr_t instr[], int instr_pos, byte_t bytes[], unsigned int vaddr, i
   return count;
 }
 
+/**
+ * Linear-sweeps all bytes of index region not covered by any instr.
+ *  bytes[] = whole indexed region
+ *  Swept instr. are marked INSTR_SWEPT
+ *  return => total num. of decoded instr. in instr[] array
+ */
+int decode_gaps(instr_t instr[], int instr_pos, byte_t bytes[], addr_index_t *index) {
+  int count = instr_pos;
+
+  for (size_t off = 0; off < index->len; off++) {
+    if (index->slot[off] >= 0)
+      continue;
+
+    // Sweep until first already decoded instr.
+    int from = count;
+    count = decode(instr, count, bytes, index->vaddr, index->len, index->vaddr + off,
+                   DECODE_LINEAR, 0, index);
+    for (int i = from; i < count; i++)
+      instr[i].flags |= INSTR_SWEPT;
+  }
+
+  return count;
+}
+
+/**
+ * Notes signed immediate of push/xor/add/cmp, if negative
+ */
+void proc_value_note(instr_t *instr) {
+  if (!instr->has_ext_opcode) {
+    switch (instr->opcode) {
+      case OP_PUSH_68:
+      case OP_PUSH_6A:
+      case OP_XOR:
+      case OP_ADD:
+      case OP_CMP_3D: // print signed value
+        if (instr->value < 0) {
+          snprintf(instr->mnemo_notes, MNEMO_NOTES_LEN,
+                  "-0x%llx", -instr->value);
+        }
+        break;
+    }
+  }
+}
+
+/**
+ * Notes jump/call destination label, NULL if dest. isn't an instr. boundary
+ */
+void proc_jump_note(instr_t *instr, const label_t *dest_label) {
+  if (dest_label == NULL) {
+    addr_t dest = get_instr_dest(instr);
+    snprintf(instr->mnemo_notes, MNEMO_NOTES_LEN, "[broken] 0x%" PRIx64, dest);
+    return;
+  }
+
+  instr->cf_label = *dest_label;
+  instr->flags |= INSTR_CF_LABEL;
+}
+
+/**
+ * Labels jump/call destinations & notes them at the jumps
+ *  instr[] must be sorted by addr
+ */
 void proc_flow_labels(instr_t instr[], int count) {
   for (int i = 0; i < count; i++) {
-    long long dest = 0;
-
-    // Should print note?
-    if (!instr[i].has_ext_opcode) {
-      switch (instr[i].opcode) {
-        case OP_JB:
-        case OP_JE:
-        case OP_JNE:
-        case OP_JMP_EB: // rel8off
-        case OP_JMP_E9: // rel32off
-        case OP_CALL:
-          dest = instr[i].addr + instr[i].len + instr[i].value;
-          goto PROC_JUMP;
-        case OP_PUSH_68:
-        case OP_PUSH_6A:
-        case OP_XOR:
-        case OP_ADD:
-        case OP_CMP_3D: // print signed value
-          if (instr[i].value < 0) {
-            snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN,
-                    "-0x%llx", -instr[i].value);
-          }
-          break;
-      }
-    } else {
-      switch (instr[i].opcode) {
-        case OP_EXT_JB:
-        case OP_EXT_JE:
-        case OP_EXT_JNE: // rel32off
-          dest = instr[i].addr + instr[i].len + instr[i].value;
-          goto PROC_JUMP;
-      }
+    addr_t dest = 0;
+
+    // Jump/call?
+    switch (get_instr_flow(&instr[i])) {
+      case FLOW_JCC:
+      case FLOW_JMP:
+      case FLOW_CALL:
+        dest = get_instr_dest(&instr[i]);
+        goto PROC_JUMP;
+      default:
+        break;
     }
 
+    proc_value_note(&instr[i]);
     continue;
 
 PROC_JUMP: ;
@@ -593,17 +1114,90 @@ PROC_JUMP: ;
 
     // Invalid jump destination?
     if (dest_instr == NULL || dest_instr->addr != dest) {
-      snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN, "[broken] %s0x%llx",
-                (dest < 0 ? "-" : ""), (dest < 0 ? -dest : dest));
+      proc_jump_note(&instr[i], NULL);
       continue;
     }
 
     // Create label for dest instr, if it hasn't got one yet
-    if (dest_instr->label[0] == '\0')
-      snprintf(dest_instr->label, LABEL_LEN, "sub_%x_%x", dest_instr->sub_addr, dest_instr->addr);
+    if (!has_label(dest_instr))
+      set_label(dest_instr, NULL, dest_instr->sub_addr);
 
     // Print # dest label
-    snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN, "%s", dest_instr->label);
-    snprintf(instr[i].mnemo_cf_label, MNEMO_CF_LABEL_LEN, "%s", dest_instr->label);
+    proc_jump_note(&instr[i], &dest_instr->label);
+  }
+}
+
+/**
+ * Prints label of instr. at addr
+ *  return => num. of chars printed
+ */
+int print_label(FILE *out, const label_t *label, addr_t addr) {
+  int n = label->name != NULL ? fprintf(out, "%s", label->name)
+                              : fprintf(out, "sub_%lx", label->base);
+  if (addr != label->base)
+    n += fprintf(out, "_%lx", addr);
+  return n;
+}
+
+/**
+ * Prints "# note" of instr., dest. label of jumps/calls, if any
+ */
+void print_instr_note(FILE *out, const instr_t *instr) {
+  if (instr->flags & INSTR_CF_LABEL) {
+    fprintf(out, "# ");
+    print_label(out, &instr->cf_label, get_instr_dest(instr));
+  }
+  else if (instr->mnemo_notes[0] != '\0') {
+    fprintf(out, "# %s", instr->mnemo_notes);
+  }
+}
+
+/**
+ * Prints recfun-style listing, '?' marks instr. found by linear sweep only
+ *  xrefs => annotate labels with num. of references, NULL to omit
+ *  heat => prefix instr. with sample counts & labels with bblock totals, NULL to omit
+ */
+void print_instr_list(FILE *out, instr_t list[], int count, const xref_t *xrefs, const heat_t *heat) {
+  for (int i = 0; i < count; i++) {
+    if (has_label(&list[i])) {
+      const int *refs;
+      int n_refs = xrefs != NULL ? xref_lookup(xrefs, list[i].addr, &refs) : 0;
+      uint64_t hits = heat != NULL ? heat_block(heat, list, count, i) : 0;
+
+      char notes[64];
+      int pos = 0;
+      if (n_refs > 0)
+        pos += snprintf(notes + pos, sizeof(notes) - pos, "; xrefs: %d", n_refs);
+      if (hits > 0)
+        pos += snprintf(notes + pos, sizeof(notes) - pos, "%shits: %lu (%.1f%%)",
+                        pos > 0 ? ", " : "; ", hits, 100.0 * hits / heat->total);
+
+      int len = print_label(out, &list[i].label, list[i].addr);
+      if (pos > 0)
+        fprintf(out, ":%*s%s\n", len < 40 ? 40 - len : 1, "", notes);
+      else
+        fprintf(out, ":\n");
+    }
+
+    if (heat != NULL) {
+      uint64_t hits = heat_instr(heat, &list[i]);
+      if (hits > 0)
+        fprintf(out, "%10lu", hits);
+      else
+        fprintf(out, "%10s", "");
+    }
+
+    char addr_buf[24];
+    snprintf(addr_buf, sizeof(addr_buf), "0x%lx", list[i].addr);
+
+    fprintf(out, "  %c%s:%*s %-20s    %-5s %-20s ",
+            (list[i].flags & INSTR_SWEPT) ? '?' : ' ', // lower confidence
+            addr_buf,
+            (int)(strlen(addr_buf) < 7 ? 7 - strlen(addr_buf) : 0), "", // padding
+            list[i].hex_bytes,
+            list[i].mnemo_opcode,
+            list[i].mnemo_operand);
+    print_instr_note(out, &list[i]);
+    fprintf(out, "\n");
   }
 }
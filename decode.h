@@ -1,112 +1,222 @@
-#ifndef DECODE_H
-#define DECODE_H
-
-#define MSG_UNK_OPCODE "unknown instruction"
-
-#define MNEMO_OPCODE_LEN   8
-#define MNEMO_OPERAND_LEN  32
-#define MNEMO_NOTES_LEN    48
-#define MNEMO_CF_LABEL_LEN 32
-
-#define HEX_BYTES_LEN      32
-#define LABEL_LEN          32
-
-typedef unsigned char byte_t;
-
-typedef enum {
-  OP_ADD     = 0x05,
-  OP_XOR     = 0x35,
-  OP_CMP_39  = 0x39,
-  OP_CMP_3D  = 0x3D,
-  OP_PUSH_50 = 0x50,
-  OP_PUSH_51 = 0x51,
-  OP_PUSH_52 = 0x52,
-  OP_PUSH_53 = 0x53,
-  OP_PUSH_54 = 0x54,
-  OP_PUSH_55 = 0x55,
-  OP_PUSH_56 = 0x56,
-  OP_PUSH_57 = 0x57,
-  OP_POP_58  = 0x58,
-  OP_POP_59  = 0x59,
-  OP_POP_5A  = 0x5A,
-  OP_POP_5B  = 0x5B,
-  OP_POP_5C  = 0x5C,
-  OP_POP_5D  = 0x5D,
-  OP_POP_5E  = 0x5E,
-  OP_POP_5F  = 0x5F,
-  OP_PUSH_68 = 0x68,
-  OP_PUSH_6A = 0x6A,
-  OP_JB      = 0x72,
-  OP_JE      = 0x74,
-  OP_JNE     = 0x75,
-  OP_MOV_89  = 0x89,
-  OP_MOV_8B  = 0x8B,
-  OP_8F      = 0x8F, // pop reg/mem64 /0
-  OP_NOP     = 0x90,
-  OP_RET_C2  = 0xC2,
-  OP_RET_C3  = 0xC3,
-  OP_INT3    = 0xCC,
-  OP_CALL    = 0xE8,
-  OP_JMP_E9  = 0xE9,
-  OP_JMP_EB  = 0xEB,
-  OP_F7      = 0xF7, // mul reg/mem64 /4
-  OP_FF      = 0xFF  // call reg/mem64 /2, push reg/mem64 /6
-} opcode_t;
-
-typedef enum {
-  OP_EXT_JB      = 0x82,
-  OP_EXT_JE      = 0x84,
-  OP_EXT_JNE     = 0x85,
-  OP_EXT_NOP     = 0x1F,
-  OP_EXT_PUSH_FS = 0xA0,
-  OP_EXT_POP_FS  = 0xA1,
-  OP_EXT_PUSH_GS = 0xA8,
-  OP_EXT_POP_GS  = 0xA9,
-} ext_opcode_t;
-
-typedef struct {
-  bool w;
-  bool r;
-  bool x;
-  bool b;
-} rex_byte_t;
-
-typedef struct {
-  byte_t mod;
-  byte_t reg;
-  byte_t rm;
-} modrm_byte_t;
-
-typedef struct {
-  unsigned int addr;
-  size_t len;
-
-  char mnemo_opcode[MNEMO_OPCODE_LEN];
-  char mnemo_operand[MNEMO_OPERAND_LEN];
-  char mnemo_notes[MNEMO_NOTES_LEN];
-  char mnemo_cf_label[MNEMO_CF_LABEL_LEN];
-
-  char hex_bytes[HEX_BYTES_LEN];
-  char label[LABEL_LEN];
-  unsigned int sub_addr;
-
-  bool has_ext_opcode;
-  byte_t opcode;
-  long long value;
-
-  bool has_rex;
-  rex_byte_t rex;
-
-  bool has_modrm;
-  modrm_byte_t modrm;
-} instr_t;
-
-typedef enum {
-  DECODE_LINEAR,
-  DECODE_RECURSIVE
-} decode_mode_t;
-
-int decode(instr_t instr[], int instr_pos, byte_t bytes[], unsigned int vaddr, int len, decode_mode_t mode, unsigned int sub_addr);
-void proc_flow_labels(instr_t instr[], int count);
-
-#endif
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MSG_UNK_OPCODE "unknown instruction"
+
+#define MNEMO_OPCODE_LEN   8
+#define MNEMO_OPERAND_LEN  32
+#define MNEMO_NOTES_LEN    48
+
+#define HEX_BYTES_LEN      32
+
+#define MAX_INSTR_LEN      15
+
+typedef unsigned char byte_t;
+typedef uint64_t addr_t;
+
+typedef enum {
+  OP_ADD_01  = 0x01,
+  OP_ADD_03  = 0x03,
+  OP_ADD     = 0x05,
+  OP_XOR     = 0x35,
+  OP_CMP_39  = 0x39,
+  OP_CMP_3D  = 0x3D,
+  OP_PUSH_50 = 0x50,
+  OP_PUSH_51 = 0x51,
+  OP_PUSH_52 = 0x52,
+  OP_PUSH_53 = 0x53,
+  OP_PUSH_54 = 0x54,
+  OP_PUSH_55 = 0x55,
+  OP_PUSH_56 = 0x56,
+  OP_PUSH_57 = 0x57,
+  OP_POP_58  = 0x58,
+  OP_POP_59  = 0x59,
+  OP_POP_5A  = 0x5A,
+  OP_POP_5B  = 0x5B,
+  OP_POP_5C  = 0x5C,
+  OP_POP_5D  = 0x5D,
+  OP_POP_5E  = 0x5E,
+  OP_POP_5F  = 0x5F,
+  OP_PUSH_68 = 0x68,
+  OP_PUSH_6A = 0x6A,
+  OP_JB      = 0x72,
+  OP_JE      = 0x74,
+  OP_JNE     = 0x75,
+  OP_MOVSXD  = 0x63,
+  OP_JA      = 0x77,
+  OP_MOV_89  = 0x89,
+  OP_MOV_8B  = 0x8B,
+  OP_LEA     = 0x8D,
+  OP_8F      = 0x8F, // pop reg/mem64 /0
+  OP_NOP     = 0x90,
+  OP_RET_C2  = 0xC2,
+  OP_RET_C3  = 0xC3,
+  OP_INT3    = 0xCC,
+  OP_CALL    = 0xE8,
+  OP_JMP_E9  = 0xE9,
+  OP_JMP_EB  = 0xEB,
+  OP_F7      = 0xF7, // mul reg/mem64 /4
+  OP_FF      = 0xFF  // call reg/mem64 /2, jmp reg/mem64 /4, push reg/mem64 /6
+} opcode_t;
+
+typedef enum {
+  OP_EXT_JB      = 0x82,
+  OP_EXT_JE      = 0x84,
+  OP_EXT_JNE     = 0x85,
+  OP_EXT_JA      = 0x87,
+  OP_EXT_NOP     = 0x1F,
+  OP_EXT_PUSH_FS = 0xA0,
+  OP_EXT_POP_FS  = 0xA1,
+  OP_EXT_PUSH_GS = 0xA8,
+  OP_EXT_POP_GS  = 0xA9,
+} ext_opcode_t;
+
+typedef struct {
+  bool w;
+  bool r;
+  bool x;
+  bool b;
+} rex_byte_t;
+
+typedef struct {
+  byte_t mod;
+  byte_t reg;
+  byte_t rm;
+} modrm_byte_t;
+
+typedef struct {
+  byte_t scale;
+  byte_t index;
+  byte_t base;
+} sib_byte_t;
+
+// Block label, rendered only when printed (print_label())
+//  name => symbol name in mapped .strtab, NULL => sub_<base>
+//  Labelled addr other than base is appended as _<addr>
+typedef struct {
+  const char *name;
+  addr_t base;
+} label_t;
+
+typedef struct {
+  addr_t addr;
+
+  char mnemo_opcode[MNEMO_OPCODE_LEN];
+  char mnemo_operand[MNEMO_OPERAND_LEN];
+  char mnemo_notes[MNEMO_NOTES_LEN];
+
+  char hex_bytes[HEX_BYTES_LEN];
+  label_t label;    // valid if INSTR_LABEL, starts a bblock
+  label_t cf_label; // of jump/call dest., valid if INSTR_CF_LABEL
+  addr_t sub_addr;
+
+  bool has_ext_opcode;
+  byte_t opcode;
+  long long value;
+
+  bool has_rex;
+  rex_byte_t rex;
+
+  bool has_modrm;
+  modrm_byte_t modrm;
+
+  bool has_sib;
+  sib_byte_t sib;
+
+  byte_t len;
+  byte_t flags; // INSTR_*
+} instr_t;
+
+// instr_t.flags
+#define INSTR_SWEPT    0b001 // found by linear sweep of a gap, lower confidence
+#define INSTR_LABEL    0b010
+#define INSTR_CF_LABEL 0b100
+
+static inline bool has_label(const instr_t *instr) {
+  return instr->flags & INSTR_LABEL;
+}
+
+static inline void set_label(instr_t *instr, const char *name, addr_t base) {
+  instr->label.name = name;
+  instr->label.base = base;
+  instr->flags |= INSTR_LABEL;
+}
+
+// Relocation of ET_REL .text field, see get_elf_relocs()
+//  Targets outside region get stub addr past its end, like PLT after linking
+typedef struct {
+  addr_t addr;      // of relocated field
+  uint32_t type;    // R_X86_64_*
+  bool pc_rel;      // field is disp32/rel32, applied by decode()
+  bool local;       // target defined within region
+  addr_t target;    // symbol addr, or its stub
+  int64_t addend;
+  const char *name; // symbol, or section of section symbol
+} reloc_t;
+
+// Relocations by addr
+typedef struct {
+  reloc_t *relocs;
+  int n_relocs;
+} reloc_index_t;
+
+/**
+ * Address index, maps every byte of region to instr. covering it
+ */
+typedef struct {
+  addr_t vaddr;
+  size_t len;
+  int *slot; // index into instr[], -1 if not decoded
+  const reloc_index_t *relocs; // applied to decoded instr., NULL if none
+} addr_index_t;
+
+typedef enum {
+  FLOW_NONE,
+  FLOW_JCC,  // conditional rel. jump
+  FLOW_JMP,  // unconditional rel. jump
+  FLOW_CALL, // rel. call
+  FLOW_RET,
+  FLOW_IJMP  // indirect jump, jmp reg/mem64
+} flow_t;
+
+typedef enum {
+  DECODE_LINEAR,
+  DECODE_RECURSIVE,
+  DECODE_FUNCTION  // recursive, but calls are not followed
+} decode_mode_t;
+
+int index_init(addr_index_t *index, addr_t vaddr, size_t len);
+void index_free(addr_index_t *index);
+void index_add(addr_index_t *index, instr_t instr[], int from, int to);
+int index_lookup(const addr_index_t *index, addr_t addr);
+size_t index_covered(const addr_index_t *index);
+int reloc_lookup(const reloc_index_t *relocs, addr_t from, addr_t to);
+int index_sort(addr_index_t *index, instr_t instr[], int count);
+
+size_t decode_instr(instr_t *instr, byte_t bytes[], addr_t vaddr, size_t pos, addr_t sub_addr);
+size_t decode_instr_reloc(instr_t *instr, byte_t bytes[], addr_t vaddr, size_t pos, addr_t sub_addr,
+                          const reloc_index_t *relocs);
+int decode(instr_t instr[], int instr_pos, byte_t bytes[], addr_t vaddr, size_t len, addr_t start, decode_mode_t mode, addr_t sub_addr, addr_index_t *index);
+int decode_gaps(instr_t instr[], int instr_pos, byte_t bytes[], addr_index_t *index);
+int decode_length(const byte_t bytes[], size_t len, flow_t *flow, long long *rel);
+void decode_boundaries(const byte_t bytes[], size_t len, uint64_t mask[]);
+int find_instr(instr_t list[], int count, addr_t addr);
+addr_t get_instr_dest(const instr_t *instr);
+flow_t get_instr_flow(const instr_t *instr);
+void proc_value_note(instr_t *instr);
+void proc_jump_note(instr_t *instr, const label_t *dest_label);
+void proc_flow_labels(instr_t instr[], int count);
+bool is_instr_rip_relative(const instr_t *instr);
+
+int print_label(FILE *out, const label_t *label, addr_t addr);
+void print_instr_note(FILE *out, const instr_t *instr);
+
+struct xref;
+struct heat;
+void print_instr_list(FILE *out, instr_t list[], int count, const struct xref *xrefs, const struct heat *heat);
+
+#endif
@@ -1,189 +1,1215 @@
-#include <stdio.h>
-#include <stdbool.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/mman.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <elf.h>
-#include <unistd.h>
-
-#include "elf.h"
-
-int get_elf_sections(byte_t *bin, section_t sections[], int *n_sections) {
-  Elf64_Ehdr *ehdr = (Elf64_Ehdr *)bin;
-
-  // Get section header of "section name" string table
-  Elf64_Shdr *shdr_section_name_table = NULL;
-  if (ehdr->e_shstrndx != SHN_XINDEX) {
-    shdr_section_name_table = (Elf64_Shdr *)(bin + ehdr->e_shoff + (ehdr->e_shstrndx * ehdr->e_shentsize));
-  }
-  else {
-    int ndx = ((Elf64_Shdr *)(bin + ehdr->e_shoff))->sh_link;
-    shdr_section_name_table = (Elf64_Shdr *)(bin + ehdr->e_shoff + (ndx * ehdr->e_shentsize));
-  }
-
-  // Find .text section among all sections
-  *n_sections = ehdr->e_shnum;
-  for (int i = 0; i < ehdr->e_shnum; i++) {
-    Elf64_Shdr *shdr = (Elf64_Shdr *)(bin + ehdr->e_shoff + (i * ehdr->e_shentsize));
-    sections[i].vaddr = shdr->sh_addr;
-    sections[i].elf_offset = shdr->sh_offset;
-    sections[i].size = shdr->sh_size;
-    sections[i].name = (char *)(bin + shdr_section_name_table->sh_offset + shdr->sh_name);
-  }
-
-  return 0;
-}
-
-int get_elf_info(byte_t *bin, section_t sections[], int n_sections, uintptr_t *entry, uintptr_t *vaddr, uintptr_t *text_offset, int *text_size) {
-  Elf64_Ehdr *ehdr = (Elf64_Ehdr *)bin;
-  *entry = ehdr->e_entry;
-
-  // Get vaddr
-  /*
-  *vaddr = 0;
-  for (int i = 0; i < ehdr->e_phnum; i++) {
-    Elf64_Phdr *phdr = (Elf64_Phdr *)(bin + ehdr->e_phoff + (i * ehdr->e_phentsize));
-    if (phdr->p_type == PT_LOAD && phdr->p_offset == 0) {
-      *vaddr = phdr->p_vaddr;
-      break;
-    }
-  }
-  */
-
-  for (int i = 0; i < n_sections; i++) {
-    if (!strncmp(sections[i].name, ".text", 5)) {
-      *vaddr = sections[i].vaddr;
-      *text_offset = sections[i].elf_offset;
-      *text_size = sections[i].size;
-      return 0;
-    }
-  }
-
-  printf("Could not find .text section!\n");
-  return 1;
-}
-
-int get_elf_symtab(byte_t *bin, section_t sections[], int n_sections, symbol_t symbols[], int *n_symbols) {
-  section_t *s_symtab = NULL, *s_strtab = NULL;
-  for (int i = 0; i < n_sections; i++) {
-    if (!strncmp(sections[i].name, ".symtab", 5)) {
-      s_symtab = &sections[i];
-    }
-    else if (!strncmp(sections[i].name, ".strtab", 5)) {
-      s_strtab = &sections[i];
-    }
-  }
-
-  if (s_symtab == NULL) {
-    printf("Could not find .symtab section!\n");
-    *n_symbols = 0;
-    return 0;
-  }
-  if (s_strtab == NULL) {
-    printf("Could not find .strtab section!\n");
-    *n_symbols = 0;
-    return 0;
-  }
-
-  *n_symbols = 0;
-  for (int i = 0; i * sizeof(Elf64_Sym) < s_symtab->size; i++) {
-    Elf64_Sym *sym = (Elf64_Sym *)(bin + s_symtab->elf_offset + (i * sizeof(Elf64_Sym)));
-    char *name = (char *)(bin + s_strtab->elf_offset + sym->st_name);
-    if (sym->st_name != 0 && name[0] != '\0') {
-      symbols[*n_symbols].value = sym->st_value;
-      symbols[*n_symbols].size = sym->st_size;
-      symbols[*n_symbols].type = ELF64_ST_TYPE(sym->st_info);
-      symbols[*n_symbols].binding = ELF64_ST_BIND(sym->st_info);
-      symbols[*n_symbols].name = name;
-      symbols[*n_symbols].shndx = sym->st_shndx;
-
-      (*n_symbols)++;
-    }
-  }
-
-  return 0;
-}
-
-int load_file(const char *path, int *fd, byte_t **bin, int *fsize) {
-  // Open file for reading
-  *fd = open(path, O_RDONLY);
-  if (*fd < 0) {
-    printf("Could not open file: %s\n", path);
-    return 1;
-  }
-
-  // Get file size
-  struct stat stat_buf;
-  fstat(*fd, &stat_buf);
-  *fsize = stat_buf.st_size;
-
-  // Map file to memory
-  *bin = (byte_t *)mmap(NULL, *fsize, PROT_READ, MAP_PRIVATE, *fd, 0);
-  if (*bin < 0) {
-    printf("Could not mmap file: %s\n", path);
-    close(*fd);
-    return 1;
-  }
-
-  return 0;
-}
-
-int close_file(byte_t *bin, int fd, int fsize) {
-  munmap(bin, fsize);
-  close(fd);
-  return 0;
-}
-
-void proc_section_labels(instr_t instr[], int count, section_t sections[], int n_sections) {
-  for (int i = 0; i < count; i++) {
-    // Should print note?
-    if (!instr[i].has_ext_opcode) {
-      switch (instr[i].opcode) {
-        case OP_MOV_89:
-        case OP_MOV_8B:
-          if (instr[i].modrm.mod != 0b11
-              && strstr(instr[i].mnemo_operand, "(\%rip)") != NULL) { // strstr LULZ
-            long long dest = instr[i].addr + instr[i].len + instr[i].value;
-            bool done = false;
-
-            for (int j = 0; j < n_sections; j++) {
-              if (dest >= sections[j].vaddr && dest < sections[j].vaddr + sections[j].size) {
-                snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN,
-                    "%s + 0x%llx", sections[j].name, dest - sections[j].vaddr);
-                done = true;
-                break;
-              }
-            }
-
-            if (!done) {
-              snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN, "0x%llx", dest);
-            }
-          }
-          break;
-      }
-    }
-  }
-}
-
-void proc_symtab_labels(instr_t instr[], int count, symbol_t symbols[], int n_symbols) {
-  for (int i = 0; i < count; i++) {
-    for (int j = 0; j < n_symbols; j++) {
-      // Entrypoint match?
-      if (instr[i].addr == symbols[j].value) {
-        snprintf(instr[i].label, LABEL_LEN, "%s", symbols[j].name);
-        break;
-      }
-
-      // Rename all unnamed bblocks
-      if (instr[i].label[0] != '\0'
-          && instr[i].sub_addr == symbols[j].value
-          && !strncmp(instr[i].label, "sub_", 4)) {
-        snprintf(instr[i].label, LABEL_LEN, "%s_%x", symbols[j].name, instr[i].addr);
-        break;
-      }
-    }
-  }
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <unistd.h>
+
+#include "elf.h"
+
+static FILE *notice_out = NULL; // non-fatal notices, NULL => stdout
+
+/**
+ * Where non-fatal notices (missing .symtab, ...) go, e.g. stderr when
+ *  stdout carries JSON Lines records
+ */
+void set_elf_notice_out(FILE *out) {
+  notice_out = out;
+}
+
+/**
+ * Checks if the mapped file starts with a 64-bit ELF header
+ *  return => true if header is complete and has ELF magic
+ */
+bool is_elf_file(byte_t *bin, size_t fsize) {
+  return fsize >= sizeof(Elf64_Ehdr)
+      && bin[EI_MAG0] == ELFMAG0 && bin[EI_MAG1] == ELFMAG1
+      && bin[EI_MAG2] == ELFMAG2 && bin[EI_MAG3] == ELFMAG3
+      && bin[EI_CLASS] == ELFCLASS64;
+}
+
+/**
+ * Checks if [offset, offset + size) lies within the file
+ */
+static bool in_file(size_t fsize, uint64_t offset, uint64_t size) {
+  return offset <= fsize && size <= fsize - offset;
+}
+
+int get_elf_sections(byte_t *bin, size_t fsize, section_t sections[], int *n_sections) {
+  Elf64_Ehdr *ehdr = (Elf64_Ehdr *)bin;
+  *n_sections = 0;
+
+  if (ehdr->e_shoff == 0) {
+    printf("Could not find section headers!\n");
+    return 1;
+  }
+  if (ehdr->e_shentsize != sizeof(Elf64_Shdr)
+      || !in_file(fsize, ehdr->e_shoff, sizeof(Elf64_Shdr))) {
+    printf("Could not parse section headers, invalid offset!\n");
+    return 1;
+  }
+
+  // Section count and name table index may be stored in section 0
+  Elf64_Shdr *shdr_table = (Elf64_Shdr *)(bin + ehdr->e_shoff);
+  uint64_t shnum = ehdr->e_shnum != 0 ? ehdr->e_shnum : shdr_table[0].sh_size;
+  uint64_t shstrndx = ehdr->e_shstrndx != SHN_XINDEX ? ehdr->e_shstrndx : shdr_table[0].sh_link;
+
+  if (shnum > MAX_SECTIONS) {
+    printf("Could not parse section headers, too many sections (%lu)!\n", shnum);
+    return 1;
+  }
+  if (!in_file(fsize, ehdr->e_shoff, shnum * sizeof(Elf64_Shdr))) {
+    printf("Could not parse section headers, table is truncated!\n");
+    return 1;
+  }
+
+  // Get section header of "section name" string table
+  Elf64_Shdr *shdr_section_name_table = NULL;
+  if (shstrndx < shnum && shdr_table[shstrndx].sh_type != SHT_NOBITS
+      && in_file(fsize, shdr_table[shstrndx].sh_offset, shdr_table[shstrndx].sh_size)) {
+    shdr_section_name_table = &shdr_table[shstrndx];
+  }
+
+  for (uint64_t i = 0; i < shnum; i++) {
+    Elf64_Shdr *shdr = &shdr_table[i];
+    sections[i].vaddr = shdr->sh_addr;
+    sections[i].elf_offset = shdr->sh_offset;
+    sections[i].size = shdr->sh_size;
+    sections[i].type = shdr->sh_type;
+    sections[i].flags = shdr->sh_flags;
+
+    // NOBITS occupy no file bytes, anything else must be fully backed
+    if (shdr->sh_type == SHT_NOBITS) {
+      sections[i].elf_offset = 0;
+    }
+    else if (!in_file(fsize, shdr->sh_offset, shdr->sh_size)) {
+      printf("Could not parse section %lu, range exceeds file!\n", i);
+      return 1;
+    }
+
+    // Name must be terminated within the name table
+    sections[i].name = "";
+    if (shdr_section_name_table != NULL
+        && shdr->sh_name < shdr_section_name_table->sh_size) {
+      char *name = (char *)(bin + shdr_section_name_table->sh_offset + shdr->sh_name);
+      if (memchr(name, '\0', shdr_section_name_table->sh_size - shdr->sh_name) != NULL) {
+        sections[i].name = name;
+      }
+    }
+  }
+
+  *n_sections = shnum;
+  return 0;
+}
+
+int get_elf_info(byte_t *bin, section_t sections[], int n_sections, uintptr_t *entry, uintptr_t *vaddr, uintptr_t *text_offset, size_t *text_size) {
+  Elf64_Ehdr *ehdr = (Elf64_Ehdr *)bin;
+  *entry = ehdr->e_entry;
+
+  // Get vaddr
+  /*
+  *vaddr = 0;
+  for (int i = 0; i < ehdr->e_phnum; i++) {
+    Elf64_Phdr *phdr = (Elf64_Phdr *)(bin + ehdr->e_phoff + (i * ehdr->e_phentsize));
+    if (phdr->p_type == PT_LOAD && phdr->p_offset == 0) {
+      *vaddr = phdr->p_vaddr;
+      break;
+    }
+  }
+  */
+
+  for (int i = 0; i < n_sections; i++) {
+    if (!strncmp(sections[i].name, ".text", 5)) {
+      *vaddr = sections[i].vaddr;
+      *text_offset = sections[i].elf_offset;
+      *text_size = sections[i].size;
+      return 0;
+    }
+  }
+
+  printf("Could not find .text section!\n");
+  return 1;
+}
+
+int get_elf_symtab(byte_t *bin, section_t sections[], int n_sections, symbol_t **symbols, int *n_symbols) {
+  section_t *s_symtab = NULL, *s_strtab = NULL;
+  *symbols = NULL;
+  *n_symbols = 0;
+
+  for (int i = 0; i < n_sections; i++) {
+    if (!strncmp(sections[i].name, ".symtab", 5)) {
+      s_symtab = &sections[i];
+    }
+    else if (!strncmp(sections[i].name, ".strtab", 5)) {
+      s_strtab = &sections[i];
+    }
+  }
+
+  if (s_symtab == NULL) {
+    fprintf(notice_out != NULL ? notice_out : stdout, "Could not find .symtab section!\n");
+    return 0;
+  }
+  if (s_strtab == NULL) {
+    fprintf(notice_out != NULL ? notice_out : stdout, "Could not find .strtab section!\n");
+    return 0;
+  }
+  if (s_symtab->type == SHT_NOBITS || s_strtab->type == SHT_NOBITS) {
+    return 0;
+  }
+
+  size_t max_symbols = s_symtab->size / sizeof(Elf64_Sym);
+  if (max_symbols == 0) {
+    return 0;
+  }
+
+  *symbols = (symbol_t *)malloc(max_symbols * sizeof(symbol_t));
+  if (*symbols == NULL) {
+    printf("Could not allocate memory for symbols!\n");
+    return 1;
+  }
+
+  // Ranges were validated by get_elf_sections, only names need checking
+  const char *strtab = (const char *)(bin + s_strtab->elf_offset);
+  for (size_t i = 0; i < max_symbols; i++) {
+    Elf64_Sym *sym = (Elf64_Sym *)(bin + s_symtab->elf_offset + (i * sizeof(Elf64_Sym)));
+    if (sym->st_name == 0 || sym->st_name >= s_strtab->size
+        || memchr(strtab + sym->st_name, '\0', s_strtab->size - sym->st_name) == NULL) {
+      continue;
+    }
+
+    char *name = (char *)(strtab + sym->st_name);
+    if (name[0] != '\0') {
+      (*symbols)[*n_symbols].value = sym->st_value;
+      (*symbols)[*n_symbols].size = sym->st_size;
+      (*symbols)[*n_symbols].type = ELF64_ST_TYPE(sym->st_info);
+      (*symbols)[*n_symbols].binding = ELF64_ST_BIND(sym->st_info);
+      (*symbols)[*n_symbols].name = name;
+      (*symbols)[*n_symbols].shndx = sym->st_shndx;
+
+      (*n_symbols)++;
+    }
+  }
+
+  return 0;
+}
+
+static uint32_t hash_name(const char *name) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (; *name != '\0'; name++)
+    h = (h ^ (byte_t)*name) * 16777619u;
+  return h;
+}
+
+/**
+ * Builds open-addressing hash of defined symbols by name
+ *  Duplicate names keep the first definition
+ *  return => 0 on success
+ */
+int symbol_index_init(symbol_index_t *index, symbol_t symbols[], int n_symbols) {
+  size_t cap = 16;
+  while (cap < (size_t)n_symbols * 2)
+    cap <<= 1;
+
+  index->symbols = symbols;
+  index->mask = cap - 1;
+  index->slot = (int *)malloc(cap * sizeof(int));
+  if (index->slot == NULL) {
+    printf("Could not allocate memory for symbol index!\n");
+    return 1;
+  }
+  memset(index->slot, -1, cap * sizeof(int));
+
+  for (int i = 0; i < n_symbols; i++) {
+    if (symbols[i].shndx == SHN_UNDEF)
+      continue;
+
+    size_t s = hash_name(symbols[i].name) & index->mask;
+    while (index->slot[s] >= 0 && strcmp(symbols[index->slot[s]].name, symbols[i].name))
+      s = (s + 1) & index->mask;
+    if (index->slot[s] < 0)
+      index->slot[s] = i;
+  }
+
+  return 0;
+}
+
+void symbol_index_free(symbol_index_t *index) {
+  free(index->slot);
+  index->slot = NULL;
+}
+
+/**
+ * return => defined symbol with given name, NULL if none
+ */
+symbol_t *symbol_index_find(const symbol_index_t *index, const char *name) {
+  size_t s = hash_name(name) & index->mask;
+  while (index->slot[s] >= 0) {
+    symbol_t *sym = &index->symbols[index->slot[s]];
+    if (!strcmp(sym->name, name))
+      return sym;
+    s = (s + 1) & index->mask;
+  }
+
+  return NULL;
+}
+
+/**
+ * Looks up defined .dynsym symbol through .gnu.hash, no table is built
+ *  return => 0 if found
+ */
+int get_elf_gnu_hash_symbol(byte_t *bin, section_t sections[], int n_sections, const char *name, symbol_t *sym) {
+  section_t *s_hash = NULL, *s_dynsym = NULL, *s_dynstr = NULL;
+  for (int i = 0; i < n_sections; i++) {
+    if (sections[i].type == SHT_GNU_HASH)
+      s_hash = &sections[i];
+    else if (sections[i].type == SHT_DYNSYM)
+      s_dynsym = &sections[i];
+    else if (!strcmp(sections[i].name, ".dynstr"))
+      s_dynstr = &sections[i];
+  }
+  if (s_hash == NULL || s_dynsym == NULL || s_dynstr == NULL || s_hash->size < 16)
+    return 1;
+
+  const uint32_t *hdr = (const uint32_t *)(bin + s_hash->elf_offset);
+  uint32_t n_buckets = hdr[0], sym_offset = hdr[1], bloom_size = hdr[2], bloom_shift = hdr[3];
+  size_t n_words = (s_hash->size - 16) / 4;
+  if (n_buckets == 0 || bloom_size == 0
+      || (uint64_t)bloom_size * 2 + n_buckets > n_words)
+    return 1;
+
+  const uint64_t *bloom = (const uint64_t *)&hdr[4];
+  const uint32_t *buckets = &hdr[4 + bloom_size * 2];
+  const uint32_t *chain = &buckets[n_buckets];
+  size_t n_chain = n_words - bloom_size * 2 - n_buckets;
+  const Elf64_Sym *dynsym = (const Elf64_Sym *)(bin + s_dynsym->elf_offset);
+  size_t n_dynsym = s_dynsym->size / sizeof(Elf64_Sym);
+  const char *dynstr = (const char *)(bin + s_dynstr->elf_offset);
+
+  uint32_t h = 5381;
+  for (const char *c = name; *c != '\0'; c++)
+    h = h * 33 + (byte_t)*c;
+
+  // Bloom filter rejects most misses without touching the chains
+  uint64_t word = bloom[(h / 64) % bloom_size];
+  uint64_t mask = (1ULL << (h % 64)) | (1ULL << ((h >> bloom_shift) % 64));
+  if ((word & mask) != mask)
+    return 1;
+
+  for (uint32_t i = buckets[h % n_buckets]; i >= sym_offset && i < n_dynsym
+       && i - sym_offset < n_chain; i++) {
+    uint32_t h2 = chain[i - sym_offset];
+    const Elf64_Sym *s = &dynsym[i];
+    if ((h | 1) == (h2 | 1) && s->st_name < s_dynstr->size
+        && !strncmp(name, dynstr + s->st_name, s_dynstr->size - s->st_name)
+        && s->st_shndx != SHN_UNDEF) {
+      sym->value = s->st_value;
+      sym->size = s->st_size;
+      sym->type = ELF64_ST_TYPE(s->st_info);
+      sym->binding = ELF64_ST_BIND(s->st_info);
+      sym->name = (char *)(dynstr + s->st_name);
+      sym->shndx = s->st_shndx;
+      return 0;
+    }
+    if (h2 & 1)
+      break;
+  }
+
+  return 1;
+}
+
+// GOT slot => .dynsym index, from JUMP_SLOT/GLOB_DAT relocations
+typedef struct {
+  uintptr_t got;
+  uint32_t sym;
+} got_slot_t;
+
+static int compare_got_slot(const void *a, const void *b) {
+  uintptr_t x = ((const got_slot_t *)a)->got, y = ((const got_slot_t *)b)->got;
+  return (x > y) - (x < y);
+}
+
+static inline size_t hash_addr(uintptr_t addr) {
+  uint64_t h = (uint64_t)addr * 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> 32);
+}
+
+/**
+ * Matches jmp *GOT(%rip) of PLT stub at bytes[off], endbr64 & bnd allowed
+ *  return => GOT slot addr, 0 if there's no stub; end => offset past the jmp
+ */
+static uintptr_t read_plt_stub(const byte_t bytes[], size_t size, uintptr_t vaddr, size_t off, size_t *end) {
+  if (off + 4 <= size && !memcmp(&bytes[off], "\xf3\x0f\x1e\xfa", 4))
+    off += 4;
+  if (off < size && bytes[off] == 0xf2)
+    off++;
+  if (off + 6 > size || bytes[off] != 0xff || bytes[off + 1] != 0x25)
+    return 0;
+
+  int32_t disp;
+  memcpy(&disp, &bytes[off + 2], sizeof(int32_t));
+  *end = off + 6;
+  return vaddr + off + 6 + disp;
+}
+
+/**
+ * Maps PLT stubs (.plt, .plt.sec, .plt.got) to symbols they jump to
+ *  Stub's GOT slot is named by .rela.plt/.rela.dyn relocation against .dynsym
+ *  plt => empty if there are no imports, free with plt_index_free()
+ *  return => 0 on success
+ */
+int get_elf_plt(byte_t *bin, section_t sections[], int n_sections, plt_index_t *plt) {
+  section_t *s_dynsym = NULL, *s_dynstr = NULL;
+  size_t n_relas = 0, max_stubs = 0;
+  memset(plt, 0, sizeof(plt_index_t));
+
+  for (int i = 0; i < n_sections; i++) {
+    if (sections[i].type == SHT_DYNSYM)
+      s_dynsym = &sections[i];
+    else if (!strcmp(sections[i].name, ".dynstr"))
+      s_dynstr = &sections[i];
+    else if (sections[i].type == SHT_RELA
+             && (!strcmp(sections[i].name, ".rela.plt") || !strcmp(sections[i].name, ".rela.dyn")))
+      n_relas += sections[i].size / sizeof(Elf64_Rela);
+    else if (sections[i].type == SHT_PROGBITS && !strncmp(sections[i].name, ".plt", 4))
+      max_stubs += sections[i].size / 6;
+  }
+  if (s_dynsym == NULL || s_dynstr == NULL || s_dynstr->type == SHT_NOBITS
+      || n_relas == 0 || max_stubs == 0)
+    return 0;
+
+  got_slot_t *slots = (got_slot_t *)malloc(n_relas * sizeof(got_slot_t));
+  plt->entries = (plt_entry_t *)malloc(max_stubs * sizeof(plt_entry_t));
+  if (slots == NULL || plt->entries == NULL) {
+    printf("Could not allocate memory for PLT!\n");
+    goto ERR_FREE;
+  }
+
+  // Imported GOT slots, sorted for lookup by stubs
+  const Elf64_Sym *dynsym = (const Elf64_Sym *)(bin + s_dynsym->elf_offset);
+  size_t n_dynsym = s_dynsym->size / sizeof(Elf64_Sym);
+  const char *dynstr = (const char *)(bin + s_dynstr->elf_offset);
+  size_t n_slots = 0;
+  for (int i = 0; i < n_sections; i++) {
+    if (sections[i].type != SHT_RELA
+        || (strcmp(sections[i].name, ".rela.plt") && strcmp(sections[i].name, ".rela.dyn")))
+      continue;
+
+    const Elf64_Rela *rela = (const Elf64_Rela *)(bin + sections[i].elf_offset);
+    for (size_t j = 0; j < sections[i].size / sizeof(Elf64_Rela); j++) {
+      uint32_t type = ELF64_R_TYPE(rela[j].r_info), sym = ELF64_R_SYM(rela[j].r_info);
+      if ((type != R_X86_64_JUMP_SLOT && type != R_X86_64_GLOB_DAT) || sym == 0 || sym >= n_dynsym)
+        continue;
+
+      uint32_t st_name = dynsym[sym].st_name;
+      if (st_name == 0 || st_name >= s_dynstr->size
+          || memchr(dynstr + st_name, '\0', s_dynstr->size - st_name) == NULL)
+        continue;
+      slots[n_slots++] = (got_slot_t){ rela[j].r_offset, sym };
+    }
+  }
+  qsort(slots, n_slots, sizeof(got_slot_t), compare_got_slot);
+
+  // Stubs, names point into .dynstr till they get their @plt copy
+  size_t names_len = 0;
+  for (int i = 0; i < n_sections && n_slots > 0; i++) {
+    if (sections[i].type != SHT_PROGBITS || strncmp(sections[i].name, ".plt", 4))
+      continue;
+
+    const byte_t *bytes = bin + sections[i].elf_offset;
+    for (size_t off = 0, end; off < sections[i].size; ) {
+      got_slot_t key = { read_plt_stub(bytes, sections[i].size, sections[i].vaddr, off, &end), 0 };
+      got_slot_t *slot = key.got != 0
+          ? (got_slot_t *)bsearch(&key, slots, n_slots, sizeof(got_slot_t), compare_got_slot) : NULL;
+      if (slot == NULL) {
+        off++;
+        continue;
+      }
+
+      char *name = (char *)(dynstr + dynsym[slot->sym].st_name);
+      plt->entries[plt->n_entries++] = (plt_entry_t){ sections[i].vaddr + off, name };
+      names_len += strlen(name) + sizeof("@plt");
+      off = end;
+    }
+  }
+  free(slots);
+  slots = NULL;
+  if (plt->n_entries == 0) {
+    plt_index_free(plt);
+    return 0;
+  }
+
+  size_t cap = 16;
+  while (cap < (size_t)plt->n_entries * 2)
+    cap <<= 1;
+  plt->mask = cap - 1;
+  plt->slot = (int *)malloc(cap * sizeof(int));
+  plt->names = (char *)malloc(names_len);
+  if (plt->slot == NULL || plt->names == NULL) {
+    printf("Could not allocate memory for PLT!\n");
+    goto ERR_FREE;
+  }
+  memset(plt->slot, -1, cap * sizeof(int));
+
+  char *pos = plt->names;
+  for (int i = 0; i < plt->n_entries; i++) {
+    char *name = pos;
+    pos += sprintf(pos, "%s@plt", plt->entries[i].name) + 1;
+    plt->entries[i].name = name;
+
+    size_t s = hash_addr(plt->entries[i].addr) & plt->mask;
+    while (plt->slot[s] >= 0 && plt->entries[plt->slot[s]].addr != plt->entries[i].addr)
+      s = (s + 1) & plt->mask;
+    if (plt->slot[s] < 0)
+      plt->slot[s] = i;
+  }
+
+  return 0;
+
+ERR_FREE:
+  free(slots);
+  plt_index_free(plt);
+  return 1;
+}
+
+void plt_index_free(plt_index_t *plt) {
+  free(plt->entries);
+  free(plt->names);
+  free(plt->slot);
+  memset(plt, 0, sizeof(plt_index_t));
+}
+
+/**
+ * return => PLT stub starting at addr, NULL if none
+ */
+const plt_entry_t *plt_index_find(const plt_index_t *plt, uintptr_t addr) {
+  if (plt->slot == NULL)
+    return NULL;
+
+  size_t s = hash_addr(addr) & plt->mask;
+  while (plt->slot[s] >= 0) {
+    const plt_entry_t *entry = &plt->entries[plt->slot[s]];
+    if (entry->addr == addr)
+      return entry;
+    s = (s + 1) & plt->mask;
+  }
+
+  return NULL;
+}
+
+static int compare_reloc_addr(const void *a, const void *b) {
+  addr_t x = ((const reloc_t *)a)->addr, y = ((const reloc_t *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Parses .rela.<text> of ET_REL object, relocations by addr
+ *  Symbols of .text resolve to their addr, all others to stub past .text end
+ *  relocs => empty if not an object file, free with reloc_index_free()
+ *  return => 0 on success
+ */
+int get_elf_relocs(byte_t *bin, section_t sections[], int n_sections, uintptr_t text_offset, reloc_index_t *relocs) {
+  Elf64_Ehdr *ehdr = (Elf64_Ehdr *)bin;
+  relocs->relocs = NULL;
+  relocs->n_relocs = 0;
+  if (ehdr->e_type != ET_REL)
+    return 0;
+
+  int text = -1;
+  section_t *s_rela = NULL, *s_symtab = NULL, *s_strtab = NULL;
+  for (int i = 0; i < n_sections && text < 0; i++) {
+    if (sections[i].type == SHT_PROGBITS && sections[i].elf_offset == text_offset)
+      text = i;
+  }
+  if (text < 0)
+    return 0;
+
+  for (int i = 0; i < n_sections; i++) {
+    if (sections[i].type == SHT_RELA && !strncmp(sections[i].name, ".rela", 5)
+        && !strcmp(sections[i].name + 5, sections[text].name))
+      s_rela = &sections[i];
+    else if (sections[i].type == SHT_SYMTAB)
+      s_symtab = &sections[i];
+    else if (!strcmp(sections[i].name, ".strtab"))
+      s_strtab = &sections[i];
+  }
+  if (s_rela == NULL || s_symtab == NULL || s_strtab == NULL || s_strtab->type == SHT_NOBITS)
+    return 0;
+
+  size_t n_relas = s_rela->size / sizeof(Elf64_Rela);
+  relocs->relocs = (reloc_t *)malloc((n_relas > 0 ? n_relas : 1) * sizeof(reloc_t));
+  if (relocs->relocs == NULL) {
+    printf("Could not allocate memory for relocations!\n");
+    return 1;
+  }
+
+  const Elf64_Rela *rela = (const Elf64_Rela *)(bin + s_rela->elf_offset);
+  const Elf64_Sym *symtab = (const Elf64_Sym *)(bin + s_symtab->elf_offset);
+  size_t n_syms = s_symtab->size / sizeof(Elf64_Sym);
+  const char *strtab = (const char *)(bin + s_strtab->elf_offset);
+  addr_t vaddr = sections[text].vaddr;
+  addr_t stubs = (vaddr + sections[text].size + 15) & ~(addr_t)15;
+
+  for (size_t i = 0; i < n_relas; i++) {
+    uint32_t type = ELF64_R_TYPE(rela[i].r_info), sym = ELF64_R_SYM(rela[i].r_info);
+    if (sym == 0 || sym >= n_syms || rela[i].r_offset >= sections[text].size)
+      continue;
+
+    // Section symbols are named by their section
+    const Elf64_Sym *s = &symtab[sym];
+    const char *name = NULL;
+    if (ELF64_ST_TYPE(s->st_info) == STT_SECTION) {
+      if (s->st_shndx < n_sections)
+        name = sections[s->st_shndx].name;
+    }
+    else if (s->st_name < s_strtab->size
+             && memchr(strtab + s->st_name, '\0', s_strtab->size - s->st_name) != NULL) {
+      name = strtab + s->st_name;
+    }
+    if (name == NULL || name[0] == '\0')
+      continue;
+
+    reloc_t *rel = &relocs->relocs[relocs->n_relocs++];
+    rel->addr = vaddr + rela[i].r_offset;
+    rel->type = type;
+    rel->pc_rel = type == R_X86_64_PC32 || type == R_X86_64_PLT32 || type == R_X86_64_GOTPCREL
+               || type == R_X86_64_GOTPCRELX || type == R_X86_64_REX_GOTPCRELX;
+    rel->local = s->st_shndx == text && rel->pc_rel
+              && type != R_X86_64_GOTPCREL && type != R_X86_64_GOTPCRELX && type != R_X86_64_REX_GOTPCRELX;
+    rel->target = rel->local ? vaddr + s->st_value : stubs + (addr_t)sym * 16;
+    rel->addend = rela[i].r_addend;
+    rel->name = name;
+  }
+
+  qsort(relocs->relocs, relocs->n_relocs, sizeof(reloc_t), compare_reloc_addr);
+  return 0;
+}
+
+void reloc_index_free(reloc_index_t *relocs) {
+  free(relocs->relocs);
+  relocs->relocs = NULL;
+  relocs->n_relocs = 0;
+}
+
+/**
+ * Resolves function query to [start, end) within .text
+ *  query => symbol name or start:end (hex)
+ *  index => .symtab name index, NULL to use only .gnu.hash
+ *  Symbol size comes from symtab, then from .eh_frame, else till end of .text
+ *  found => matched symbol (.dynsym ones are not in symbols[]), name NULL for range
+ *  return => 0 on success
+ */
+int get_elf_range(const char *query, byte_t *bin, section_t sections[], int n_sections,
+                  const symbol_index_t *index, fde_t fdes[], int n_fdes,
+                  uintptr_t vaddr, size_t size, uintptr_t *start, uintptr_t *end, symbol_t *found) {
+  found->name = NULL;
+  const char *sep = strchr(query, ':');
+  if (sep != NULL) {
+    char *rest;
+    *start = strtoull(query, &rest, 16);
+    if (rest != sep || sep[1] == '\0') {
+      printf("Could not parse address range: %s\n", query);
+      return 1;
+    }
+    *end = strtoull(sep + 1, &rest, 16);
+    if (*rest != '\0') {
+      printf("Could not parse address range: %s\n", query);
+      return 1;
+    }
+  }
+  else {
+    symbol_t *sym = NULL, dynsym;
+    if (index != NULL)
+      sym = symbol_index_find(index, query);
+    if (sym == NULL && !get_elf_gnu_hash_symbol(bin, sections, n_sections, query, &dynsym))
+      sym = &dynsym;
+    if (sym == NULL) {
+      printf("Could not find symbol: %s\n", query);
+      return 1;
+    }
+
+    *found = *sym;
+    *start = sym->value;
+    *end = sym->size > 0 ? sym->value + sym->size : vaddr + size;
+    if (sym->size == 0) {
+      for (int i = 0; i < n_fdes && fdes[i].start <= *start; i++) {
+        if (*start - fdes[i].start < fdes[i].size)
+          *end = fdes[i].start + fdes[i].size;
+      }
+    }
+  }
+
+  if (*start < vaddr || *start >= *end || *end - vaddr > size) {
+    printf("Could not decode 0x%lx:0x%lx, not within .text!\n", *start, *end);
+    return 1;
+  }
+
+  return 0;
+}
+
+// DWARF pointer encodings used by .eh_frame
+#define DW_EH_PE_absptr   0x00
+#define DW_EH_PE_uleb128  0x01
+#define DW_EH_PE_udata2   0x02
+#define DW_EH_PE_udata4   0x03
+#define DW_EH_PE_udata8   0x04
+#define DW_EH_PE_sleb128  0x09
+#define DW_EH_PE_sdata2   0x0A
+#define DW_EH_PE_sdata4   0x0B
+#define DW_EH_PE_sdata8   0x0C
+#define DW_EH_PE_pcrel    0x10
+#define DW_EH_PE_datarel  0x30
+#define DW_EH_PE_indirect 0x80
+#define DW_EH_PE_omit     0xFF
+
+typedef struct {
+  const byte_t *data;
+  size_t size;
+  uintptr_t vaddr;
+} eh_section_t;
+
+/**
+ * Fields of .eh_frame aren't aligned, read them through memcpy
+ */
+static uint32_t read_uint32(const byte_t bytes[]) {
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static uint16_t read_uint16(const byte_t bytes[]) {
+  uint16_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static int compare_fde_start(const void *a, const void *b) {
+  uintptr_t x = ((const fde_t *)a)->start, y = ((const fde_t *)b)->start;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Reads (S)LEB128 at *off, advances *off
+ *  return => false if value runs past end
+ */
+static bool read_leb128(const eh_section_t *s, size_t *off, bool is_signed, int64_t *value) {
+  uint64_t result = 0;
+  int shift = 0;
+  byte_t b;
+
+  do {
+    if (*off >= s->size)
+      return false;
+    b = s->data[(*off)++];
+    if (shift < 64)
+      result |= (uint64_t)(b & 0x7F) << shift;
+    shift += 7;
+  } while (b & 0x80);
+
+  if (is_signed && shift < 64 && (b & 0x40))
+    result |= ~0ULL << shift;
+  *value = (int64_t)result;
+  return true;
+}
+
+/**
+ * Reads pointer in DW_EH_PE encoding at *off, advances *off
+ *  datarel => base for DW_EH_PE_datarel (.eh_frame_hdr vaddr)
+ *  return => false if encoding is unsupported or runs past end
+ */
+static bool read_encoded(const eh_section_t *s, size_t *off, byte_t enc, uintptr_t datarel, uint64_t *value) {
+  uintptr_t field = s->vaddr + *off;
+  size_t left = *off <= s->size ? s->size - *off : 0;
+  int64_t v;
+
+  switch (enc & 0x0F) {
+    case DW_EH_PE_absptr:
+    case DW_EH_PE_udata8:
+    case DW_EH_PE_sdata8:
+      if (left < 8) return false;
+      memcpy(&v, &s->data[*off], 8);
+      *off += 8;
+      break;
+    case DW_EH_PE_udata4:
+    case DW_EH_PE_sdata4:
+      if (left < 4) return false;
+      if ((enc & 0x0F) == DW_EH_PE_udata4)
+        v = read_uint32(&s->data[*off]);
+      else
+        v = (int32_t)read_uint32(&s->data[*off]);
+      *off += 4;
+      break;
+    case DW_EH_PE_udata2:
+    case DW_EH_PE_sdata2:
+      if (left < 2) return false;
+      if ((enc & 0x0F) == DW_EH_PE_udata2)
+        v = read_uint16(&s->data[*off]);
+      else
+        v = (int16_t)read_uint16(&s->data[*off]);
+      *off += 2;
+      break;
+    case DW_EH_PE_uleb128:
+    case DW_EH_PE_sleb128:
+      if (!read_leb128(s, off, (enc & 0x0F) == DW_EH_PE_sleb128, &v)) return false;
+      break;
+    default:
+      return false;
+  }
+
+  // Indirect pointers would need to be read from .got, function bounds never use them
+  switch (enc & 0x70) {
+    case 0:                 break;
+    case DW_EH_PE_pcrel:    v += field; break;
+    case DW_EH_PE_datarel:  v += datarel; break;
+    default:                return false;
+  }
+
+  *value = (uint64_t)v;
+  return !(enc & DW_EH_PE_indirect);
+}
+
+/**
+ * Reads CFI record header at off
+ *  start => offset of CIE id / CIE pointer field
+ *  end => offset past the record
+ *  return => false on terminator or truncated record
+ */
+static bool read_cfi_header(const eh_section_t *s, size_t off, size_t *start, size_t *end) {
+  if (off > s->size || s->size - off < 4)
+    return false;
+
+  uint64_t len = read_uint32(&s->data[off]);
+  off += 4;
+  if (len == 0xFFFFFFFF) {
+    if (s->size - off < 8)
+      return false;
+    memcpy(&len, &s->data[off], 8);
+    off += 8;
+  }
+
+  if (len < 4 || len > s->size - off)
+    return false;
+  *start = off;
+  *end = off + len;
+  return true;
+}
+
+/**
+ * Parses CIE at off, returns its FDE pointer encoding
+ *  return => false if CIE is malformed
+ */
+static bool read_cie_encoding(const eh_section_t *s, size_t off, byte_t *fde_enc) {
+  size_t pos, end;
+  if (!read_cfi_header(s, off, &pos, &end) || read_uint32(&s->data[pos]) != 0)
+    return false;
+  eh_section_t cie = { s->data, end, s->vaddr };
+  pos += 4;
+
+  if (pos >= cie.size)
+    return false;
+  byte_t version = cie.data[pos++];
+
+  const char *aug = (const char *)&cie.data[pos];
+  const byte_t *aug_end = memchr(aug, '\0', cie.size - pos);
+  if (aug_end == NULL)
+    return false;
+  pos = aug_end - cie.data + 1;
+
+  // Old GCC "eh" augmentation carries a pointer
+  if (aug[0] == 'e' && aug[1] == 'h')
+    pos += 8;
+
+  int64_t unused;
+  if (!read_leb128(&cie, &pos, false, &unused) // code alignment
+      || !read_leb128(&cie, &pos, true, &unused)) // data alignment
+    return false;
+  if (version == 1)
+    pos++; // return address register
+  else if (!read_leb128(&cie, &pos, false, &unused))
+    return false;
+
+  *fde_enc = DW_EH_PE_absptr;
+  if (aug[0] != 'z')
+    return true;
+
+  if (!read_leb128(&cie, &pos, false, &unused)) // augmentation data length
+    return false;
+  for (int i = 1; aug[i] != '\0'; i++) {
+    uint64_t ptr;
+    if (pos >= cie.size)
+      return false;
+
+    switch (aug[i]) {
+      case 'R':
+        *fde_enc = cie.data[pos];
+        return true;
+      case 'L':
+        pos++;
+        break;
+      case 'P': {
+        byte_t enc = cie.data[pos++];
+        if (!read_encoded(&cie, &pos, enc & ~DW_EH_PE_indirect, 0, &ptr))
+          return false;
+        break;
+      }
+      case 'S':
+      case 'B':
+      case 'G':
+        break;
+      default:
+        return true;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Parses FDE at off into function range
+ *  cie_off, cie_enc => one-entry cache of last CIE
+ *  return => 1 if FDE, 0 if CIE/empty FDE, -1 if malformed
+ */
+static int read_fde(const eh_section_t *s, size_t off, size_t *cie_off, byte_t *cie_enc, fde_t *fde) {
+  size_t pos, end;
+  if (!read_cfi_header(s, off, &pos, &end))
+    return -1;
+
+  uint32_t cie_ptr = read_uint32(&s->data[pos]);
+  if (cie_ptr == 0)
+    return 0;
+  if (cie_ptr > pos)
+    return -1;
+
+  // CIE pointer is relative to its own field
+  if (pos - cie_ptr != *cie_off) {
+    if (!read_cie_encoding(s, pos - cie_ptr, cie_enc))
+      return -1;
+    *cie_off = pos - cie_ptr;
+  }
+
+  eh_section_t rec = { s->data, end, s->vaddr };
+  uint64_t start, range;
+  pos += 4;
+  if (!read_encoded(&rec, &pos, *cie_enc, 0, &start)
+      || !read_encoded(&rec, &pos, *cie_enc & 0x0F, 0, &range))
+    return -1;
+
+  if (start == 0 || range == 0)
+    return 0;
+  fde->start = start;
+  fde->size = range;
+  return 1;
+}
+
+/**
+ * Collects FDE offsets from .eh_frame_hdr binary search table
+ *  return => num. of offsets, -1 if table is missing or unusable
+ */
+static int read_eh_frame_hdr(const eh_section_t *hdr, const eh_section_t *eh, size_t **offsets) {
+  if (hdr->size < 4 || hdr->data[0] != 1)
+    return -1;
+
+  byte_t ptr_enc = hdr->data[1], count_enc = hdr->data[2], table_enc = hdr->data[3];
+  size_t pos = 4;
+  uint64_t eh_ptr, count;
+  if (ptr_enc == DW_EH_PE_omit || count_enc == DW_EH_PE_omit
+      || table_enc != (DW_EH_PE_datarel | DW_EH_PE_sdata4)
+      || !read_encoded(hdr, &pos, ptr_enc, hdr->vaddr, &eh_ptr)
+      || !read_encoded(hdr, &pos, count_enc, hdr->vaddr, &count)
+      || eh_ptr != eh->vaddr || count > (hdr->size - pos) / 8)
+    return -1;
+
+  *offsets = (size_t *)malloc((count > 0 ? count : 1) * sizeof(size_t));
+  if (*offsets == NULL)
+    return -1;
+
+  // Entries are (initial_loc, fde_addr) pairs sorted by initial_loc
+  for (uint64_t i = 0; i < count; i++) {
+    int32_t fde_rel = (int32_t)read_uint32(&hdr->data[pos + i * 8 + 4]);
+    (*offsets)[i] = hdr->vaddr + fde_rel - eh->vaddr;
+  }
+  return count;
+}
+
+/**
+ * Builds function-range table from .eh_frame FDEs
+ *  Uses .eh_frame_hdr search table if present, linear walk otherwise
+ *  fdes => malloc'd array sorted by start, NULL if there is no .eh_frame
+ */
+int get_elf_fdes(byte_t *bin, section_t sections[], int n_sections, fde_t **fdes, int *n_fdes) {
+  section_t *s_eh = NULL, *s_hdr = NULL;
+  *fdes = NULL;
+  *n_fdes = 0;
+
+  for (int i = 0; i < n_sections; i++) {
+    if (!strcmp(sections[i].name, ".eh_frame"))
+      s_eh = &sections[i];
+    else if (!strcmp(sections[i].name, ".eh_frame_hdr"))
+      s_hdr = &sections[i];
+  }
+
+  // Not loaded (ET_REL) => pc-relative pointers are unresolved
+  if (s_eh == NULL || s_eh->type == SHT_NOBITS || s_eh->vaddr == 0)
+    return 0;
+
+  eh_section_t eh = { bin + s_eh->elf_offset, s_eh->size, s_eh->vaddr };
+  size_t *offsets = NULL;
+  int n_offsets = -1;
+  if (s_hdr != NULL && s_hdr->type != SHT_NOBITS) {
+    eh_section_t hdr = { bin + s_hdr->elf_offset, s_hdr->size, s_hdr->vaddr };
+    n_offsets = read_eh_frame_hdr(&hdr, &eh, &offsets);
+  }
+
+  // Upper bound, smallest record is 16 B
+  size_t max_fdes = n_offsets >= 0 ? (size_t)n_offsets : eh.size / 16 + 1;
+  *fdes = (fde_t *)malloc(max_fdes * sizeof(fde_t));
+  if (*fdes == NULL) {
+    printf("Could not allocate memory for .eh_frame!\n");
+    free(offsets);
+    return 1;
+  }
+
+  size_t cie_off = SIZE_MAX;
+  byte_t cie_enc = DW_EH_PE_absptr;
+  bool sorted = true;
+  int n = 0;
+
+  if (n_offsets >= 0) {
+    for (int i = 0; i < n_offsets; i++) {
+      if (read_fde(&eh, offsets[i], &cie_off, &cie_enc, &(*fdes)[n]) == 1)
+        n++;
+    }
+  }
+  else {
+    size_t off = 0, start, end;
+    while (n < (int)max_fdes && read_cfi_header(&eh, off, &start, &end)) {
+      if (read_fde(&eh, off, &cie_off, &cie_enc, &(*fdes)[n]) == 1) {
+        if (n > 0 && (*fdes)[n - 1].start > (*fdes)[n].start)
+          sorted = false;
+        n++;
+      }
+      off = end;
+    }
+  }
+  free(offsets);
+
+  if (!sorted)
+    qsort(*fdes, n, sizeof(fde_t), compare_fde_start);
+  *n_fdes = n;
+  return 0;
+}
+
+/**
+ * Translates vaddr to pointer into mmapped file
+ *  avail => num. of bytes till end of section
+ *  NULL if addr isn't within any section loaded from file
+ */
+byte_t *get_elf_bytes(byte_t *bin, section_t sections[], int n_sections, uintptr_t addr, size_t *avail) {
+  for (int i = 0; i < n_sections; i++) {
+    if (sections[i].vaddr != 0 && sections[i].type != SHT_NOBITS
+        && addr >= sections[i].vaddr && addr - sections[i].vaddr < sections[i].size) {
+      *avail = sections[i].vaddr + sections[i].size - addr;
+      return bin + sections[i].elf_offset + (addr - sections[i].vaddr);
+    }
+  }
+
+  *avail = 0;
+  return NULL;
+}
+
+int load_file(const char *path, int *fd, byte_t **bin, size_t *fsize) {
+  // Open file for reading
+  *fd = open(path, O_RDONLY);
+  if (*fd < 0) {
+    printf("Could not open file: %s\n", path);
+    return 1;
+  }
+
+  // Get file size
+  struct stat stat_buf;
+  if (fstat(*fd, &stat_buf) < 0 || !S_ISREG(stat_buf.st_mode)) {
+    printf("Could not stat file: %s\n", path);
+    close(*fd);
+    return 1;
+  }
+  if (stat_buf.st_size == 0) {
+    printf("File is empty: %s\n", path);
+    close(*fd);
+    return 1;
+  }
+  *fsize = stat_buf.st_size;
+
+  // Map file to memory, pages are faulted in only when touched,
+  // so only the headers and the ranges the parsers read get loaded
+  *bin = (byte_t *)mmap(NULL, *fsize, PROT_READ, MAP_PRIVATE, *fd, 0);
+  if (*bin == MAP_FAILED) {
+    printf("Could not mmap file: %s\n", path);
+    close(*fd);
+    return 1;
+  }
+
+  // Headers, tables and rodata are read in no particular order
+  madvise(*bin, *fsize, MADV_RANDOM);
+
+  return 0;
+}
+
+/**
+ * Hints the kernel that [offset, offset + size) of the mapped file
+ * is going to be swept from start to end (typically .text)
+ *  flags => LOAD_POPULATE to fault the whole range in now,
+ *           LOAD_HUGEPAGE to ask for huge pages where supported
+ */
+void load_file_range(byte_t *bin, size_t fsize, uintptr_t offset, size_t size, int flags) {
+  if (!in_file(fsize, offset, size) || size == 0)
+    return;
+
+  // madvise wants page aligned start
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = offset & ~(page - 1);
+  byte_t *addr = bin + start;
+  size_t len = offset + size - start;
+
+  madvise(addr, len, MADV_SEQUENTIAL);
+  madvise(addr, len, MADV_WILLNEED);
+
+#ifdef MADV_HUGEPAGE
+  if (flags & LOAD_HUGEPAGE)
+    madvise(addr, len, MADV_HUGEPAGE);
+#endif
+
+  if (flags & LOAD_POPULATE) {
+#ifdef MADV_POPULATE_READ
+    if (madvise(addr, len, MADV_POPULATE_READ) == 0)
+      return;
+#endif
+    // Older kernels, touch every page
+    volatile byte_t sink = 0;
+    for (size_t i = 0; i < len; i += page)
+      sink ^= addr[i];
+    (void)sink;
+  }
+}
+
+int close_file(byte_t *bin, int fd, size_t fsize) {
+  munmap(bin, fsize);
+  close(fd);
+  return 0;
+}
+
+void proc_section_labels(instr_t instr[], int count, section_t sections[], int n_sections) {
+  for (int i = 0; i < count; i++) {
+    // Should print note?
+    if (!instr[i].has_ext_opcode) {
+      switch (instr[i].opcode) {
+        case OP_MOV_89:
+        case OP_MOV_8B:
+        case OP_LEA:
+          if (instr[i].modrm.mod != 0b11
+              && strstr(instr[i].mnemo_operand, "(\%rip)") != NULL) { // strstr LULZ
+            addr_t dest = get_instr_dest(&instr[i]);
+            bool done = false;
+
+            for (int j = 0; j < n_sections; j++) {
+              if (dest >= sections[j].vaddr && dest - sections[j].vaddr < sections[j].size) {
+                snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN,
+                    "%s + 0x%lx", sections[j].name, dest - sections[j].vaddr);
+                done = true;
+                break;
+              }
+            }
+
+            if (!done) {
+              snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN, "0x%lx", dest);
+            }
+          }
+          break;
+      }
+    }
+  }
+}
+
+void proc_symtab_labels(instr_t instr[], int count, symbol_t symbols[], int n_symbols) {
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; j < n_symbols; j++) {
+      // Entrypoint match?
+      if (instr[i].addr == symbols[j].value) {
+        set_label(&instr[i], symbols[j].name, symbols[j].value);
+        break;
+      }
+
+      // Rename all unnamed bblocks, <name>_<addr>
+      if (has_label(&instr[i])
+          && instr[i].sub_addr == symbols[j].value
+          && instr[i].label.name == NULL) {
+        set_label(&instr[i], symbols[j].name, symbols[j].value);
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * Names calls & tail jumps into PLT as <symbol>@plt
+ *  Must run after proc_flow_labels(), replaces its [broken] note
+ */
+void proc_plt_labels(instr_t instr[], int count, const plt_index_t *plt) {
+  if (plt->n_entries == 0)
+    return;
+
+  for (int i = 0; i < count; i++) {
+    flow_t flow = get_instr_flow(&instr[i]);
+    if ((flow != FLOW_CALL && flow != FLOW_JMP) || (instr[i].flags & INSTR_CF_LABEL))
+      continue;
+
+    const plt_entry_t *entry = plt_index_find(plt, get_instr_dest(&instr[i]));
+    if (entry != NULL) {
+      label_t label = { entry->name, entry->addr };
+      proc_jump_note(&instr[i], &label);
+    }
+  }
+}
+
+/**
+ * Names relocated fields of ET_REL object by their symbols
+ *  Jumps & calls out of region get dest. label, the rest "# <symbol> + <addend>"
+ *  Must run after proc_flow_labels() & proc_section_labels(), replaces their notes
+ */
+void proc_reloc_labels(instr_t instr[], int count, const reloc_index_t *relocs) {
+  if (relocs->n_relocs == 0)
+    return;
+
+  for (int i = 0; i < count; i++) {
+    addr_t next = instr[i].addr + instr[i].len;
+    int r = reloc_lookup(relocs, instr[i].addr, next);
+    if (r < 0)
+      continue;
+
+    // Field must be operand of instr., not straddle into next one
+    const reloc_t *rel = &relocs->relocs[r];
+    if (rel->addr + (rel->type == R_X86_64_64 ? 8 : 4) > next)
+      continue;
+    flow_t flow = get_instr_flow(&instr[i]);
+    if (flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL) {
+      if (!rel->local) {
+        label_t label = { rel->name, get_instr_dest(&instr[i]) };
+        proc_jump_note(&instr[i], &label);
+      }
+      continue;
+    }
+
+    // Field's offset to symbol, as the linker would see it
+    int64_t offset = rel->addend + (rel->pc_rel ? (int64_t)(next - rel->addr) : 0);
+    const char *got = rel->type == R_X86_64_GOTPCREL || rel->type == R_X86_64_GOTPCRELX
+                   || rel->type == R_X86_64_REX_GOTPCRELX ? "@GOTPCREL" : "";
+    if (offset == 0)
+      snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN, "%s%s", rel->name, got);
+    else
+      snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN, "%s%s %c 0x%lx",
+               rel->name, got, offset < 0 ? '-' : '+', offset < 0 ? -offset : offset);
+  }
+}
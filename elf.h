@@ -1,45 +1,100 @@
-#ifndef ELF_H
-#define ELF_H
-
-#include <stdio.h>
-#include <stdbool.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/mman.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <elf.h>
-
-#include "decode.h"
-
-#define MAX_SECTIONS 64
-#define MAX_SYMBOLS 512
-
-typedef struct {
-  uintptr_t elf_offset;
-  uintptr_t vaddr;
-  int size;
-  char *name;
-} section_t;
-
-typedef struct {
-  uintptr_t value;
-  int size;
-  byte_t binding;
-  char *name;
-  uint16_t shndx;
-  byte_t type;
-} symbol_t;
-
-int get_elf_sections(byte_t *bin, section_t sections[], int *n_sections);
-int get_elf_symtab(byte_t *bin, section_t sections[], int n_sections, symbol_t symbols[], int *n_symbols);
-int get_elf_info(byte_t *bin, section_t sections[], int n_sections, uintptr_t *entry, uintptr_t *vaddr, uintptr_t *text_offset, int *text_size);
-
-int load_file(const char *path, int *fd, byte_t **bin, int *fsize);
-int close_file(byte_t *bin, int fd, int fsize);
-
-void proc_section_labels(instr_t instr[], int count, section_t sections[], int n_sections);
-void proc_symtab_labels(instr_t instr[], int count, symbol_t symbols[], int n_symbols);
-
-#endif
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <elf.h>
+
+#include "decode.h"
+
+#define MAX_SECTIONS 1024
+
+#define LOAD_POPULATE 0b01
+#define LOAD_HUGEPAGE 0b10
+
+typedef struct {
+  uintptr_t elf_offset;
+  uintptr_t vaddr;
+  size_t size;
+  uint32_t type;
+  uint64_t flags; // SHF_*
+  char *name;
+} section_t;
+
+typedef struct {
+  uintptr_t value;
+  size_t size;
+  byte_t binding;
+  char *name;
+  uint16_t shndx;
+  byte_t type;
+} symbol_t;
+
+// Name => symbol hash, slot = index into symbols[] or -1
+typedef struct {
+  symbol_t *symbols;
+  int *slot;
+  size_t mask;
+} symbol_index_t;
+
+// PLT stub => imported .dynsym symbol
+typedef struct {
+  uintptr_t addr;
+  char *name; // "<symbol>@plt", in plt_index_t.names
+} plt_entry_t;
+
+// Stub addr => entry hash, slot = index into entries[] or -1
+typedef struct {
+  plt_entry_t *entries;
+  int n_entries;
+  char *names;
+  int *slot;
+  size_t mask;
+} plt_index_t;
+
+// Function range from .eh_frame FDE
+typedef struct {
+  uintptr_t start;
+  size_t size;
+} fde_t;
+
+void set_elf_notice_out(FILE *out);
+
+bool is_elf_file(byte_t *bin, size_t fsize);
+int get_elf_sections(byte_t *bin, size_t fsize, section_t sections[], int *n_sections);
+int get_elf_symtab(byte_t *bin, section_t sections[], int n_sections, symbol_t **symbols, int *n_symbols);
+int get_elf_gnu_hash_symbol(byte_t *bin, section_t sections[], int n_sections, const char *name, symbol_t *sym);
+int get_elf_plt(byte_t *bin, section_t sections[], int n_sections, plt_index_t *plt);
+int get_elf_relocs(byte_t *bin, section_t sections[], int n_sections, uintptr_t text_offset, reloc_index_t *relocs);
+int get_elf_range(const char *query, byte_t *bin, section_t sections[], int n_sections,
+                  const symbol_index_t *index, fde_t fdes[], int n_fdes,
+                  uintptr_t vaddr, size_t size, uintptr_t *start, uintptr_t *end, symbol_t *found);
+int get_elf_fdes(byte_t *bin, section_t sections[], int n_sections, fde_t **fdes, int *n_fdes);
+int get_elf_info(byte_t *bin, section_t sections[], int n_sections, uintptr_t *entry, uintptr_t *vaddr, uintptr_t *text_offset, size_t *text_size);
+
+int symbol_index_init(symbol_index_t *index, symbol_t symbols[], int n_symbols);
+void symbol_index_free(symbol_index_t *index);
+symbol_t *symbol_index_find(const symbol_index_t *index, const char *name);
+
+void plt_index_free(plt_index_t *plt);
+const plt_entry_t *plt_index_find(const plt_index_t *plt, uintptr_t addr);
+void reloc_index_free(reloc_index_t *relocs);
+
+byte_t *get_elf_bytes(byte_t *bin, section_t sections[], int n_sections, uintptr_t addr, size_t *avail);
+
+int load_file(const char *path, int *fd, byte_t **bin, size_t *fsize);
+void load_file_range(byte_t *bin, size_t fsize, uintptr_t offset, size_t size, int flags);
+int close_file(byte_t *bin, int fd, size_t fsize);
+
+void proc_section_labels(instr_t instr[], int count, section_t sections[], int n_sections);
+void proc_symtab_labels(instr_t instr[], int count, symbol_t symbols[], int n_symbols);
+void proc_plt_labels(instr_t instr[], int count, const plt_index_t *plt);
+void proc_reloc_labels(instr_t instr[], int count, const reloc_index_t *relocs);
+
+#endif
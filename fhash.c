@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "func.h"
+#include "fhash.h"
+
+#define JUMP_OUT 0x7FFFFFFF // block delta of jumps leaving function
+
+static inline uint64_t mix(uint64_t h, uint64_t k) {
+  h = (h ^ k) * 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> 29);
+}
+
+static uint64_t hash_string(const char *s) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  while (*s)
+    h = (h ^ (byte_t)*s++) * 0x100000001B3ULL;
+  return h;
+}
+
+/**
+ * Keys => chains of equal keys, open addressing on first of each chain
+ */
+typedef struct {
+  const uint64_t *keys;
+  int *slot; // first index with key, -1 if empty
+  int *next; // next index with same key, -1 at end
+  size_t mask;
+} chain_index_t;
+
+/**
+ * include => index only keys[i] with include[i] set, NULL for all
+ *  return => 0 on success
+ */
+static int chain_index_init(chain_index_t *index, const uint64_t keys[], const bool include[], int n) {
+  size_t cap = 16;
+  while (cap < (size_t)n * 2)
+    cap <<= 1;
+
+  index->keys = keys;
+  index->mask = cap - 1;
+  index->slot = (int *)malloc(cap * sizeof(int));
+  index->next = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+  if (index->slot == NULL || index->next == NULL) {
+    printf("Could not allocate memory for hash index!\n");
+    free(index->slot);
+    free(index->next);
+    return 1;
+  }
+  memset(index->slot, -1, cap * sizeof(int));
+
+  // Backwards, so chains run in index order
+  for (int i = n - 1; i >= 0; i--) {
+    index->next[i] = -1;
+    if (include != NULL && !include[i])
+      continue;
+
+    size_t s = keys[i] & index->mask;
+    while (index->slot[s] >= 0 && keys[index->slot[s]] != keys[i])
+      s = (s + 1) & index->mask;
+    index->next[i] = index->slot[s];
+    index->slot[s] = i;
+  }
+
+  return 0;
+}
+
+static void chain_index_free(chain_index_t *index) {
+  free(index->slot);
+  free(index->next);
+}
+
+/**
+ * return => first index with key, -1 if none
+ */
+static int chain_index_find(const chain_index_t *index, uint64_t key) {
+  size_t s = key & index->mask;
+  while (index->slot[s] >= 0) {
+    if (index->keys[index->slot[s]] == key)
+      return index->slot[s];
+    s = (s + 1) & index->mask;
+  }
+  return -1;
+}
+
+/**
+ * Encoding of instr. without its imm./disp./rel. value
+ */
+uint64_t hash_instr(const instr_t *instr) {
+  uint64_t key = (uint64_t)instr->has_ext_opcode << 8 | instr->opcode;
+  key |= (uint64_t)instr->len << 16;
+  if (instr->has_rex)
+    key |= (uint64_t)(0x10 | instr->rex.w << 3 | instr->rex.r << 2 | instr->rex.x << 1 | instr->rex.b) << 24;
+  if (instr->has_modrm)
+    key |= (uint64_t)(0x100 | instr->modrm.mod << 6 | instr->modrm.reg << 3 | instr->modrm.rm) << 32;
+  if (instr->has_sib)
+    key |= (uint64_t)(0x100 | instr->sib.scale << 6 | instr->sib.index << 3 | instr->sib.base) << 48;
+  return mix(0, key);
+}
+
+/**
+ * Hashes every function, bblocks are those of proc_flow_labels()
+ *  hashes => malloc'd, free with free_hashes()
+ *  return => 0 on success
+ */
+int hash_functions(func_t funcs[], int n_funcs, fhash_t **hashes) {
+  int max_count = 1;
+  for (int i = 0; i < n_funcs; i++)
+    if (funcs[i].count > max_count)
+      max_count = funcs[i].count;
+
+  *hashes = (fhash_t *)calloc(n_funcs > 0 ? n_funcs : 1, sizeof(fhash_t));
+  int *block_of = (int *)malloc(max_count * sizeof(int));
+  if (*hashes == NULL || block_of == NULL)
+    goto ERR_ALLOC;
+
+  for (int i = 0; i < n_funcs; i++) {
+    instr_t *list = funcs[i].instr;
+    int count = funcs[i].count;
+    fhash_t *fh = &(*hashes)[i];
+
+    int n_blocks = 0;
+    for (int j = 0; j < count; j++) {
+      if (j == 0 || has_label(&list[j]))
+        n_blocks++;
+      block_of[j] = n_blocks - 1;
+    }
+
+    fh->n_instr = count;
+    fh->n_blocks = n_blocks;
+    fh->blocks = (uint64_t *)malloc((n_blocks > 0 ? n_blocks : 1) * sizeof(uint64_t));
+    if (fh->blocks == NULL)
+      goto ERR_ALLOC;
+
+    uint64_t block = 0;
+    fh->hash = mix(0, n_blocks);
+    for (int j = 0; j < count; j++) {
+      block = mix(block, hash_instr(&list[j]));
+
+      // Jumps within function by bblocks skipped, calls & the rest masked
+      flow_t flow = get_instr_flow(&list[j]);
+      if (flow == FLOW_JCC || flow == FLOW_JMP) {
+        int t = find_instr(list, count, get_instr_dest(&list[j]));
+        block = mix(block, t >= 0 ? (uint64_t)(block_of[t] - block_of[j]) : JUMP_OUT);
+      }
+
+      if (j == count - 1 || block_of[j + 1] != block_of[j]) {
+        fh->blocks[block_of[j]] = block;
+        fh->hash = mix(fh->hash, block);
+        block = 0;
+      }
+    }
+  }
+
+  free(block_of);
+  return 0;
+
+ERR_ALLOC:
+  printf("Could not allocate memory for function hashes!\n");
+  free(block_of);
+  if (*hashes != NULL)
+    free_hashes(*hashes, n_funcs);
+  *hashes = NULL;
+  return 1;
+}
+
+void free_hashes(fhash_t hashes[], int n_hashes) {
+  for (int i = 0; i < n_hashes; i++)
+    free(hashes[i].blocks);
+  free(hashes);
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * return => bblocks of b also in a, multiset intersection
+ */
+int count_same_blocks(const fhash_t *a, const fhash_t *b) {
+  uint64_t *x = (uint64_t *)malloc((a->n_blocks + b->n_blocks + 1) * sizeof(uint64_t));
+  if (x == NULL)
+    return 0;
+  uint64_t *y = x + a->n_blocks;
+  memcpy(x, a->blocks, a->n_blocks * sizeof(uint64_t));
+  memcpy(y, b->blocks, b->n_blocks * sizeof(uint64_t));
+  qsort(x, a->n_blocks, sizeof(uint64_t), compare_u64);
+  qsort(y, b->n_blocks, sizeof(uint64_t), compare_u64);
+
+  int same = 0;
+  for (int i = 0, j = 0; i < a->n_blocks && j < b->n_blocks; ) {
+    if (x[i] == y[j]) {
+      same++;
+      i++;
+      j++;
+    }
+    else if (x[i] < y[j]) {
+      i++;
+    }
+    else {
+      j++;
+    }
+  }
+
+  free(x);
+  return same;
+}
+
+/**
+ * Pairs functions of two builds, first by name, then by unique hash
+ *  Named ones keep their name, so same name => SAME or CHANGED
+ *  Remaining ones with equal hash on both sides are SAME (moved/renamed)
+ *  matches => malloc'd, new funcs in order, then removed ones
+ *  return => 0 on success
+ */
+int match_functions(func_t old_funcs[], fhash_t old_hashes[], int n_old,
+                    func_t new_funcs[], fhash_t new_hashes[], int n_new,
+                    match_t **matches, int *n_matches) {
+  uint64_t *old_keys = (uint64_t *)malloc((n_old > 0 ? n_old : 1) * sizeof(uint64_t));
+  bool *old_free = (bool *)malloc((n_old > 0 ? n_old : 1) * sizeof(bool));
+  int *pair = (int *)malloc((n_new > 0 ? n_new : 1) * sizeof(int));
+  *matches = (match_t *)malloc((n_old + n_new > 0 ? n_old + n_new : 1) * sizeof(match_t));
+  chain_index_t index = { NULL, NULL, NULL, 0 };
+  if (old_keys == NULL || old_free == NULL || pair == NULL || *matches == NULL) {
+    printf("Could not allocate memory for matching!\n");
+    goto ERR_FREE;
+  }
+
+  for (int i = 0; i < n_new; i++)
+    pair[i] = -1;
+
+  // By name
+  for (int i = 0; i < n_old; i++) {
+    old_free[i] = old_funcs[i].name != NULL;
+    old_keys[i] = old_free[i] ? hash_string(old_funcs[i].name) : 0;
+  }
+  if (chain_index_init(&index, old_keys, old_free, n_old))
+    goto ERR_FREE;
+  for (int i = 0; i < n_new; i++) {
+    if (new_funcs[i].name == NULL)
+      continue;
+    for (int j = chain_index_find(&index, hash_string(new_funcs[i].name)); j >= 0; j = index.next[j]) {
+      if (old_free[j] && !strcmp(old_funcs[j].name, new_funcs[i].name)) {
+        pair[i] = j;
+        old_free[j] = false;
+        break;
+      }
+    }
+  }
+  chain_index_free(&index);
+
+  // By hash, whatever is left
+  for (int i = 0; i < n_old; i++) {
+    old_free[i] = true;
+    old_keys[i] = old_hashes[i].hash;
+  }
+  for (int i = 0; i < n_new; i++)
+    if (pair[i] >= 0)
+      old_free[pair[i]] = false;
+  if (chain_index_init(&index, old_keys, old_free, n_old))
+    goto ERR_FREE;
+  for (int i = 0; i < n_new; i++) {
+    if (pair[i] >= 0)
+      continue;
+    for (int j = chain_index_find(&index, new_hashes[i].hash); j >= 0; j = index.next[j]) {
+      if (old_free[j]) {
+        pair[i] = j;
+        old_free[j] = false;
+        break;
+      }
+    }
+  }
+  chain_index_free(&index);
+
+  int n = 0;
+  for (int i = 0; i < n_new; i++) {
+    match_t *m = &(*matches)[n++];
+    m->old = pair[i];
+    m->new = i;
+    if (pair[i] < 0)
+      m->kind = MATCH_ADDED;
+    else
+      m->kind = old_hashes[pair[i]].hash == new_hashes[i].hash ? MATCH_SAME : MATCH_CHANGED;
+  }
+  for (int j = 0; j < n_old; j++) {
+    if (old_free[j])
+      (*matches)[n++] = (match_t){ j, -1, MATCH_REMOVED };
+  }
+  *n_matches = n;
+
+  free(old_keys);
+  free(old_free);
+  free(pair);
+  return 0;
+
+ERR_FREE:
+  free(old_keys);
+  free(old_free);
+  free(pair);
+  free(*matches);
+  *matches = NULL;
+  return 1;
+}
+
+/**
+ * Groups functions of equal hash, e.g. for identical code folding
+ *  first => malloc'd, first[i] = lowest index with hash of i
+ *  return => 0 on success
+ */
+int group_functions(fhash_t hashes[], int n_funcs, int **first) {
+  uint64_t *keys = (uint64_t *)calloc(n_funcs > 0 ? n_funcs : 1, sizeof(uint64_t));
+  *first = (int *)malloc((n_funcs > 0 ? n_funcs : 1) * sizeof(int));
+  chain_index_t index = { NULL, NULL, NULL, 0 };
+  if (keys == NULL || *first == NULL) {
+    printf("Could not allocate memory for grouping!\n");
+    goto ERR_FREE;
+  }
+
+  for (int i = 0; i < n_funcs; i++)
+    keys[i] = hashes[i].hash;
+  if (chain_index_init(&index, keys, NULL, n_funcs))
+    goto ERR_FREE;
+  for (int i = 0; i < n_funcs; i++)
+    (*first)[i] = chain_index_find(&index, keys[i]);
+  chain_index_free(&index);
+
+  free(keys);
+  return 0;
+
+ERR_FREE:
+  free(keys);
+  free(*first);
+  *first = NULL;
+  return 1;
+}
@@ -0,0 +1,41 @@
+#ifndef FHASH_H
+#define FHASH_H
+
+#include <stdint.h>
+
+#include "decode.h"
+#include "func.h"
+
+// Position-independent hash of function & its bblocks
+//  Opcode, REX, ModR/M & SIB count, imm./disp./rel. values don't,
+//  jumps count by how many bblocks they skip
+typedef struct {
+  uint64_t hash;
+  int n_instr;
+  int n_blocks;
+  uint64_t *blocks; // bblock hashes, by addr
+} fhash_t;
+
+typedef enum {
+  MATCH_SAME,    // same hash, by name or by hash
+  MATCH_CHANGED, // same name, different hash
+  MATCH_REMOVED, // only in old
+  MATCH_ADDED    // only in new
+} match_kind_t;
+
+typedef struct {
+  int old, new; // func. index, -1 if none
+  match_kind_t kind;
+} match_t;
+
+uint64_t hash_instr(const instr_t *instr);
+int hash_functions(func_t funcs[], int n_funcs, fhash_t **hashes);
+void free_hashes(fhash_t hashes[], int n_hashes);
+int count_same_blocks(const fhash_t *a, const fhash_t *b);
+
+int match_functions(func_t old_funcs[], fhash_t old_hashes[], int n_old,
+                    func_t new_funcs[], fhash_t new_hashes[], int n_new,
+                    match_t **matches, int *n_matches);
+int group_functions(fhash_t hashes[], int n_funcs, int **first);
+
+#endif
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <elf.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "scan.h"
+#include "xref.h"
+#include "func.h"
+
+typedef struct {
+  byte_t *bytes;
+  uintptr_t vaddr;
+  func_t *funcs;
+  int n_funcs;
+  const reloc_index_t *relocs;
+  byte_t *bin; // whole file, for jump tables, NULL => not resolved
+  section_t *sections;
+  int n_sections;
+  int next; // next func. to decode, shared by workers
+} func_work_t;
+
+static int compare_func_addr(const void *a, const void *b) {
+  uintptr_t x = ((const func_t *)a)->addr, y = ((const func_t *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+static int compare_instr_addr(const void *a, const void *b) {
+  addr_t x = ((const instr_t *)a)->addr, y = ((const instr_t *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Appends function entry candidate, duplicates are merged later
+ *  size = known size of function (from symbol), 0 if unknown
+ */
+static void add_func(func_t funcs[], int *n, uintptr_t addr, uintptr_t size, char *name, byte_t src) {
+  memset(&funcs[*n], 0, sizeof(func_t));
+  funcs[*n].addr = addr;
+  funcs[*n].end = size > 0 ? addr + size : 0;
+  funcs[*n].name = name;
+  funcs[*n].src = src;
+  (*n)++;
+}
+
+/**
+ * Checks for push %rbp; mov %rsp,%rbp
+ */
+static bool is_prologue(byte_t bytes[], size_t left) {
+  return left >= 4 && bytes[0] == 0x55 && bytes[1] == 0x48
+      && ((bytes[2] == 0x89 && bytes[3] == 0xE5)     // mov %rsp, %rbp
+          || (bytes[2] == 0x8B && bytes[3] == 0xEC)); // mov %rsp, %rbp (8B form)
+}
+
+/**
+ * Checks if addr lies strictly inside (not at start of) some FDE range
+ *  fdes => sorted by start
+ */
+static bool in_fde(fde_t fdes[], int n_fdes, uintptr_t addr) {
+  int lo = 0, hi = n_fdes;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (fdes[mid].start < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  // lo => first FDE starting at or after addr
+  return lo > 0 && addr - fdes[lo - 1].start < fdes[lo - 1].size;
+}
+
+/**
+ * Finds function entries within bytes[] (.text mapped at vaddr)
+ *  Seeds: e_entry, STT_FUNC symbols, .eh_frame FDEs, validated call targets, prologues
+ *  Call targets & prologues inside an FDE range are dropped, FDEs are exact
+ *  Each function ends at the next one (or at symbol/FDE size, if known)
+ *  relocs => of ET_REL object, unlinked calls target their relocation, NULL if none
+ *  funcs => malloc'd array sorted by addr, free with free_functions()
+ */
+int find_functions(byte_t bytes[], size_t len, uintptr_t vaddr, uintptr_t entry, symbol_t symbols[], int n_symbols, fde_t fdes[], int n_fdes,
+                   const reloc_index_t *relocs, func_t **funcs, int *n_funcs) {
+  uintptr_t *targets = (uintptr_t *)malloc(len * sizeof(uintptr_t));
+  uint64_t *bounds = (uint64_t *)malloc(SCAN_MASK_WORDS(len) * sizeof(uint64_t));
+  *funcs = NULL;
+  *n_funcs = 0;
+  if (targets == NULL || bounds == NULL) {
+    printf("Could not allocate memory for function discovery!\n");
+    goto ERR_FREE;
+  }
+
+  // Call targets & prologues on linear-sweep boundaries
+  int n_targets = scan_call_targets(bytes, len, vaddr, targets, len);
+  decode_boundaries(bytes, len, bounds);
+
+  int n_prologues = 0;
+  for (size_t i = 0; i < len; i++) {
+    if ((bounds[i / 64] & (1ULL << (i % 64))) && is_prologue(&bytes[i], len - i))
+      n_prologues++;
+  }
+
+  int n_relocs = relocs != NULL ? relocs->n_relocs : 0;
+  *funcs = (func_t *)malloc((1 + n_symbols + n_fdes + n_targets + n_relocs + n_prologues) * sizeof(func_t));
+  if (*funcs == NULL) {
+    printf("Could not allocate memory for function discovery!\n");
+    goto ERR_FREE;
+  }
+
+  int n = 0;
+  if (entry >= vaddr && entry < vaddr + len)
+    add_func(*funcs, &n, entry, 0, NULL, FUNC_SRC_ENTRY);
+
+  for (int i = 0; i < n_symbols; i++) {
+    if (symbols[i].type == STT_FUNC && symbols[i].shndx != SHN_UNDEF
+        && symbols[i].value >= vaddr && symbols[i].value < vaddr + len)
+      add_func(*funcs, &n, symbols[i].value, symbols[i].size, symbols[i].name, FUNC_SRC_SYMBOL);
+  }
+
+  for (int i = 0; i < n_fdes; i++) {
+    if (fdes[i].start >= vaddr && fdes[i].start < vaddr + len)
+      add_func(*funcs, &n, fdes[i].start, fdes[i].size, NULL, FUNC_SRC_FDE);
+  }
+
+  for (int i = 0; i < n_targets; i++) {
+    if (n_relocs > 0 && reloc_lookup(relocs, targets[i] - 4, targets[i] - 3) >= 0)
+      continue; // rel32 yet to be relocated
+    if (!in_fde(fdes, n_fdes, targets[i]))
+      add_func(*funcs, &n, targets[i], 0, NULL, FUNC_SRC_CALL);
+  }
+
+  for (int i = 0; i < n_relocs; i++) {
+    const reloc_t *rel = &relocs->relocs[i];
+    uintptr_t dest = rel->target + rel->addend + 4;
+    if (rel->local && rel->addr > vaddr && rel->addr - vaddr <= len - 4 && bytes[rel->addr - vaddr - 1] == OP_CALL
+        && dest >= vaddr && dest < vaddr + len && !in_fde(fdes, n_fdes, dest))
+      add_func(*funcs, &n, dest, 0, NULL, FUNC_SRC_CALL);
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    if ((bounds[i / 64] & (1ULL << (i % 64))) && is_prologue(&bytes[i], len - i)
+        && !in_fde(fdes, n_fdes, vaddr + i))
+      add_func(*funcs, &n, vaddr + i, 0, NULL, FUNC_SRC_PROLOGUE);
+  }
+
+  // Sort & merge duplicates
+  qsort(*funcs, n, sizeof(func_t), compare_func_addr);
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (m > 0 && (*funcs)[m - 1].addr == (*funcs)[i].addr) {
+      func_t *prev = &(*funcs)[m - 1];
+      prev->src |= (*funcs)[i].src;
+      if (prev->name == NULL)
+        prev->name = (*funcs)[i].name;
+      if (prev->end == 0)
+        prev->end = (*funcs)[i].end;
+      continue;
+    }
+    (*funcs)[m++] = (*funcs)[i];
+  }
+
+  // Set boundaries
+  for (int i = 0; i < m; i++) {
+    uintptr_t next = i < m - 1 ? (*funcs)[i + 1].addr : vaddr + len;
+    if ((*funcs)[i].end == 0 || (*funcs)[i].end > next)
+      (*funcs)[i].end = next;
+  }
+  *n_funcs = m;
+
+  free(targets);
+  free(bounds);
+  return 0;
+
+ERR_FREE:
+  free(targets);
+  free(bounds);
+  return 1;
+}
+
+static void *decode_worker(void *arg) {
+  func_work_t *work = (func_work_t *)arg;
+  int i;
+
+  while ((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->n_funcs) {
+    func_t *func = &work->funcs[i];
+    size_t size = func->end - func->addr;
+
+    addr_index_t index;
+    func->instr = (instr_t *)malloc(size * sizeof(instr_t));
+    if (func->instr == NULL || index_init(&index, func->addr, size)) {
+      free(func->instr);
+      func->instr = NULL;
+      func->count = 0;
+      continue;
+    }
+    index.relocs = work->relocs;
+
+    // Decode function body only, callees are separate units
+    byte_t *bytes = work->bytes + (func->addr - work->vaddr);
+    func->count = decode(func->instr, 0, bytes, func->addr, size, func->addr, DECODE_FUNCTION, 0, &index);
+
+    // Switch cases within function, before index is sorted away
+    if (work->bin != NULL) {
+      func->count = decode_jump_tables(func->instr, func->count, work->bin, work->sections, work->n_sections,
+                                       bytes, func->addr, size, DECODE_FUNCTION, &index,
+                                       &func->jtabs, &func->n_jtabs);
+      if (func->n_jtabs == 0) {
+        free_jump_tables(func->jtabs, 0);
+        func->jtabs = NULL;
+      }
+    }
+    if (index_sort(&index, func->instr, func->count))
+      qsort(func->instr, func->count, sizeof(instr_t), compare_instr_addr);
+    index_free(&index);
+
+    // Room was reserved per byte, give back the unused part
+    instr_t *shrunk = (instr_t *)realloc(func->instr, (func->count > 0 ? func->count : 1) * sizeof(instr_t));
+    if (shrunk != NULL)
+      func->instr = shrunk;
+  }
+
+  return NULL;
+}
+
+/**
+ * Decodes all functions independently, in n_threads parallel workers
+ *  relocs => applied to .text of ET_REL object, NULL if none
+ *  bin => whole ELF file, jump tables are resolved within each function,
+ *         NULL if none
+ *  return => 0 on success
+ */
+int decode_functions(byte_t bytes[], uintptr_t vaddr, func_t funcs[], int n_funcs, const reloc_index_t *relocs,
+                     byte_t *bin, section_t sections[], int n_sections, int n_threads) {
+  func_work_t work = { bytes, vaddr, funcs, n_funcs, relocs, bin, sections, n_sections, 0 };
+  pthread_t threads[n_threads];
+  int started = 0;
+
+  for (int i = 0; i < n_threads; i++) {
+    if (pthread_create(&threads[i], NULL, decode_worker, &work) != 0)
+      break;
+    started++;
+  }
+
+  // No threads, decode on this one
+  if (started == 0)
+    decode_worker(&work);
+
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  for (int i = 0; i < n_funcs; i++) {
+    if (funcs[i].instr == NULL) {
+      printf("Could not allocate memory for decoder!\n");
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void free_functions(func_t funcs[], int n_funcs) {
+  for (int i = 0; i < n_funcs; i++) {
+    free(funcs[i].instr);
+    free_jump_tables(funcs[i].jtabs, funcs[i].n_jtabs);
+  }
+  free(funcs);
+}
+
+/**
+ * Resolves calls between functions, which proc_flow_labels() can't see
+ *  Must run after proc_flow_labels() on every function
+ */
+void proc_call_labels(func_t funcs[], int n_funcs) {
+  for (int i = 0; i < n_funcs; i++) {
+    for (int j = 0; j < funcs[i].count; j++) {
+      instr_t *instr = &funcs[i].instr[j];
+      if (get_instr_flow(instr) != FLOW_CALL || (instr->flags & INSTR_CF_LABEL))
+        continue;
+
+      func_t key = { .addr = get_instr_dest(instr) };
+      func_t *dest = (func_t *)bsearch(&key, funcs, n_funcs, sizeof(func_t), compare_func_addr);
+      if (dest == NULL || dest->count == 0 || dest->instr[0].addr != key.addr)
+        continue;
+
+      proc_jump_note(instr, &dest->instr[0].label);
+    }
+  }
+}
+
+/**
+ * Builds xref index over all functions, instr. ids run through funcs in order
+ *  return => 0 on success
+ */
+int build_func_xrefs(func_t funcs[], int n_funcs, xref_t *xref) {
+  instr_t **lists = (instr_t **)malloc((n_funcs > 0 ? n_funcs : 1) * sizeof(instr_t *));
+  int *counts = (int *)malloc((n_funcs > 0 ? n_funcs : 1) * sizeof(int));
+  if (lists == NULL || counts == NULL) {
+    printf("Could not allocate memory for xref index!\n");
+    free(lists);
+    free(counts);
+    return 1;
+  }
+
+  for (int i = 0; i < n_funcs; i++) {
+    lists[i] = funcs[i].instr;
+    counts[i] = funcs[i].count;
+  }
+  int err = xref_build(xref, lists, counts, n_funcs);
+
+  free(lists);
+  free(counts);
+  return err;
+}
@@ -0,0 +1,39 @@
+#ifndef FUNC_H
+#define FUNC_H
+
+#include "decode.h"
+#include "elf.h"
+#include "jtab.h"
+#include "xref.h"
+
+// Where was the function entry found
+typedef enum {
+  FUNC_SRC_ENTRY    = 0b00001,
+  FUNC_SRC_SYMBOL   = 0b00010,
+  FUNC_SRC_CALL     = 0b00100,
+  FUNC_SRC_PROLOGUE = 0b01000,
+  FUNC_SRC_FDE      = 0b10000
+} func_src_t;
+
+typedef struct {
+  uintptr_t addr;
+  uintptr_t end;
+  char *name;
+  byte_t src;
+
+  instr_t *instr;
+  int count;
+  jtab_t *jtabs; // switch tables of function, NULL if none
+  int n_jtabs;
+} func_t;
+
+int find_functions(byte_t bytes[], size_t len, uintptr_t vaddr, uintptr_t entry, symbol_t symbols[], int n_symbols, fde_t fdes[], int n_fdes,
+                   const reloc_index_t *relocs, func_t **funcs, int *n_funcs);
+int decode_functions(byte_t bytes[], uintptr_t vaddr, func_t funcs[], int n_funcs, const reloc_index_t *relocs,
+                     byte_t *bin, section_t sections[], int n_sections, int n_threads);
+void free_functions(func_t funcs[], int n_funcs);
+
+void proc_call_labels(func_t funcs[], int n_funcs);
+int build_func_xrefs(func_t funcs[], int n_funcs, xref_t *xref);
+
+#endif
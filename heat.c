@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "heat.h"
+
+#define HEAT_CHUNK (1 << 20)
+
+static inline void heat_add(heat_t *heat, addr_t addr) {
+  heat->total++;
+  if (addr >= heat->vaddr && addr - heat->vaddr < heat->len)
+    heat->hits[addr - heat->vaddr]++;
+  else
+    heat->outside++;
+}
+
+static inline int hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+/**
+ * Reads samples, one per line: first field is a hex address, e.g. `perf script -F ip`
+ *  Lines not starting with an address are skipped
+ *  bias => load address of a PIE at sampling time, subtracted from every sample
+ *  heat => free with heat_free()
+ *  return => 0 on success
+ */
+int heat_load(heat_t *heat, const char *path, addr_t vaddr, size_t len, addr_t bias) {
+  heat->vaddr = vaddr;
+  heat->len = len;
+  heat->total = heat->outside = 0;
+  heat->hits = (uint64_t *)calloc(len > 0 ? len : 1, sizeof(uint64_t));
+  char *buf = (char *)malloc(HEAT_CHUNK);
+  if (heat->hits == NULL || buf == NULL) {
+    printf("Could not allocate memory for samples!\n");
+    goto ERR_FREE;
+  }
+
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    printf("Could not open samples: %s\n", path);
+    goto ERR_FREE;
+  }
+
+  // Chunked scan, hundreds of millions of lines are common
+  enum { LINE_START, NUMBER, SKIP } state = LINE_START;
+  uint64_t value = 0;
+  int digits = 0;
+  size_t n;
+  while ((n = fread(buf, 1, HEAT_CHUNK, in)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      char c = buf[i];
+      if (c == '\n') {
+        if (state == NUMBER && digits > 0)
+          heat_add(heat, value - bias);
+        state = LINE_START;
+        value = 0;
+        digits = 0;
+        continue;
+      }
+
+      if (state == LINE_START) {
+        if (c == ' ' || c == '\t')
+          continue;
+        state = NUMBER;
+      }
+      if (state != NUMBER)
+        continue;
+
+      int d = hex_digit(c);
+      if (d >= 0) {
+        value = (value << 4) | d;
+        digits++;
+      }
+      else if (c == 'x' && digits == 1 && value == 0) {
+        digits = 0; // 0x prefix
+      }
+      else {
+        if ((c == ' ' || c == '\t' || c == '\r') && digits > 0)
+          heat_add(heat, value - bias);
+        state = SKIP;
+      }
+    }
+  }
+  if (state == NUMBER && digits > 0)
+    heat_add(heat, value - bias);
+
+  bool failed = ferror(in);
+  fclose(in);
+  if (failed) {
+    printf("Could not read samples: %s\n", path);
+    goto ERR_FREE;
+  }
+
+  free(buf);
+  return 0;
+
+ERR_FREE:
+  free(buf);
+  free(heat->hits);
+  heat->hits = NULL;
+  return 1;
+}
+
+void heat_free(heat_t *heat) {
+  free(heat->hits);
+  heat->hits = NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef HEAT_H
+#define HEAT_H
+
+#include <stdio.h>
+
+#include "decode.h"
+
+#define HEAT_LEVELS 9
+
+// Sampled instr. addresses, direct-mapped per byte of region
+//  Instr. & block counts sum their bytes, skid into the middle of
+//  an instr. still counts for it
+typedef struct heat {
+  addr_t vaddr;
+  size_t len;
+  uint64_t *hits;   // hits[addr - vaddr]
+  uint64_t total;   // samples read
+  uint64_t outside; // samples not within region
+} heat_t;
+
+/**
+ * return => samples hitting instr.
+ */
+static inline uint64_t heat_instr(const heat_t *heat, const instr_t *instr) {
+  uint64_t sum = 0;
+  for (size_t off = instr->addr - heat->vaddr, end = off + instr->len; off < end && off < heat->len; off++)
+    sum += heat->hits[off];
+  return sum;
+}
+
+/**
+ * Sums bblock starting at list[i], up to next label
+ *  return => samples hitting the bblock
+ */
+static inline uint64_t heat_block(const heat_t *heat, instr_t list[], int count, int i) {
+  uint64_t sum = heat_instr(heat, &list[i]);
+  for (int j = i + 1; j < count && !has_label(&list[j]); j++)
+    sum += heat_instr(heat, &list[j]);
+  return sum;
+}
+
+/**
+ * Log-scaled heat of hits relative to all samples
+ *  return => 0 - HEAT_LEVELS-1, -1 if not hit at all
+ */
+static inline int heat_level(const heat_t *heat, uint64_t hits) {
+  if (hits == 0)
+    return -1;
+  int level = (64 - __builtin_clzll(hits)) * HEAT_LEVELS / (64 - __builtin_clzll(heat->total) + 1);
+  return level < HEAT_LEVELS ? level : HEAT_LEVELS - 1;
+}
+
+/**
+ * White -> yellow -> red
+ */
+static inline const char *heat_color(int level) {
+  static const char *colors[HEAT_LEVELS] = {
+    "#ffffcc", "#ffeda0", "#fed976", "#feb24c", "#fd8d3c",
+    "#fc4e2a", "#e31a1c", "#bd0026", "#800026"
+  };
+  return colors[level];
+}
+
+int heat_load(heat_t *heat, const char *path, addr_t vaddr, size_t len, addr_t bias);
+void heat_free(heat_t *heat);
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "func.h"
+#include "image.h"
+
+/**
+ * Maps file, parses ELF tables and decodes every function
+ *  image => malloc'd, free with image_free()
+ *  return => 0 on success
+ */
+int image_load(const char *path, image_t **image) {
+  image_t *img = (image_t *)calloc(1, sizeof(image_t));
+  if (img == NULL) {
+    printf("Could not allocate memory for image!\n");
+    return 1;
+  }
+  img->fd = -1;
+
+  img->path = strdup(path);
+  if (img->path == NULL || load_file(path, &img->fd, &img->bin, &img->fsize)) {
+    img->fd = -1;
+    goto ERR_FREE;
+  }
+
+  struct stat st;
+  if (fstat(img->fd, &st) < 0)
+    goto ERR_FREE;
+  img->dev = st.st_dev;
+  img->ino = st.st_ino;
+  img->mtime = st.st_mtim;
+
+  if (!is_elf_file(img->bin, img->fsize)) {
+    printf("File is not an .elf file: %s\n", path);
+    goto ERR_FREE;
+  }
+
+  if (get_elf_sections(img->bin, img->fsize, img->sections, &img->n_sections)
+      || get_elf_info(img->bin, img->sections, img->n_sections, &img->entry, &img->vaddr, &img->offset, &img->size)
+      || get_elf_symtab(img->bin, img->sections, img->n_sections, &img->symbols, &img->n_symbols)
+      || get_elf_fdes(img->bin, img->sections, img->n_sections, &img->fdes, &img->n_fdes)
+      || get_elf_plt(img->bin, img->sections, img->n_sections, &img->plt)
+      || get_elf_relocs(img->bin, img->sections, img->n_sections, img->offset, &img->relocs)
+      || (img->n_symbols > 0 && symbol_index_init(&img->sym_index, img->symbols, img->n_symbols)))
+    goto ERR_FREE;
+  load_file_range(img->bin, img->fsize, img->offset, img->size, LOAD_POPULATE);
+
+  byte_t *text = img->bin + img->offset;
+  if (find_functions(text, img->size, img->vaddr, img->entry, img->symbols, img->n_symbols,
+                     img->fdes, img->n_fdes, &img->relocs, &img->funcs, &img->n_funcs)
+      || decode_functions(text, img->vaddr, img->funcs, img->n_funcs, &img->relocs,
+                          img->bin, img->sections, img->n_sections, sysconf(_SC_NPROCESSORS_ONLN)))
+    goto ERR_FREE;
+
+  for (int i = 0; i < img->n_funcs; i++) {
+    proc_symtab_labels(img->funcs[i].instr, img->funcs[i].count, img->symbols, img->n_symbols);
+    proc_flow_labels(img->funcs[i].instr, img->funcs[i].count);
+    proc_section_labels(img->funcs[i].instr, img->funcs[i].count, img->sections, img->n_sections);
+  }
+  proc_call_labels(img->funcs, img->n_funcs);
+  for (int i = 0; i < img->n_funcs; i++) {
+    proc_plt_labels(img->funcs[i].instr, img->funcs[i].count, &img->plt);
+    proc_reloc_labels(img->funcs[i].instr, img->funcs[i].count, &img->relocs);
+  }
+
+  img->func_base = (int *)malloc((img->n_funcs + 1) * sizeof(int));
+  if (img->func_base == NULL || build_func_xrefs(img->funcs, img->n_funcs, &img->xref))
+    goto ERR_FREE;
+  img->func_base[0] = 0;
+  for (int i = 0; i < img->n_funcs; i++)
+    img->func_base[i + 1] = img->func_base[i] + img->funcs[i].count;
+
+  // Budget accounting
+  img->mem = sizeof(image_t) + img->fsize
+      + img->n_symbols * sizeof(symbol_t) + img->n_fdes * sizeof(fde_t)
+      + img->n_funcs * (sizeof(func_t) + sizeof(int))
+      + img->xref.n_targets * (sizeof(addr_t) + sizeof(int)) + img->xref.n_refs * sizeof(int);
+  if (img->n_symbols > 0)
+    img->mem += (img->sym_index.mask + 1) * sizeof(int);
+  if (img->plt.n_entries > 0)
+    img->mem += img->plt.n_entries * sizeof(plt_entry_t) + (img->plt.mask + 1) * sizeof(int);
+  img->mem += img->relocs.n_relocs * sizeof(reloc_t);
+  for (int i = 0; i < img->n_funcs; i++)
+    img->mem += img->funcs[i].count * sizeof(instr_t);
+
+  *image = img;
+  return 0;
+
+ERR_FREE:
+  image_free(img);
+  return 1;
+}
+
+void image_free(image_t *image) {
+  if (image->funcs != NULL)
+    free_functions(image->funcs, image->n_funcs);
+  if (image->n_symbols > 0)
+    symbol_index_free(&image->sym_index);
+  plt_index_free(&image->plt);
+  reloc_index_free(&image->relocs);
+  xref_free(&image->xref);
+  free(image->func_base);
+  free(image->symbols);
+  free(image->fdes);
+  if (image->fd >= 0)
+    close_file(image->bin, image->fd, image->fsize);
+  free(image->path);
+  free(image);
+}
+
+/**
+ * return => function whose [addr, end) covers addr, NULL if none
+ */
+func_t *image_find_func(image_t *image, uintptr_t addr) {
+  int lo = 0, hi = image->n_funcs - 1;
+  while (lo <= hi) {
+    int mid = lo + (hi - lo) / 2;
+    func_t *func = &image->funcs[mid];
+    if (addr < func->addr)
+      hi = mid - 1;
+    else if (addr >= func->end)
+      lo = mid + 1;
+    else
+      return func;
+  }
+  return NULL;
+}
+
+/**
+ * Maps xref id back to instr.
+ *  func => function containing it
+ */
+instr_t *image_get_xref(image_t *image, int id, func_t **func) {
+  int lo = 0, hi = image->n_funcs - 1;
+  while (lo < hi) {
+    int mid = lo + (hi - lo + 1) / 2;
+    if (image->func_base[mid] <= id)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  *func = &image->funcs[lo];
+  return &image->funcs[lo].instr[id - image->func_base[lo]];
+}
+
+void cache_init(image_cache_t *cache, size_t budget) {
+  pthread_mutex_init(&cache->lock, NULL);
+  cache->head = cache->tail = NULL;
+  cache->n_images = 0;
+  cache->mem = 0;
+  cache->budget = budget;
+}
+
+// Caller holds cache->lock
+static void cache_unlink(image_cache_t *cache, image_t *image) {
+  if (image->prev != NULL)
+    image->prev->next = image->next;
+  else
+    cache->head = image->next;
+  if (image->next != NULL)
+    image->next->prev = image->prev;
+  else
+    cache->tail = image->prev;
+
+  image->prev = image->next = NULL;
+  image->stale = true;
+  cache->n_images--;
+  cache->mem -= image->mem;
+}
+
+// Caller holds cache->lock
+static void cache_push_head(image_cache_t *cache, image_t *image) {
+  image->prev = NULL;
+  image->next = cache->head;
+  if (cache->head != NULL)
+    cache->head->prev = image;
+  cache->head = image;
+  if (cache->tail == NULL)
+    cache->tail = image;
+}
+
+/**
+ * Drops least recently used idle images until within budget
+ *  Images in use are skipped, so the budget may be exceeded while they are
+ *  Caller holds cache->lock
+ */
+static void cache_evict(image_cache_t *cache) {
+  image_t *image = cache->tail;
+  while (cache->mem > cache->budget && image != NULL) {
+    image_t *prev = image->prev;
+    if (image->refs == 0) {
+      fprintf(stderr, "Evicting image: %s\n", image->path);
+      cache_unlink(cache, image);
+      image_free(image);
+    }
+    image = prev;
+  }
+}
+
+void cache_free(image_cache_t *cache) {
+  pthread_mutex_lock(&cache->lock);
+  while (cache->head != NULL) {
+    image_t *image = cache->head;
+    cache_unlink(cache, image);
+    if (image->refs == 0)
+      image_free(image);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+static bool is_same_file(const image_t *image, const struct stat *st) {
+  return image->dev == st->st_dev && image->ino == st->st_ino
+      && image->fsize == (size_t)st->st_size
+      && image->mtime.tv_sec == st->st_mtim.tv_sec
+      && image->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/**
+ * Finds resident image of path or loads it, files changed on disk are reloaded
+ *  Concurrent misses on one path may both load it, the loser is dropped
+ *  return => image pinned until cache_release(), NULL on error
+ */
+image_t *cache_acquire(image_cache_t *cache, const char *path) {
+  struct stat st;
+  if (stat(path, &st) < 0) {
+    printf("Could not stat file: %s\n", path);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  for (image_t *image = cache->head; image != NULL; image = image->next) {
+    if (strcmp(image->path, path))
+      continue;
+
+    if (is_same_file(image, &st)) {
+      cache_unlink(cache, image);
+      image->stale = false;
+      cache_push_head(cache, image);
+      cache->n_images++;
+      cache->mem += image->mem;
+      image->refs++;
+      pthread_mutex_unlock(&cache->lock);
+      return image;
+    }
+
+    // Outdated, free now or on last release
+    cache_unlink(cache, image);
+    if (image->refs == 0)
+      image_free(image);
+    break;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  // Load without holding the lock, other queries go on meanwhile
+  image_t *loaded;
+  if (image_load(path, &loaded))
+    return NULL;
+
+  pthread_mutex_lock(&cache->lock);
+  for (image_t *image = cache->head; image != NULL; image = image->next) {
+    if (!strcmp(image->path, path) && image->ino == loaded->ino
+        && image->mtime.tv_sec == loaded->mtime.tv_sec
+        && image->mtime.tv_nsec == loaded->mtime.tv_nsec) {
+      image->refs++;
+      pthread_mutex_unlock(&cache->lock);
+      image_free(loaded);
+      return image;
+    }
+  }
+
+  cache_push_head(cache, loaded);
+  cache->n_images++;
+  cache->mem += loaded->mem;
+  loaded->refs = 1;
+  cache_evict(cache);
+  pthread_mutex_unlock(&cache->lock);
+
+  return loaded;
+}
+
+void cache_release(image_cache_t *cache, image_t *image) {
+  pthread_mutex_lock(&cache->lock);
+  image->refs--;
+  if (image->refs == 0) {
+    if (image->stale)
+      image_free(image);
+    else
+      cache_evict(cache);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
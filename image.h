@@ -0,0 +1,68 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "func.h"
+#include "xref.h"
+
+// Mapped & fully decoded binary, read-only once loaded
+typedef struct image {
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+
+  int fd;
+  byte_t *bin;
+  size_t fsize;
+
+  section_t sections[MAX_SECTIONS];
+  int n_sections;
+  symbol_t *symbols;
+  int n_symbols;
+  symbol_index_t sym_index;
+  plt_index_t plt;
+  reloc_index_t relocs;
+  fde_t *fdes;
+  int n_fdes;
+
+  uintptr_t entry, vaddr, offset;
+  size_t size;
+
+  func_t *funcs;
+  int n_funcs;
+  int *func_base; // xref id of funcs[i].instr[0], n_funcs + 1 entries
+  xref_t xref;
+
+  size_t mem; // mapped + heap bytes, for the cache budget
+
+  // Owned by image_cache_t
+  int refs;
+  bool stale; // dropped from cache, freed on last release
+  struct image *prev, *next;
+} image_t;
+
+// LRU of resident images, head = most recently used
+typedef struct {
+  pthread_mutex_t lock;
+  image_t *head, *tail;
+  int n_images;
+  size_t mem;
+  size_t budget;
+} image_cache_t;
+
+int image_load(const char *path, image_t **image);
+void image_free(image_t *image);
+func_t *image_find_func(image_t *image, uintptr_t addr);
+instr_t *image_get_xref(image_t *image, int id, func_t **func);
+
+void cache_init(image_cache_t *cache, size_t budget);
+void cache_free(image_cache_t *cache);
+image_t *cache_acquire(image_cache_t *cache, const char *path);
+void cache_release(image_cache_t *cache, image_t *image);
+
+#endif
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "istat.h"
+
+#define GROUP_MNEMONIC "(group)"
+
+typedef struct {
+  const char **paths;
+  int n_paths;
+  int next; // next path to take, atomic
+} istat_work_t;
+
+typedef struct {
+  istat_work_t *work;
+  istat_t stat; // of this thread only
+} istat_worker_t;
+
+static bool is_legacy_prefix(byte_t b) {
+  switch (b) {
+    case 0x26: case 0x2E: case 0x36: case 0x3E: case 0x64: case 0x65: // segment
+    case 0x66: case 0x67:                                             // operand/address size
+    case 0xF0: case 0xF2: case 0xF3:                                  // lock, rep
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * Keeps mnemonic of opcode, "(group)" once /digit extensions differ
+ */
+static void note_mnemonic(char mnemonic[], const char *seen) {
+  if (mnemonic[0] == '\0')
+    snprintf(mnemonic, MNEMO_OPCODE_LEN, "%s", seen);
+  else if (strcmp(mnemonic, seen))
+    snprintf(mnemonic, MNEMO_OPCODE_LEN, "%s", GROUP_MNEMONIC);
+}
+
+/**
+ * Adds linear sweep of bytes[] to stat, no listing kept
+ *  Last instr. are decoded from zero-padded copy, so none reads past size
+ */
+void istat_region(istat_t *stat, byte_t bytes[], addr_t vaddr, size_t size) {
+  byte_t tail[2 * MAX_INSTR_LEN] = { 0 };
+  size_t pos = 0;
+  instr_t instr;
+
+  while (pos < size) {
+    size_t len;
+    if (size - pos >= MAX_INSTR_LEN) {
+      len = decode_instr(&instr, bytes, vaddr, pos, vaddr);
+    }
+    else {
+      memcpy(tail, &bytes[pos], size - pos);
+      len = decode_instr(&instr, tail, vaddr + pos, 0, vaddr);
+    }
+    if (len == 0 || len > size - pos)
+      break; // truncated
+
+    byte_t first = bytes[pos];
+    pos += len;
+
+    stat->instr++;
+    stat->lengths[len <= MAX_INSTR_LEN ? len : MAX_INSTR_LEN]++;
+    stat->flows[get_instr_flow(&instr)]++;
+    stat->opcodes[instr.has_ext_opcode][instr.opcode]++;
+    if (is_legacy_prefix(first))
+      stat->prefixes[first]++;
+    if (instr.has_rex) {
+      stat->rex++;
+      stat->rex_w += instr.rex.w;
+    }
+
+    if (!strcmp(instr.mnemo_opcode, "unknown")) {
+      stat->unknown++;
+      stat->unknown_opcodes[instr.has_ext_opcode][instr.opcode]++;
+    }
+    else {
+      note_mnemonic(stat->mnemonics[instr.has_ext_opcode][instr.opcode], instr.mnemo_opcode);
+    }
+  }
+
+  stat->bytes += pos;
+}
+
+void istat_merge(istat_t *to, const istat_t *from) {
+  to->files += from->files;
+  to->skipped += from->skipped;
+  to->bytes += from->bytes;
+  to->instr += from->instr;
+  to->unknown += from->unknown;
+  to->rex += from->rex;
+  to->rex_w += from->rex_w;
+  for (int i = 0; i < 256; i++)
+    to->prefixes[i] += from->prefixes[i];
+  for (int i = 0; i <= MAX_INSTR_LEN; i++)
+    to->lengths[i] += from->lengths[i];
+  for (int i = 0; i <= FLOW_IJMP; i++)
+    to->flows[i] += from->flows[i];
+
+  for (int ext = 0; ext < 2; ext++) {
+    for (int op = 0; op < 256; op++) {
+      to->opcodes[ext][op] += from->opcodes[ext][op];
+      to->unknown_opcodes[ext][op] += from->unknown_opcodes[ext][op];
+      if (from->mnemonics[ext][op][0] != '\0')
+        note_mnemonic(to->mnemonics[ext][op], from->mnemonics[ext][op]);
+    }
+  }
+}
+
+/**
+ * .text of one ELF file into stat, anything else is skipped
+ */
+static void istat_file(istat_t *stat, const char *path) {
+  int fd;
+  size_t fsize;
+  byte_t *bin;
+  if (load_file(path, &fd, &bin, &fsize)) {
+    stat->skipped++;
+    return;
+  }
+
+  section_t sections[MAX_SECTIONS];
+  uintptr_t entry, offset, vaddr;
+  size_t size;
+  int n_sections;
+  if (!is_elf_file(bin, fsize)
+      || get_elf_sections(bin, fsize, sections, &n_sections)
+      || get_elf_info(bin, sections, n_sections, &entry, &vaddr, &offset, &size)) {
+    stat->skipped++;
+  }
+  else {
+    load_file_range(bin, fsize, offset, size, LOAD_POPULATE);
+    istat_region(stat, bin + offset, vaddr, size);
+    stat->files++;
+  }
+
+  close_file(bin, fd, fsize);
+}
+
+static void *istat_worker(void *arg) {
+  istat_worker_t *worker = (istat_worker_t *)arg;
+  istat_work_t *work = worker->work;
+  int i;
+
+  while ((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->n_paths)
+    istat_file(&worker->stat, work->paths[i]);
+
+  return NULL;
+}
+
+/**
+ * Statistics of all files, in n_threads parallel workers
+ *  Each worker counts on its own, counts are merged once all are done
+ *  total => zeroed first
+ *  return => 0 on success
+ */
+int istat_files(const char *paths[], int n_paths, int n_threads, istat_t *total) {
+  if (n_threads > n_paths)
+    n_threads = n_paths;
+  if (n_threads < 1)
+    n_threads = 1;
+
+  istat_work_t work = { paths, n_paths, 0 };
+  istat_worker_t *workers = (istat_worker_t *)calloc(n_threads, sizeof(istat_worker_t));
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+  if (workers == NULL || threads == NULL) {
+    printf("Could not allocate memory for statistics!\n");
+    free(workers);
+    free(threads);
+    return 1;
+  }
+
+  int started = 0;
+  for (int i = 0; i < n_threads; i++) {
+    workers[i].work = &work;
+    if (pthread_create(&threads[i], NULL, istat_worker, &workers[i]) != 0)
+      break;
+    started++;
+  }
+
+  // No threads, count on this one
+  if (started == 0) {
+    workers[0].work = &work;
+    istat_worker(&workers[0]);
+    started = 1;
+  }
+  else {
+    for (int i = 0; i < started; i++)
+      pthread_join(threads[i], NULL);
+  }
+
+  memset(total, 0, sizeof(istat_t));
+  for (int i = 0; i < started; i++)
+    istat_merge(total, &workers[i].stat);
+
+  free(workers);
+  free(threads);
+  return 0;
+}
+
+static inline double percent(uint64_t part, uint64_t whole) {
+  return whole > 0 ? 100.0 * part / whole : 0.0;
+}
+
+typedef struct {
+  int ext;
+  int op;
+  uint64_t count;
+} opcode_count_t;
+
+static int compare_opcode_count(const void *a, const void *b) {
+  uint64_t x = ((const opcode_count_t *)a)->count, y = ((const opcode_count_t *)b)->count;
+  return (x < y) - (x > y);
+}
+
+/**
+ * Summary, length histogram & opcodes by frequency
+ */
+void print_istat(FILE *out, const istat_t *stat) {
+  fprintf(out, "files: %lu, %lu skipped\n", stat->files, stat->skipped);
+  fprintf(out, "bytes: %lu, instr.: %lu, %.2f bytes/instr.\n",
+          stat->bytes, stat->instr, stat->instr > 0 ? (double)stat->bytes / stat->instr : 0.0);
+  fprintf(out, "unknown: %lu, %.2f%%\n", stat->unknown, percent(stat->unknown, stat->instr));
+  fprintf(out, "rex: %.2f%%, rex.w: %.2f%%\n", percent(stat->rex, stat->instr), percent(stat->rex_w, stat->instr));
+
+  fprintf(out, "prefixes:");
+  for (int b = 0; b < 256; b++) {
+    if (stat->prefixes[b] > 0)
+      fprintf(out, " %02x %.2f%%", b, percent(stat->prefixes[b], stat->instr));
+  }
+  fprintf(out, "\n");
+
+  uint64_t branches = stat->flows[FLOW_JCC] + stat->flows[FLOW_JMP] + stat->flows[FLOW_IJMP]
+                    + stat->flows[FLOW_CALL] + stat->flows[FLOW_RET];
+  fprintf(out, "branches: %.2f%% (jcc %.2f%%, jmp %.2f%%, jmp* %.2f%%, call %.2f%%, ret %.2f%%)\n",
+          percent(branches, stat->instr),
+          percent(stat->flows[FLOW_JCC], stat->instr), percent(stat->flows[FLOW_JMP], stat->instr),
+          percent(stat->flows[FLOW_IJMP], stat->instr), percent(stat->flows[FLOW_CALL], stat->instr),
+          percent(stat->flows[FLOW_RET], stat->instr));
+
+  fprintf(out, "\nlength        count        %%\n");
+  for (int len = 1; len <= MAX_INSTR_LEN; len++) {
+    if (stat->lengths[len] > 0)
+      fprintf(out, "%6d %12lu %7.2f%%\n", len, stat->lengths[len], percent(stat->lengths[len], stat->instr));
+  }
+
+  // Most frequent first, unknown share says what decode_single() lacks
+  opcode_count_t counts[2 * 256];
+  int n = 0;
+  for (int ext = 0; ext < 2; ext++) {
+    for (int op = 0; op < 256; op++) {
+      if (stat->opcodes[ext][op] > 0)
+        counts[n++] = (opcode_count_t){ ext, op, stat->opcodes[ext][op] };
+    }
+  }
+  qsort(counts, n, sizeof(opcode_count_t), compare_opcode_count);
+
+  fprintf(out, "\nopcode        count        %%  unknown  mnemonic\n");
+  for (int i = 0; i < n; i++) {
+    int ext = counts[i].ext, op = counts[i].op;
+    fprintf(out, "%s%02x%s %12lu %7.2f%% %7.2f%%  %s\n", ext ? "0f " : "", op, ext ? "" : "   ",
+            counts[i].count, percent(counts[i].count, stat->instr),
+            percent(stat->unknown_opcodes[ext][op], counts[i].count),
+            stat->mnemonics[ext][op][0] != '\0' ? stat->mnemonics[ext][op] : "-");
+  }
+}
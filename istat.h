@@ -0,0 +1,32 @@
+#ifndef ISTAT_H
+#define ISTAT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "decode.h"
+
+// Decoder statistics of linear sweep over .text, summed over files
+//  Legacy prefixes decode as 1-byte unknown instr. of their own, they
+//  count both as prefixes and as unknown opcodes
+typedef struct {
+  uint64_t files;
+  uint64_t skipped; // not ELF, or no .text
+  uint64_t bytes;
+  uint64_t instr;
+  uint64_t unknown;
+  uint64_t rex, rex_w;
+  uint64_t prefixes[256];                   // by prefix byte
+  uint64_t lengths[MAX_INSTR_LEN + 1];
+  uint64_t flows[FLOW_IJMP + 1];
+  uint64_t opcodes[2][256];                 // [has_ext_opcode][opcode]
+  uint64_t unknown_opcodes[2][256];         // of opcodes[][], decoded as unknown
+  char mnemonics[2][256][MNEMO_OPCODE_LEN]; // of known decodes, "(group)" if they differ
+} istat_t;
+
+void istat_region(istat_t *stat, byte_t bytes[], addr_t vaddr, size_t size);
+void istat_merge(istat_t *to, const istat_t *from);
+int istat_files(const char *paths[], int n_paths, int n_threads, istat_t *total);
+void print_istat(FILE *out, const istat_t *stat);
+
+#endif
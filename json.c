@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "decode.h"
+#include "xref.h"
+#include "heat.h"
+#include "jtab.h"
+#include "json.h"
+
+#define JSONL_RESERVE 2 // closing "}\n"
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static const char *FLOW_NAMES[] = {
+  [FLOW_NONE] = "none",
+  [FLOW_JCC]  = "jcc",
+  [FLOW_JMP]  = "jmp",
+  [FLOW_CALL] = "call",
+  [FLOW_RET]  = "ret",
+  [FLOW_IJMP] = "ijmp"
+};
+
+/**
+ * return => format by name (text, jsonl), 1 if unknown
+ */
+int parse_format(const char *arg, format_t *format) {
+  if (!strcmp(arg, "text"))
+    *format = FORMAT_TEXT;
+  else if (!strcmp(arg, "jsonl"))
+    *format = FORMAT_JSONL;
+  else
+    return 1;
+  return 0;
+}
+
+static inline bool has_room(const jsonl_t *rec, size_t n) {
+  return rec->len + n <= JSONL_RECORD_LEN - JSONL_RESERVE;
+}
+
+static inline void put_raw(jsonl_t *rec, const char *s, size_t n) {
+  memcpy(rec->buf + rec->len, s, n);
+  rec->len += n;
+}
+
+/**
+ * Digits of value in base 10/16, no prefix
+ *  return => num. of chars written
+ */
+static int format_uint(char *buf, uint64_t value, int base) {
+  char tmp[20];
+  int n = 0;
+  do {
+    tmp[n++] = HEX_DIGITS[value % base];
+    value /= base;
+  } while (value > 0);
+
+  for (int i = 0; i < n; i++)
+    buf[i] = tmp[n - 1 - i];
+  return n;
+}
+
+/**
+ * Writes ,"key": if there's room for it & value of value_len
+ *  return => false if the field must be skipped
+ */
+static bool put_key(jsonl_t *rec, const char *key, size_t value_len) {
+  size_t key_len = strlen(key);
+  if (!has_room(rec, key_len + 4 + value_len))
+    return false;
+
+  rec->buf[rec->len++] = ',';
+  rec->buf[rec->len++] = '"';
+  put_raw(rec, key, key_len);
+  rec->buf[rec->len++] = '"';
+  rec->buf[rec->len++] = ':';
+  return true;
+}
+
+/**
+ * Appends escaped chars of string value, cut where it would not fit
+ *  Room for closing quote is kept
+ */
+static void put_escaped(jsonl_t *rec, const char *s) {
+  for (; *s != '\0'; s++) {
+    byte_t c = (byte_t)*s;
+    char esc[6];
+    size_t n;
+    if (c == '"' || c == '\\') {
+      esc[0] = '\\';
+      esc[1] = c;
+      n = 2;
+    }
+    else if (c < 0x20) {
+      memcpy(esc, "\\u00", 4);
+      esc[4] = HEX_DIGITS[c >> 4];
+      esc[5] = HEX_DIGITS[c & 0xF];
+      n = 6;
+    }
+    else {
+      esc[0] = c;
+      n = 1;
+    }
+
+    if (!has_room(rec, n + 1))
+      return;
+    put_raw(rec, esc, n);
+  }
+}
+
+void jsonl_begin(jsonl_t *rec, const char *kind) {
+  rec->len = 0;
+  put_raw(rec, "{\"kind\":\"", 9);
+  put_escaped(rec, kind);
+  rec->buf[rec->len++] = '"';
+}
+
+void jsonl_str(jsonl_t *rec, const char *key, const char *value) {
+  if (!put_key(rec, key, 2))
+    return;
+  rec->buf[rec->len++] = '"';
+  put_escaped(rec, value);
+  rec->buf[rec->len++] = '"';
+}
+
+/**
+ * Address as "0x<hex>" string, 64-bit values don't survive JSON numbers
+ */
+void jsonl_addr(jsonl_t *rec, const char *key, addr_t value) {
+  char buf[20] = "\"0x";
+  int n = 3 + format_uint(buf + 3, value, 16);
+  buf[n++] = '"';
+  if (put_key(rec, key, n))
+    put_raw(rec, buf, n);
+}
+
+void jsonl_uint(jsonl_t *rec, const char *key, uint64_t value) {
+  char buf[20];
+  int n = format_uint(buf, value, 10);
+  if (put_key(rec, key, n))
+    put_raw(rec, buf, n);
+}
+
+void jsonl_true(jsonl_t *rec, const char *key) {
+  if (put_key(rec, key, 4))
+    put_raw(rec, "true", 4);
+}
+
+/**
+ * Label as print_label() renders it
+ */
+void jsonl_label(jsonl_t *rec, const char *key, const label_t *label, addr_t addr) {
+  char base[24] = "sub_", suffix[20] = "_";
+  base[4 + format_uint(base + 4, label->base, 16)] = '\0';
+  suffix[addr != label->base ? 1 + format_uint(suffix + 1, addr, 16) : 0] = '\0';
+
+  if (!put_key(rec, key, 2 + strlen(suffix)))
+    return;
+  rec->buf[rec->len++] = '"';
+  put_escaped(rec, label->name != NULL ? label->name : base);
+  put_escaped(rec, suffix);
+  rec->buf[rec->len++] = '"';
+}
+
+void jsonl_end(jsonl_t *rec, FILE *out) {
+  put_raw(rec, "}\n", 2);
+  fwrite(rec->buf, 1, rec->len, out);
+}
+
+/**
+ * Instr. record, fields of print_instr_list() line
+ *  n_refs, hits => omitted if 0
+ */
+void jsonl_instr(FILE *out, const instr_t *instr, int n_refs, uint64_t hits) {
+  jsonl_t rec;
+  jsonl_begin(&rec, "instr");
+  jsonl_addr(&rec, "addr", instr->addr);
+  if (has_label(instr))
+    jsonl_label(&rec, "label", &instr->label, instr->addr);
+  if (n_refs > 0)
+    jsonl_uint(&rec, "xrefs", n_refs);
+  jsonl_str(&rec, "bytes", instr->hex_bytes);
+  jsonl_str(&rec, "mnemonic", instr->mnemo_opcode);
+  if (instr->mnemo_operand[0] != '\0')
+    jsonl_str(&rec, "operands", instr->mnemo_operand);
+
+  flow_t flow = get_instr_flow(instr);
+  if (flow != FLOW_NONE)
+    jsonl_str(&rec, "flow", FLOW_NAMES[flow]);
+  if (flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL)
+    jsonl_addr(&rec, "dest", get_instr_dest(instr));
+  if (instr->flags & INSTR_CF_LABEL)
+    jsonl_label(&rec, "dest_label", &instr->cf_label, get_instr_dest(instr));
+  else if (instr->mnemo_notes[0] != '\0')
+    jsonl_str(&rec, "note", instr->mnemo_notes);
+
+  if (instr->flags & INSTR_SWEPT)
+    jsonl_true(&rec, "swept");
+  if (hits > 0)
+    jsonl_uint(&rec, "hits", hits);
+  jsonl_end(&rec, out);
+}
+
+/**
+ * print_instr_list() as JSON Lines, one record per instr.
+ */
+void jsonl_instr_list(FILE *out, instr_t list[], int count, const xref_t *xrefs, const heat_t *heat) {
+  for (int i = 0; i < count; i++) {
+    const int *refs;
+    int n_refs = xrefs != NULL && has_label(&list[i]) ? xref_lookup(xrefs, list[i].addr, &refs) : 0;
+    jsonl_instr(out, &list[i], n_refs, heat != NULL ? heat_instr(heat, &list[i]) : 0);
+  }
+}
+
+static void jsonl_edge(FILE *out, const instr_t *from, const label_t *dest, addr_t dest_addr, const char *type) {
+  jsonl_t rec;
+  jsonl_begin(&rec, "edge");
+  jsonl_label(&rec, "from", &from->label, from->addr);
+  jsonl_label(&rec, "to", dest, dest_addr);
+  jsonl_str(&rec, "type", type);
+  jsonl_end(&rec, out);
+}
+
+/**
+ * CFG as JSON Lines, bblock record followed by its instr., then all edges
+ *  Same bblocks & edges as print_bblocks(), print_arrows() & print_jtab_arrows() draw
+ *  return => num. of bblocks
+ */
+int jsonl_cfg(FILE *out, instr_t list[], int count, jtab_t jtabs[], int n_jtabs, const heat_t *heat) {
+  int bblock_count = 0;
+  jsonl_t rec;
+
+  for (int i = 0; i < count; i++) {
+    if (has_label(&list[i])) {
+      int n = 1;
+      while (i + n < count && !has_label(&list[i + n]))
+        n++;
+
+      jsonl_begin(&rec, "block");
+      jsonl_label(&rec, "label", &list[i].label, list[i].addr);
+      jsonl_addr(&rec, "addr", list[i].addr);
+      jsonl_addr(&rec, "end", list[i + n - 1].addr + list[i + n - 1].len);
+      jsonl_uint(&rec, "n_instr", n);
+      uint64_t hits = heat != NULL ? heat_block(heat, list, count, i) : 0;
+      if (hits > 0)
+        jsonl_uint(&rec, "hits", hits);
+      jsonl_end(&rec, out);
+      bblock_count++;
+    }
+    jsonl_instr(out, &list[i], 0, heat != NULL ? heat_instr(heat, &list[i]) : 0);
+  }
+
+  int prev_bblock_i = 0;
+  for (int i = 0; i < count; i++) {
+    if (has_label(&list[i]))
+      prev_bblock_i = i;
+
+    flow_t flow = get_instr_flow(&list[i]);
+    if ((flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL)
+        && (list[i].flags & INSTR_CF_LABEL))
+      jsonl_edge(out, &list[prev_bblock_i], &list[i].cf_label, get_instr_dest(&list[i]), list[i].mnemo_opcode);
+
+    if (i < count - 1 && has_label(&list[i + 1])
+        && flow != FLOW_JMP && flow != FLOW_IJMP && flow != FLOW_RET)
+      jsonl_edge(out, &list[prev_bblock_i], &list[i + 1].label, list[i + 1].addr, "next");
+  }
+
+  for (int i = 0; i < n_jtabs; i++) {
+    int j = find_instr(list, count, jtabs[i].addr);
+    if (j < 0)
+      continue;
+    while (j > 0 && !has_label(&list[j]))
+      j--;
+
+    for (int k = 0; k < jtabs[i].n_targets; k++) {
+      int t = find_instr(list, count, jtabs[i].targets[k]);
+      if (t >= 0 && has_label(&list[t]))
+        jsonl_edge(out, &list[j], &list[t].label, list[t].addr, "case");
+    }
+  }
+
+  return bblock_count;
+}
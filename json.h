@@ -0,0 +1,42 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "decode.h"
+#include "jtab.h"
+
+#define JSONL_RECORD_LEN 2048
+
+typedef enum {
+  FORMAT_TEXT,
+  FORMAT_JSONL // one JSON object per line
+} format_t;
+
+// JSON Lines record, built on stack & written with one fwrite()
+//  Fields that don't fit are cut, the record stays valid JSON
+typedef struct {
+  char buf[JSONL_RECORD_LEN];
+  size_t len;
+} jsonl_t;
+
+struct xref;
+struct heat;
+
+int parse_format(const char *arg, format_t *format);
+
+void jsonl_begin(jsonl_t *rec, const char *kind);
+void jsonl_str(jsonl_t *rec, const char *key, const char *value);
+void jsonl_addr(jsonl_t *rec, const char *key, addr_t value);
+void jsonl_uint(jsonl_t *rec, const char *key, uint64_t value);
+void jsonl_true(jsonl_t *rec, const char *key);
+void jsonl_label(jsonl_t *rec, const char *key, const label_t *label, addr_t addr);
+void jsonl_end(jsonl_t *rec, FILE *out);
+
+void jsonl_instr(FILE *out, const instr_t *instr, int n_refs, uint64_t hits);
+void jsonl_instr_list(FILE *out, instr_t list[], int count, const struct xref *xrefs, const struct heat *heat);
+int jsonl_cfg(FILE *out, instr_t list[], int count, jtab_t jtabs[], int n_jtabs, const struct heat *heat);
+
+#endif
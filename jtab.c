@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "jtab.h"
+
+// Bytes before jmp * searched for table load & bounds check
+#define JTAB_WINDOW 48
+
+static int32_t read_int32(const byte_t bytes[]) {
+  int32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+/**
+ * Finds bounds check (cmp $imm, %reg; ja default) in text[from] - text[end - 1]
+ *  return => num. of table entries, -1 if not found
+ */
+static long long find_jump_table_bound(byte_t text[], size_t from, size_t end) {
+  long long bound = -1;
+
+  for (size_t i = from; i < end; i++) {
+    size_t j = i + ((text[i] & 0xF0) == 0x40 ? 1 : 0); // REX
+    long long imm;
+    size_t next;
+
+    if (j + 3 <= end && text[j] == 0x83 && (text[j + 1] & 0xF8) == 0xF8) {
+      imm = (int8_t)text[j + 2]; // cmp $imm8, reg
+      next = j + 3;
+    } else if (j + 6 <= end && text[j] == 0x81 && (text[j + 1] & 0xF8) == 0xF8) {
+      imm = read_int32(&text[j + 2]); // cmp $imm32, reg
+      next = j + 6;
+    } else if (j + 5 <= end && text[j] == OP_CMP_3D) {
+      imm = read_int32(&text[j + 1]); // cmp $imm32, eax
+      next = j + 5;
+    } else {
+      continue;
+    }
+
+    // ja rel8 / ja rel32
+    if (next < end && (text[next] == OP_JA
+                       || (text[next] == 0x0F && next + 1 < end && text[next + 1] == OP_EXT_JA)))
+      bound = imm + 1;
+  }
+
+  return bound;
+}
+
+/**
+ * Register written by instr., REX bit included
+ *  return => -1 if none, -2 if it writes registers not modelled here
+ */
+static int get_dest_register(const instr_t *instr) {
+  if (instr->has_ext_opcode)
+    return get_instr_flow(instr) == FLOW_NONE && strcmp(instr->mnemo_opcode, "nop") ? -2 : -1;
+
+  switch (instr->opcode) {
+    case OP_ADD_03:
+    case OP_MOVSXD:
+    case OP_MOV_8B:
+    case OP_LEA:
+      return instr->modrm.reg | (instr->rex.r ? 0b1000 : 0);
+    case OP_ADD_01:
+    case OP_MOV_89:
+      return instr->modrm.mod == 0b11 ? instr->modrm.rm | (instr->rex.b ? 0b1000 : 0) : -1;
+    case OP_ADD:
+    case OP_XOR:
+      return 0; // rax
+    case OP_POP_58: case OP_POP_59: case OP_POP_5A: case OP_POP_5B:
+    case OP_POP_5C: case OP_POP_5D: case OP_POP_5E: case OP_POP_5F:
+      return (instr->opcode & 0b111) | (instr->rex.b ? 0b1000 : 0);
+    case OP_8F:
+    case OP_F7:
+      return -2;
+    default:
+      return -1; // cmp, push, nop, jumps
+  }
+}
+
+/**
+ * Registers read by ModRM.rm operand, as bitmask
+ *  Base & index of memory operand, none for disp32(%rip)
+ */
+static unsigned int get_rm_registers(const instr_t *instr) {
+  if (instr->modrm.mod == 0b11 || !instr->has_sib) {
+    if (instr->modrm.mod == 0b00 && instr->modrm.rm == 0b101)
+      return 0;
+    return 1u << (instr->modrm.rm | (instr->rex.b ? 0b1000 : 0));
+  }
+
+  unsigned int regs = 0;
+  byte_t index = instr->sib.index | (instr->rex.x ? 0b1000 : 0);
+  if (index != 0b100)
+    regs |= 1u << index;
+  if (!(instr->modrm.mod == 0b00 && instr->sib.base == 0b101))
+    regs |= 1u << (instr->sib.base | (instr->rex.b ? 0b1000 : 0));
+  return regs;
+}
+
+/**
+ * Finds lea table(%rip), %reg that computes register of jmp *%reg
+ *  Walks decoded instr. back from jmp, within its bblock & window,
+ *  following registers the jump target is computed from (movslq, add, mov)
+ *  return => 0 if found, table => its rip-relative address
+ */
+static int find_table_lea(instr_t instr[], const addr_index_t *index, const instr_t *jmp, addr_t from, addr_t *table) {
+  unsigned int regs = 1u << (jmp->modrm.rm | (jmp->rex.b ? 0b1000 : 0));
+  addr_t addr = jmp->addr;
+
+  while (addr > from) {
+    int k = index_lookup(index, addr - 1);
+    if (k < 0 || instr[k].addr + instr[k].len != addr)
+      return 1; // not decoded, or overlapping
+    const instr_t *prev = &instr[k];
+    addr = prev->addr;
+
+    flow_t flow = get_instr_flow(prev);
+    if ((flow != FLOW_NONE && flow != FLOW_JCC) || !strcmp(prev->mnemo_opcode, "unknown"))
+      return 1;
+
+    int dest = get_dest_register(prev);
+    if (dest == -2)
+      return 1;
+    if (dest < 0 || !(regs & (1u << dest)))
+      continue;
+
+    switch (prev->opcode) {
+      case OP_LEA:
+        if (!is_instr_rip_relative(prev))
+          return 1;
+        *table = get_instr_dest(prev);
+        return 0;
+      case OP_MOVSXD:
+      case OP_MOV_8B: // reg = [rm]
+        regs = (regs & ~(1u << dest)) | get_rm_registers(prev);
+        break;
+      case OP_MOV_89: // rm = reg
+        regs = (regs & ~(1u << dest)) | 1u << (prev->modrm.reg | (prev->rex.r ? 0b1000 : 0));
+        break;
+      case OP_ADD_01:
+      case OP_ADD_03: // dest += src
+        regs |= get_rm_registers(prev) | 1u << (prev->modrm.reg | (prev->rex.r ? 0b1000 : 0));
+        break;
+      default:
+        return 1;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * Checks that target starts an instr., i.e. isn't within decoded one
+ *  and decodes to a known opcode
+ */
+static bool is_code_boundary(instr_t instr[], const addr_index_t *index, byte_t text[], addr_t vaddr, size_t len, addr_t target) {
+  if (target < vaddr || target - vaddr >= len)
+    return false;
+
+  int k = index_lookup(index, target);
+  if (k >= 0)
+    return instr[k].addr == target;
+
+  // Last instr. are decoded from zero-padded copy, so none reads past len
+  byte_t tail[2 * MAX_INSTR_LEN] = { 0 };
+  size_t pos = target - vaddr;
+  instr_t probe;
+  size_t n;
+  if (len - pos >= MAX_INSTR_LEN) {
+    n = decode_instr(&probe, text, vaddr, pos, target);
+  } else {
+    memcpy(tail, &text[pos], len - pos);
+    n = decode_instr(&probe, tail, target, 0, target);
+  }
+  return n > 0 && n <= len - pos && strcmp(probe.mnemo_opcode, "unknown");
+}
+
+/**
+ * Recovers targets of switch jump table used by jmp * instr.
+ *  text[] = .text of len bytes, mapped at vaddr
+ *  instr[] = decoded so far, index covers it, jmp is one of them
+ *  Recognized patterns:
+ *   jmp *table(,%reg,8)                          => absolute 64b entries
+ *   lea table(%rip), %rX; ...; jmp *%reg         => 32b entries rel. to table
+ *  lea has to be decoded in bblock of jmp and compute its register
+ *  Table size is taken from cmp $imm, %reg; ja default, if found,
+ *  otherwise table ends at first entry that isn't an instr. boundary in .text
+ *  return => 0 if table was found
+ */
+int find_jump_table(byte_t *bin, section_t sections[], int n_sections, byte_t text[], uintptr_t vaddr, size_t len,
+                    instr_t instr[], const addr_index_t *index, instr_t *jmp, jtab_t *jtab) {
+  size_t end = jmp->addr - vaddr;
+  size_t from = end > JTAB_WINDOW ? end - JTAB_WINDOW : 0;
+  addr_t table = 0;
+  int entry_size = 0;
+
+  if (jmp->has_sib && jmp->modrm.mod == 0b00 && jmp->sib.base == 0b101 && jmp->sib.scale == 3) {
+    table = (uintptr_t)jmp->value;
+    entry_size = 8;
+  } else if (jmp->modrm.mod == 0b11) {
+    if (find_table_lea(instr, index, jmp, vaddr + from, &table))
+      return 1;
+    entry_size = 4;
+  }
+
+  if (table == 0)
+    return 1;
+
+  size_t avail;
+  byte_t *data = get_elf_bytes(bin, sections, n_sections, table, &avail);
+  if (data == NULL)
+    return 1;
+
+  long long bound = find_jump_table_bound(text, from, end);
+  bool bounded = bound > 0 && bound <= JTAB_MAX_TARGETS;
+  int max = bounded ? bound : JTAB_MAX_TARGETS;
+
+  jtab->targets = (uintptr_t *)malloc(max * sizeof(uintptr_t));
+  if (jtab->targets == NULL)
+    return 1;
+
+  jtab->addr = jmp->addr;
+  jtab->table = table;
+  jtab->bounded = bounded;
+  jtab->n_targets = 0;
+  for (int i = 0; i < max && (size_t)(i + 1) * entry_size <= avail; i++) {
+    uintptr_t target;
+    if (entry_size == 8)
+      memcpy(&target, &data[i * 8], sizeof(target));
+    else
+      target = table + read_int32(&data[i * 4]);
+
+    if (target < vaddr || target >= vaddr + len)
+      break; // end of table
+    if (!bounded && !is_code_boundary(instr, index, text, vaddr, len, target))
+      break; // rodata past table, decode_jump_tables() checks again as cases get decoded
+    jtab->targets[jtab->n_targets++] = target;
+  }
+
+  if (jtab->n_targets == 0) {
+    free(jtab->targets);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Resolves jump tables of all jmp * in instr[], decodes their targets
+ *  Newly decoded jmp * are resolved too (worklist)
+ *  Entries of unbounded table are decoded in order, up to first one
+ *  that isn't an instr. boundary of code decoded so far
+ *  Case blocks are labeled, the jmp * gets note with table addr
+ *  jtabs => malloc'd array, free with free_jump_tables()
+ *  return => total num. of decoded instr. in instr[] array
+ */
+int decode_jump_tables(instr_t instr[], int count, byte_t *bin, section_t sections[], int n_sections, byte_t text[], uintptr_t vaddr, size_t len, decode_mode_t mode, addr_index_t *index, jtab_t **jtabs, int *n_jtabs) {
+  int cap = 16;
+
+  *n_jtabs = 0;
+  *jtabs = (jtab_t *)malloc(cap * sizeof(jtab_t));
+  if (*jtabs == NULL) {
+    printf("Could not allocate memory for jump tables!\n");
+    return count;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (get_instr_flow(&instr[i]) != FLOW_IJMP)
+      continue;
+
+    jtab_t jtab;
+    if (find_jump_table(bin, sections, n_sections, text, vaddr, len, instr, index, &instr[i], &jtab))
+      continue;
+
+    if (*n_jtabs == cap) {
+      jtab_t *tmp = (jtab_t *)realloc(*jtabs, 2 * cap * sizeof(jtab_t));
+      if (tmp == NULL) {
+        free(jtab.targets);
+        break;
+      }
+      *jtabs = tmp;
+      cap *= 2;
+    }
+
+    for (int j = 0; j < jtab.n_targets; j++) {
+      // Unbounded table ends at entry within code of earlier cases
+      if (!jtab.bounded && !is_code_boundary(instr, index, text, vaddr, len, jtab.targets[j])) {
+        jtab.n_targets = j;
+        break;
+      }
+      count = decode(instr, count, text, vaddr, len, jtab.targets[j], mode, instr[i].sub_addr, index);
+
+      // Label case block, if it hasn't got one yet
+      int k = index_lookup(index, jtab.targets[j]);
+      if (k >= 0 && instr[k].addr == jtab.targets[j] && !has_label(&instr[k]))
+        set_label(&instr[k], NULL, instr[k].sub_addr);
+    }
+    (*jtabs)[(*n_jtabs)++] = jtab;
+
+    snprintf(instr[i].mnemo_notes, MNEMO_NOTES_LEN, "jump table 0x%lx, %d targets",
+             jtab.table, jtab.n_targets);
+  }
+
+  return count;
+}
+
+void free_jump_tables(jtab_t jtabs[], int n_jtabs) {
+  for (int i = 0; i < n_jtabs; i++)
+    free(jtabs[i].targets);
+  free(jtabs);
+}
@@ -0,0 +1,22 @@
+#ifndef JTAB_H
+#define JTAB_H
+
+#include "decode.h"
+#include "elf.h"
+
+#define JTAB_MAX_TARGETS 1024
+
+typedef struct {
+  addr_t addr; // jmp * instr.
+  uintptr_t table;
+  bool bounded; // size from cmp/ja, else table ends at first entry within code
+  int n_targets;
+  uintptr_t *targets;
+} jtab_t;
+
+int find_jump_table(byte_t *bin, section_t sections[], int n_sections, byte_t text[], uintptr_t vaddr, size_t len,
+                    instr_t instr[], const addr_index_t *index, instr_t *jmp, jtab_t *jtab);
+int decode_jump_tables(instr_t instr[], int count, byte_t *bin, section_t sections[], int n_sections, byte_t text[], uintptr_t vaddr, size_t len, decode_mode_t mode, addr_index_t *index, jtab_t **jtabs, int *n_jtabs);
+void free_jump_tables(jtab_t jtabs[], int n_jtabs);
+
+#endif
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "loop.h"
+#include "heat.h"
+
+/**
+ * Adjacency lists of n nodes in one array each, edges of node v
+ *  are adj[off[v]] .. adj[off[v + 1] - 1]
+ */
+typedef struct {
+  int *off;
+  int *adj;
+} csr_t;
+
+static int csr_build(csr_t *csr, int n, const int from[], const int to[], int n_edges) {
+  csr->off = (int *)calloc(n + 1, sizeof(int));
+  csr->adj = (int *)malloc((n_edges > 0 ? n_edges : 1) * sizeof(int));
+  if (csr->off == NULL || csr->adj == NULL)
+    return 1;
+
+  for (int e = 0; e < n_edges; e++)
+    csr->off[from[e] + 1]++;
+  for (int v = 0; v < n; v++)
+    csr->off[v + 1] += csr->off[v];
+  for (int e = n_edges - 1; e >= 0; e--) // off[v + 1] ends up at start of v
+    csr->adj[--csr->off[from[e] + 1]] = to[e];
+  memmove(csr->off, csr->off + 1, n * sizeof(int));
+  csr->off[n] = n_edges;
+  return 0;
+}
+
+static void csr_free(csr_t *csr) {
+  free(csr->off);
+  free(csr->adj);
+}
+
+/**
+ * Cooper, Harvey & Kennedy, walk both up the dom. tree until they meet
+ */
+static int intersect(const int idom[], const int po[], int a, int b) {
+  while (a != b) {
+    while (po[a] < po[b])
+      a = idom[a];
+    while (po[b] < po[a])
+      b = idom[b];
+  }
+  return a;
+}
+
+/**
+ * Dom. tree numbered by DFS, h dominates b <=> b is within h's interval
+ */
+static inline bool dominates(const int tin[], const int tout[], int h, int b) {
+  return tin[h] >= 0 && tin[b] >= 0 && tin[h] <= tin[b] && tout[b] <= tout[h];
+}
+
+/**
+ * Bblocks start at labels, edges are jumps, fallthroughs & jump table
+ *  cases within list, calls are not followed, but their targets become
+ *  entries along with bblocks nothing jumps to
+ *  Dominators are solved iteratively in reverse postorder (Cooper, Harvey
+ *  & Kennedy), which converges in a couple of passes on real code
+ *  jtabs => may be NULL
+ *  loops => free with free_loops()
+ *  return => 0 on success
+ */
+int find_loops(instr_t list[], int count, jtab_t jtabs[], int n_jtabs, loops_t *loops) {
+  memset(loops, 0, sizeof(loops_t));
+
+  int *block_of = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+  int *start = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+  if (block_of == NULL || start == NULL)
+    goto ERR_ALLOC;
+
+  // Bblocks
+  int n = 0;
+  for (int i = 0; i < count; i++) {
+    if (i == 0 || has_label(&list[i]))
+      start[n++] = i;
+    block_of[i] = n - 1;
+  }
+
+  // Edges & entries, at most 2 per instr. + cases
+  int max_edges = 2 * count;
+  for (int i = 0; i < n_jtabs; i++)
+    max_edges += jtabs[i].n_targets;
+  int *from = (int *)malloc((max_edges > 0 ? max_edges : 1) * sizeof(int));
+  int *to = (int *)malloc((max_edges > 0 ? max_edges : 1) * sizeof(int));
+  bool *is_entry = (bool *)calloc(n + 1, sizeof(bool));
+  if (from == NULL || to == NULL || is_entry == NULL)
+    goto ERR_ALLOC_EDGES;
+
+  int n_edges = 0;
+  for (int i = 0; i < count; i++) {
+    flow_t flow = get_instr_flow(&list[i]);
+    if ((flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL)
+        && (list[i].flags & INSTR_CF_LABEL)) {
+      int t = find_instr(list, count, get_instr_dest(&list[i]));
+      if (t >= 0 && start[block_of[t]] == t) {
+        if (flow == FLOW_CALL) {
+          is_entry[block_of[t]] = true;
+        }
+        else {
+          from[n_edges] = block_of[i];
+          to[n_edges++] = block_of[t];
+        }
+      }
+    }
+
+    if (i < count - 1
+        && has_label(&list[i + 1])
+        && flow != FLOW_JMP
+        && flow != FLOW_IJMP
+        && flow != FLOW_RET) {
+      from[n_edges] = block_of[i];
+      to[n_edges++] = block_of[i + 1];
+    }
+  }
+  for (int i = 0; i < n_jtabs; i++) {
+    int j = find_instr(list, count, jtabs[i].addr);
+    if (j < 0)
+      continue;
+    for (int k = 0; k < jtabs[i].n_targets; k++) {
+      int t = find_instr(list, count, jtabs[i].targets[k]);
+      if (t >= 0 && start[block_of[t]] == t) {
+        from[n_edges] = block_of[j];
+        to[n_edges++] = block_of[t];
+      }
+    }
+  }
+
+  csr_t succ = { NULL, NULL }, pred = { NULL, NULL };
+  if (csr_build(&succ, n, from, to, n_edges) || csr_build(&pred, n, to, from, n_edges))
+    goto ERR_ALLOC_GRAPH;
+
+  // Virtual root v = n above all entries
+  int v = n;
+  if (n > 0)
+    is_entry[0] = true;
+  for (int b = 0; b < n; b++)
+    if (pred.off[b + 1] == pred.off[b])
+      is_entry[b] = true;
+
+  // Postorder by iterative DFS, root's edges are the entries
+  int *po = (int *)malloc((n + 1) * sizeof(int));
+  int *rpo = (int *)malloc((n + 1) * sizeof(int));
+  int *stack = (int *)malloc((n + 1) * sizeof(int));
+  int *next = (int *)calloc(n + 1, sizeof(int));
+  int *idom = (int *)malloc((n + 1) * sizeof(int));
+  if (po == NULL || rpo == NULL || stack == NULL || next == NULL || idom == NULL)
+    goto ERR_ALLOC_DOM;
+
+  for (int b = 0; b <= n; b++)
+    po[b] = -1;
+  int n_po = 0, sp = 0;
+  stack[sp++] = v;
+  next[v] = 0;
+  po[v] = -2; // on stack
+  while (sp > 0) {
+    int x = stack[sp - 1];
+    int y = -1;
+    if (x == v) {
+      while (next[v] < n && y < 0) {
+        int b = next[v]++;
+        if (is_entry[b] && po[b] == -1)
+          y = b;
+      }
+    }
+    else {
+      while (succ.off[x] + next[x] < succ.off[x + 1] && y < 0) {
+        int b = succ.adj[succ.off[x] + next[x]++];
+        if (po[b] == -1)
+          y = b;
+      }
+    }
+
+    if (y >= 0) {
+      po[y] = -2;
+      stack[sp++] = y;
+    }
+    else {
+      po[x] = n_po;
+      rpo[n - n_po] = x; // filled from the back
+      n_po++;
+      sp--;
+    }
+  }
+  int *order = rpo + (n + 1 - n_po); // reverse postorder, order[0] = v
+
+  // Dominators
+  for (int b = 0; b <= n; b++)
+    idom[b] = -1;
+  idom[v] = v;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int k = 1; k < n_po; k++) {
+      int b = order[k];
+      int new_idom = is_entry[b] ? v : -1;
+      for (int e = pred.off[b]; e < pred.off[b + 1]; e++) {
+        int p = pred.adj[e];
+        if (idom[p] < 0)
+          continue;
+        new_idom = new_idom < 0 ? p : intersect(idom, po, p, new_idom);
+      }
+      if (idom[b] != new_idom) {
+        idom[b] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  // Dom. tree pre/post numbering
+  int *tin = po; // done with postorder
+  int *tout = next;
+  int n_children = 0;
+  for (int k = 1; k < n_po; k++) {
+    from[n_children] = idom[order[k]];
+    to[n_children++] = order[k];
+  }
+  csr_t dom = { NULL, NULL };
+  if (csr_build(&dom, n + 1, from, to, n_children))
+    goto ERR_ALLOC_TREE;
+
+  for (int b = 0; b <= n; b++)
+    tin[b] = tout[b] = -1;
+  int *edge = rpo; // next child of stack[i] is dom.adj[edge[i]]
+  int clock = 0;
+  sp = 0;
+  stack[sp] = v;
+  edge[sp++] = dom.off[v];
+  tin[v] = clock++;
+  while (sp > 0) {
+    int x = stack[sp - 1];
+    if (edge[sp - 1] < dom.off[x + 1]) {
+      int y = dom.adj[edge[sp - 1]++];
+      tin[y] = clock++;
+      stack[sp] = y;
+      edge[sp++] = dom.off[y];
+    }
+    else {
+      tout[x] = clock++;
+      sp--;
+    }
+  }
+
+  // Natural loops, walk back from latches to header
+  int *depth = (int *)calloc(n > 0 ? n : 1, sizeof(int));
+  int *mark = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+  loop_t *found = NULL;
+  int *bodies = NULL;
+  int n_loops = 0, n_bodies = 0, max_bodies = 0, max_loops = 0;
+  if (depth == NULL || mark == NULL)
+    goto ERR_ALLOC_LOOPS;
+  for (int b = 0; b < n; b++)
+    mark[b] = -1;
+
+  for (int h = 0; h < n; h++) {
+    // Header first, not walked past, then latches
+    mark[h] = h;
+    stack[0] = h;
+    int n_walk = 1;
+    for (int e = pred.off[h]; e < pred.off[h + 1]; e++) {
+      int u = pred.adj[e];
+      if (mark[u] != h && dominates(tin, tout, h, u)) {
+        mark[u] = h;
+        stack[n_walk++] = u;
+      }
+    }
+    bool self = false;
+    for (int e = succ.off[h]; e < succ.off[h + 1]; e++)
+      self |= succ.adj[e] == h;
+    if (n_walk == 1 && !self)
+      continue;
+
+    if (n_loops == max_loops) {
+      max_loops = max_loops > 0 ? max_loops * 2 : 64;
+      loop_t *tmp = (loop_t *)realloc(found, max_loops * sizeof(loop_t));
+      if (tmp == NULL)
+        goto ERR_ALLOC_LOOPS;
+      found = tmp;
+    }
+    loop_t *loop = &found[n_loops++];
+    loop->header = h;
+    loop->n_body = 0;
+    loop->body = NULL; // set once bodies stop moving
+
+    for (int w = 0; w < n_walk; w++) {
+      int x = stack[w];
+      if (n_bodies == max_bodies) {
+        max_bodies = max_bodies > 0 ? max_bodies * 2 : 1024;
+        int *tmp = (int *)realloc(bodies, max_bodies * sizeof(int));
+        if (tmp == NULL)
+          goto ERR_ALLOC_LOOPS;
+        bodies = tmp;
+      }
+      bodies[n_bodies++] = x;
+      loop->n_body++;
+      depth[x]++;
+
+      if (x == h)
+        continue;
+      for (int e = pred.off[x]; e < pred.off[x + 1]; e++) {
+        int p = pred.adj[e];
+        if (mark[p] != h && dominates(tin, tout, h, p)) { // irreducible entries stay out
+          mark[p] = h;
+          stack[n_walk++] = p;
+        }
+      }
+    }
+  }
+
+  for (int l = 0, off = 0; l < n_loops; off += found[l++].n_body) {
+    found[l].body = bodies + off;
+    found[l].depth = depth[found[l].header];
+  }
+  for (int b = 0; b < n; b++)
+    idom[b] = idom[b] == v ? -1 : idom[b];
+
+  loops->n_blocks = n;
+  loops->start = start;
+  loops->idom = idom;
+  loops->depth = depth;
+  loops->n_loops = n_loops;
+  loops->loops = found;
+  loops->bodies = bodies;
+
+  free(mark);
+  csr_free(&dom);
+  free(po);
+  free(rpo);
+  free(stack);
+  free(next);
+  csr_free(&succ);
+  csr_free(&pred);
+  free(from);
+  free(to);
+  free(is_entry);
+  free(block_of);
+  return 0;
+
+ERR_ALLOC_LOOPS:
+  free(depth);
+  free(mark);
+  free(found);
+  free(bodies);
+ERR_ALLOC_TREE:
+  csr_free(&dom);
+ERR_ALLOC_DOM:
+  free(po);
+  free(rpo);
+  free(stack);
+  free(next);
+  free(idom);
+ERR_ALLOC_GRAPH:
+  csr_free(&succ);
+  csr_free(&pred);
+ERR_ALLOC_EDGES:
+  free(from);
+  free(to);
+  free(is_entry);
+ERR_ALLOC:
+  free(block_of);
+  free(start);
+  printf("Could not allocate memory for loops!\n");
+  return 1;
+}
+
+void free_loops(loops_t *loops) {
+  free(loops->start);
+  free(loops->idom);
+  free(loops->depth);
+  free(loops->loops);
+  free(loops->bodies);
+  memset(loops, 0, sizeof(loops_t));
+}
+
+/**
+ * Blue, darker with depth
+ */
+static const char *loop_color(int depth) {
+  static const char *colors[] = { "#6baed6", "#3182bd", "#08519c", "#08306b" };
+  return colors[depth - 1];
+}
+
+/**
+ * Lists loops as DOT comments & outlines their bblocks, goes right
+ *  after print_bblocks() of the same list
+ *  heat => sum samples per loop, NULL to omit
+ */
+void print_loops(FILE *out, instr_t list[], int count, const loops_t *loops, const struct heat *heat) {
+  for (int l = 0; l < loops->n_loops; l++) {
+    const loop_t *loop = &loops->loops[l];
+    const instr_t *header = &list[loops->start[loop->header]];
+
+    fprintf(out, "  // loop 0x%lx ", header->addr);
+    print_label(out, &header->label, header->addr);
+    fprintf(out, ": depth %d, %d bblocks", loop->depth, loop->n_body);
+    if (heat != NULL) {
+      uint64_t hits = 0;
+      for (int k = 0; k < loop->n_body; k++)
+        hits += heat_block(heat, list, count, loops->start[loop->body[k]]);
+      fprintf(out, ", %lu hits (%.1f%%)", hits, heat->total > 0 ? 100.0 * hits / heat->total : 0.0);
+    }
+    fprintf(out, "\n");
+  }
+
+  // Later attributes add to the node
+  for (int b = 0; b < loops->n_blocks; b++) {
+    const instr_t *first = &list[loops->start[b]];
+    if (loops->depth[b] == 0 || !has_label(first))
+      continue;
+
+    int depth = loops->depth[b] < 4 ? loops->depth[b] : 4;
+    fprintf(out, "  ");
+    print_label(out, &first->label, first->addr);
+    fprintf(out, " [color=\"%s\" penwidth=%d]\n", loop_color(depth), 1 + depth);
+  }
+  for (int l = 0; l < loops->n_loops; l++) {
+    const instr_t *header = &list[loops->start[loops->loops[l].header]];
+    if (!has_label(header))
+      continue;
+
+    fprintf(out, "  ");
+    print_label(out, &header->label, header->addr);
+    fprintf(out, " [peripheries=2]\n");
+  }
+}
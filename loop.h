@@ -0,0 +1,37 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <stdio.h>
+
+#include "decode.h"
+#include "jtab.h"
+
+struct heat;
+
+// Natural loop, union of all back edges into one header
+typedef struct {
+  int header; // bblock
+  int depth;  // nesting depth, 1 = outermost
+  int n_body;
+  int *body;  // bblocks incl. header, points into loops_t.bodies
+} loop_t;
+
+// Dominators & loops over the bblocks of a sorted, labelled instr. list,
+//  bblocks & edges are those drawn by print_bblocks() & print_arrows()
+typedef struct {
+  int n_blocks;
+  int *start; // first instr. of bblock
+  int *idom;  // immediate dominator bblock, -1 if none (entry, unreachable)
+  int *depth; // loop nesting depth of bblock, 0 if not in loop
+
+  int n_loops;
+  loop_t *loops; // by header addr.
+  int *bodies;
+} loops_t;
+
+int find_loops(instr_t list[], int count, jtab_t jtabs[], int n_jtabs, loops_t *loops);
+void free_loops(loops_t *loops);
+
+void print_loops(FILE *out, instr_t list[], int count, const loops_t *loops, const struct heat *heat);
+
+#endif
@@ -1,67 +1,250 @@
-#include <stdio.h>
-#include <stdbool.h>
-#include <stdlib.h>
-#include <string.h>
-
-#include "decode.h"
-#include "cfg.h"
-#include "elf.h"
-
-int main(int argc, const char *argv[]) {
-  if (argc != 2) {
-    printf("Usage: cfg.elf <filename>\n");
-    return 1;
-  }
-
-  int fd, fsize;
-  byte_t *bin;
-  if (load_file(argv[1], &fd, &bin, &fsize)) {
-    return 1;
-  }
-
-  section_t sections[MAX_SECTIONS];
-  uintptr_t entry, offset, vaddr;
-  int size, n_sections;
-  bool is_elf = false;
-
-  // Is .elf?
-  if (bin[0] == 0x7F && bin[1] == 'E' && bin[2] == 'L' && bin[3] == 'F') {
-    is_elf = true;
-    if (get_elf_sections(bin, sections, &n_sections)
-        || get_elf_info(bin, sections, n_sections, &entry, &vaddr, &offset, &size)) {
-      goto ERR_CLOSE_FILE;
-    }
-  }
-  else {
-    entry = offset = vaddr = 0;
-    size = fsize;
-  }
-
-  // Make room for decoded instr_t
-  instr_t *list = (instr_t *)malloc(size * sizeof(instr_t));
-  if (list == NULL) {
-    printf("Could not allocate memory for decoder!\n");
-    goto ERR_CLOSE_FILE;
-  }
-
-  // Decode all bblocks
-  int count = decode(list, 0, bin + offset, vaddr, size, DECODE_LINEAR, 0);
-
-  // Xrefs
-  proc_flow_labels(list, count);
-  if (is_elf)
-    proc_section_labels(list, count, sections, n_sections);
-
-  // Print graph
-  printf("digraph G {\n");
-  print_bblocks(list, count);
-  print_arrows(list, count);
-  printf("}\n");
-
-  // Unmap file & free mem
-  free(list);
-ERR_CLOSE_FILE:
-  close_file(bin, fd, fsize);
-
-  return 0;
-}
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "decode.h"
+#include "cfg.h"
+#include "elf.h"
+#include "func.h"
+#include "heat.h"
+#include "loop.h"
+#include "json.h"
+
+/**
+ * Loop records, header bblock & its nesting
+ */
+static void jsonl_loops(instr_t list[], const loops_t *loops) {
+  for (int l = 0; l < loops->n_loops; l++) {
+    const instr_t *header = &list[loops->start[loops->loops[l].header]];
+    jsonl_t rec;
+    jsonl_begin(&rec, "loop");
+    jsonl_label(&rec, "header", &header->label, header->addr);
+    jsonl_uint(&rec, "depth", loops->loops[l].depth);
+    jsonl_uint(&rec, "n_blocks", loops->loops[l].n_body);
+    jsonl_end(&rec, stdout);
+  }
+}
+
+/**
+ * Outlines loops of list, keeps the totals for summary
+ */
+static int print_list_loops(instr_t list[], int count, jtab_t jtabs[], int n_jtabs, const heat_t *heat,
+                            format_t format, int *n_loops, int *max_depth) {
+  loops_t loops;
+  if (find_loops(list, count, jtabs, n_jtabs, &loops))
+    return 1;
+
+  if (format == FORMAT_JSONL)
+    jsonl_loops(list, &loops);
+  else
+    print_loops(stdout, list, count, &loops, heat);
+  *n_loops += loops.n_loops;
+  for (int l = 0; l < loops.n_loops; l++)
+    if (loops.loops[l].depth > *max_depth)
+      *max_depth = loops.loops[l].depth;
+
+  free_loops(&loops);
+  return 0;
+}
+
+/**
+ * One cluster & CFG per function
+ *  with_loops => outline natural loops
+ */
+static void print_functions(func_t funcs[], int n_funcs, const heat_t *heat, bool with_loops, format_t format) {
+  int n_loops = 0, max_depth = 0;
+
+  if (format == FORMAT_TEXT)
+    printf("digraph G {\n");
+  for (int i = 0; i < n_funcs; i++) {
+    if (funcs[i].count == 0)
+      continue;
+    if (format == FORMAT_JSONL) {
+      jsonl_cfg(stdout, funcs[i].instr, funcs[i].count, funcs[i].jtabs, funcs[i].n_jtabs, heat);
+    }
+    else {
+      printf(" subgraph cluster_%d {\n", i);
+      print_bblocks(stdout, funcs[i].instr, funcs[i].count, heat);
+      print_arrows(stdout, funcs[i].instr, funcs[i].count);
+      print_jtab_arrows(stdout, funcs[i].instr, funcs[i].count, funcs[i].jtabs, funcs[i].n_jtabs);
+    }
+    if (with_loops)
+      print_list_loops(funcs[i].instr, funcs[i].count, funcs[i].jtabs, funcs[i].n_jtabs, heat, format,
+                       &n_loops, &max_depth);
+    if (format == FORMAT_TEXT)
+      printf(" }\n");
+  }
+  if (format == FORMAT_TEXT)
+    printf("}\n");
+
+  if (with_loops)
+    fprintf(stderr, "loops: %d, max. depth %d\n", n_loops, max_depth);
+}
+
+int main(int argc, const char *argv[]) {
+  bool functions = false;
+  bool with_loops = false;
+  const char *samples = NULL;
+  addr_t bias = 0;
+  format_t format = FORMAT_TEXT;
+  int arg = 1;
+  for (; arg < argc - 1; arg++) {
+    if (!strcmp(argv[arg], "-f"))
+      functions = true;
+    else if (!strcmp(argv[arg], "-l"))
+      with_loops = true;
+    else if (!strcmp(argv[arg], "-p") && arg < argc - 2)
+      samples = argv[++arg];
+    else if (!strcmp(argv[arg], "-b") && arg < argc - 2)
+      bias = strtoull(argv[++arg], NULL, 16);
+    else if (!strncmp(argv[arg], "--format=", 9) && !parse_format(argv[arg] + 9, &format))
+      continue;
+    else
+      break;
+  }
+  if (argc < 2 || arg != argc - 1) {
+    printf("Usage: cfg.elf [-f] [-l] [-p <samples> [-b <load addr>]] [--format=text|jsonl] <filename>\n");
+    return 1;
+  }
+
+  if (format == FORMAT_JSONL)
+    set_elf_notice_out(stderr);
+
+  int fd;
+  size_t fsize;
+  byte_t *bin;
+  if (load_file(argv[argc - 1], &fd, &bin, &fsize)) {
+    return 1;
+  }
+
+  section_t sections[MAX_SECTIONS];
+  symbol_t *symbols = NULL;
+  fde_t *fdes = NULL;
+  uintptr_t entry, offset, vaddr;
+  size_t size;
+  int n_sections, n_symbols = 0, n_fdes = 0;
+  bool is_elf = false;
+  heat_t heat = { .hits = NULL };
+  plt_index_t plt = { .slot = NULL };
+  reloc_index_t relocs = { NULL, 0 };
+
+  // Is .elf?
+  if (is_elf_file(bin, fsize)) {
+    is_elf = true;
+    if (get_elf_sections(bin, fsize, sections, &n_sections)
+        || get_elf_info(bin, sections, n_sections, &entry, &vaddr, &offset, &size)
+        || get_elf_plt(bin, sections, n_sections, &plt)
+        || get_elf_relocs(bin, sections, n_sections, offset, &relocs)
+        || (functions && get_elf_symtab(bin, sections, n_sections, &symbols, &n_symbols))
+        || (functions && get_elf_fdes(bin, sections, n_sections, &fdes, &n_fdes))) {
+      goto ERR_CLOSE_FILE;
+    }
+    load_file_range(bin, fsize, offset, size, functions ? 0 : LOAD_POPULATE);
+  }
+  else {
+    entry = offset = vaddr = 0;
+    size = fsize;
+  }
+
+  // Sampled addresses, e.g. from `perf script -F ip`
+  if (samples != NULL) {
+    if (heat_load(&heat, samples, vaddr, size, bias))
+      goto ERR_CLOSE_FILE;
+    fprintf(stderr, "samples: %lu, %.1f%% within .text\n",
+            heat.total, heat.total > 0 ? 100.0 * (heat.total - heat.outside) / heat.total : 0.0);
+  }
+
+  // Discover functions, one CFG per function
+  if (functions) {
+    func_t *funcs;
+    int n_funcs;
+    if (find_functions(bin + offset, size, vaddr, entry, symbols, n_symbols, fdes, n_fdes, &relocs, &funcs, &n_funcs))
+      goto ERR_CLOSE_FILE;
+
+    if (!decode_functions(bin + offset, vaddr, funcs, n_funcs, &relocs, is_elf ? bin : NULL, sections,
+                          is_elf ? n_sections : 0, sysconf(_SC_NPROCESSORS_ONLN))) {
+      for (int i = 0; i < n_funcs; i++) {
+        proc_symtab_labels(funcs[i].instr, funcs[i].count, symbols, n_symbols);
+        proc_flow_labels(funcs[i].instr, funcs[i].count);
+        if (is_elf)
+          proc_section_labels(funcs[i].instr, funcs[i].count, sections, n_sections);
+      }
+      proc_call_labels(funcs, n_funcs);
+      for (int i = 0; i < n_funcs; i++) {
+        proc_plt_labels(funcs[i].instr, funcs[i].count, &plt);
+        proc_reloc_labels(funcs[i].instr, funcs[i].count, &relocs);
+      }
+
+      print_functions(funcs, n_funcs, samples != NULL ? &heat : NULL, with_loops, format);
+    }
+
+    free_functions(funcs, n_funcs);
+    goto ERR_CLOSE_FILE;
+  }
+
+  // Make room for decoded instr_t
+  instr_t *list = (instr_t *)malloc(size * sizeof(instr_t));
+  if (list == NULL) {
+    printf("Could not allocate memory for decoder!\n");
+    goto ERR_CLOSE_FILE;
+  }
+  addr_index_t index;
+  if (index_init(&index, vaddr, size)) {
+    free(list);
+    goto ERR_CLOSE_FILE;
+  }
+  index.relocs = &relocs;
+
+  // Decode all bblocks
+  int count = decode(list, 0, bin + offset, vaddr, size, vaddr, DECODE_LINEAR, 0, &index);
+
+  // Switch jump tables
+  jtab_t *jtabs = NULL;
+  int n_jtabs = 0;
+  if (is_elf)
+    count = decode_jump_tables(list, count, bin, sections, n_sections, bin + offset, vaddr, size,
+                               DECODE_LINEAR, &index, &jtabs, &n_jtabs);
+  index_free(&index);
+
+  // Xrefs
+  proc_flow_labels(list, count);
+  if (is_elf) {
+    proc_plt_labels(list, count, &plt);
+    proc_section_labels(list, count, sections, n_sections);
+    proc_reloc_labels(list, count, &relocs);
+  }
+
+  // Print graph
+  if (format == FORMAT_JSONL) {
+    jsonl_cfg(stdout, list, count, jtabs, n_jtabs, samples != NULL ? &heat : NULL);
+  }
+  else {
+    printf("digraph G {\n");
+    print_bblocks(stdout, list, count, samples != NULL ? &heat : NULL);
+    print_arrows(stdout, list, count);
+    print_jtab_arrows(stdout, list, count, jtabs, n_jtabs);
+  }
+  if (with_loops) {
+    int n_loops = 0, max_depth = 0;
+    if (!print_list_loops(list, count, jtabs, n_jtabs, samples != NULL ? &heat : NULL, format,
+                          &n_loops, &max_depth))
+      fprintf(stderr, "loops: %d, max. depth %d\n", n_loops, max_depth);
+  }
+  if (format == FORMAT_TEXT)
+    printf("}\n");
+
+  // Unmap file & free mem
+  free_jump_tables(jtabs, n_jtabs);
+  free(list);
+ERR_CLOSE_FILE:
+  heat_free(&heat);
+  plt_index_free(&plt);
+  reloc_index_free(&relocs);
+  free(symbols);
+  free(fdes);
+  close_file(bin, fd, fsize);
+
+  return 0;
+}
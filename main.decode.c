@@ -25,27 +25,29 @@ int main(int argc, const char *argv[]) {
   }
 
   // Decode all bblocks
-  int count = decode(list, 0, bytes, 0, size, DECODE_LINEAR, 0);
+  int count = decode(list, 0, bytes, 0, size, 0, DECODE_LINEAR, 0, NULL);
 
   // Xrefs
   proc_flow_labels(list, count);
 
   // Print
   for (int i = 0; i < count; i++) {
-    if (list[i].label[0] != '\0')
-      printf("%s:\n", list[i].label);
+    if (has_label(&list[i])) {
+      print_label(stdout, &list[i].label, list[i].addr);
+      printf(":\n");
+    }
 
-    char addr_buf[16];
-    snprintf(addr_buf, 16, "0x%x", list[i].addr);
+    char addr_buf[24];
+    snprintf(addr_buf, sizeof(addr_buf), "0x%lx", list[i].addr);
 
-    printf("   %s:%*s %-20s    %-5s %-20s %s%s\n",
+    printf("   %s:%*s %-20s    %-5s %-20s ",
             addr_buf,
-            (int)(7 - strlen(addr_buf)), "", // padding
+            (int)(strlen(addr_buf) < 7 ? 7 - strlen(addr_buf) : 0), "", // padding
             list[i].hex_bytes,
             list[i].mnemo_opcode,
-            list[i].mnemo_operand,
-            list[i].mnemo_notes[0] != '\0' ? "# " : "",
-            list[i].mnemo_notes);
+            list[i].mnemo_operand);
+    print_instr_note(stdout, &list[i]);
+    printf("\n");
   }
 
   return 0;
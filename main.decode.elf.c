@@ -1,83 +1,389 @@
-#include <stdio.h>
-#include <stdbool.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/mman.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <elf.h>
-
-#include "elf.h"
-#include "decode.h"
-
-int main(int argc, const char *argv[]) {
-  if (argc != 2) {
-    printf("Usage: decode.elf <filename>\n");
-    return 1;
-  }
-
-  int fd, fsize;
-  byte_t *bin;
-  if (load_file(argv[1], &fd, &bin, &fsize)) {
-    return 1;
-  }
-
-  section_t sections[MAX_SECTIONS];
-  uintptr_t entry, offset, vaddr;
-  int size, n_sections;
-  bool is_elf = false;
-
-  // Is .elf?
-  if (bin[0] == 0x7F && bin[1] == 'E' && bin[2] == 'L' && bin[3] == 'F') {
-    is_elf = true;
-    if (get_elf_sections(bin, sections, &n_sections)
-        || get_elf_info(bin, sections, n_sections, &entry, &vaddr, &offset, &size)) {
-      goto ERR_CLOSE_FILE;
-    }
-  }
-  else {
-    entry = offset = vaddr = 0;
-    size = fsize;
-  }
-
-  // Make room for decoded instr_t
-  instr_t *list = (instr_t *)malloc(size * sizeof(instr_t));
-  if (list == NULL) {
-    printf("Could not allocate memory for decoder!\n");
-    goto ERR_CLOSE_FILE;
-  }
-
-  // Decode all bblocks
-  int count = decode(list, 0, bin + offset, vaddr, size, DECODE_LINEAR, 0);
-
-  // Xrefs
-  proc_flow_labels(list, count);
-  if (is_elf)
-    proc_section_labels(list, count, sections, n_sections);
-
-  // Print
-  for (int i = 0; i < count; i++) {
-    if (list[i].label[0] != '\0')
-    printf("%s:\n", list[i].label);
-
-    char addr_buf[16];
-    snprintf(addr_buf, 16, "0x%x", list[i].addr);
-
-    printf("   %s:%*s %-20s    %-5s %-20s %s%s\n",
-            addr_buf,
-            (int)(7 - strlen(addr_buf)), "", // padding
-            list[i].hex_bytes,
-            list[i].mnemo_opcode,
-            list[i].mnemo_operand,
-            list[i].mnemo_notes[0] != '\0' ? "# " : "",
-            list[i].mnemo_notes);
-  }
-
-  // Unmap file & free mem
-  free(list);
-ERR_CLOSE_FILE:
-  close_file(bin, fd, fsize);
-
-  return 0;
-}
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <elf.h>
+
+#include "elf.h"
+#include "decode.h"
+#include "stream.h"
+#include "patch.h"
+#include "json.h"
+
+/**
+ * Length-only linear sweep, prints instr. counts
+ */
+static void print_counts(byte_t bytes[], size_t size, format_t format) {
+  size_t pos = 0, n_instr = 0, n_flow[FLOW_IJMP + 1] = { 0 };
+
+  while (pos < size) {
+    flow_t flow;
+    long long rel;
+    int len = decode_length(&bytes[pos], size - pos, &flow, &rel);
+    if (len == 0)
+      break; // truncated
+
+    pos += len;
+    n_instr++;
+    n_flow[flow]++;
+  }
+
+  if (format == FORMAT_JSONL) {
+    jsonl_t rec;
+    jsonl_begin(&rec, "counts");
+    jsonl_uint(&rec, "bytes", pos);
+    jsonl_uint(&rec, "instr", n_instr);
+    jsonl_uint(&rec, "jcc", n_flow[FLOW_JCC]);
+    jsonl_uint(&rec, "jmp", n_flow[FLOW_JMP]);
+    jsonl_uint(&rec, "ijmp", n_flow[FLOW_IJMP]);
+    jsonl_uint(&rec, "call", n_flow[FLOW_CALL]);
+    jsonl_uint(&rec, "ret", n_flow[FLOW_RET]);
+    jsonl_end(&rec, stdout);
+    return;
+  }
+
+  printf("%zu bytes, %zu instructions\n", pos, n_instr);
+  printf("  jcc:  %zu\n  jmp:  %zu\n  jmp*: %zu\n  call: %zu\n  ret:  %zu\n",
+          n_flow[FLOW_JCC], n_flow[FLOW_JMP], n_flow[FLOW_IJMP], n_flow[FLOW_CALL], n_flow[FLOW_RET]);
+}
+
+static void free_sweeps(sweep_t sweeps[], int n_sweeps) {
+  if (sweeps == NULL)
+    return;
+  for (int i = 0; i < n_sweeps; i++)
+    sweep_free(&sweeps[i]);
+  free(sweeps);
+}
+
+/**
+ * Sweeps each code region
+ *  sweeps => malloc'd, one per region, free with free_sweeps()
+ *  return => 0 on success
+ */
+static int sweep_regions(region_t regions[], int n_regions, section_t sections[], int n_sections, sweep_t **sweeps) {
+  *sweeps = (sweep_t *)calloc(n_regions, sizeof(sweep_t));
+  if (*sweeps == NULL) {
+    printf("Could not allocate memory for sweeps!\n");
+    return 1;
+  }
+
+  for (int i = 0; i < n_regions; i++) {
+    if (sweep_decode(&(*sweeps)[i], regions[i].name, regions[i].bytes, regions[i].vaddr, regions[i].len,
+                     sections, n_sections)) {
+      free_sweeps(*sweeps, n_regions);
+      *sweeps = NULL;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Sweeps code of old build, sweeps keep copy of its bytes so it's unmapped after
+ *  return => 0 on success
+ */
+static int sweep_old_file(const char *path, bool is_elf, sweep_t **sweeps, int *n_sweeps) {
+  int fd;
+  size_t fsize;
+  byte_t *bin;
+  if (load_file(path, &fd, &bin, &fsize))
+    return 1;
+
+  section_t sections[MAX_SECTIONS];
+  region_t regions[MAX_SECTIONS];
+  int n_sections = 0, n_regions;
+  int err = 1;
+  if (is_elf_file(bin, fsize) != is_elf) {
+    printf("Could not compare ELF with raw file: %s\n", path);
+    goto ERR_CLOSE_FILE;
+  }
+  if ((is_elf && get_elf_sections(bin, fsize, sections, &n_sections))
+      || get_code_regions(bin, fsize, is_elf ? sections : NULL, n_sections, regions, &n_regions)
+      || sweep_regions(regions, n_regions, is_elf ? sections : NULL, n_sections, sweeps))
+    goto ERR_CLOSE_FILE;
+
+  *n_sweeps = n_regions;
+  for (int i = 0; i < n_regions; i++) {
+    sweep_t *sweep = &(*sweeps)[i];
+    sweep->sections = NULL;
+    sweep->data = (byte_t *)malloc(sweep->len > 0 ? sweep->len : 1);
+    if (sweep->data == NULL) {
+      printf("Could not allocate memory for sweeps!\n");
+      free_sweeps(*sweeps, n_regions);
+      *sweeps = NULL;
+      goto ERR_CLOSE_FILE;
+    }
+    memcpy(sweep->data, sweep->bytes, sweep->len);
+    sweep->bytes = sweep->data;
+  }
+  err = 0;
+
+ERR_CLOSE_FILE:
+  close_file(bin, fd, fsize);
+  return err;
+}
+
+/**
+ * Loads sweeps saved by --sweep-out= instead of decoding old build
+ *  return => 0 on success
+ */
+static int load_sweeps(const char *path, sweep_t **sweeps, int *n_sweeps) {
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) {
+    printf("Could not open sweep cache: %s\n", path);
+    return 1;
+  }
+  int err = sweep_read(sweeps, n_sweeps, in);
+  fclose(in);
+  return err;
+}
+
+static int save_sweeps(const sweep_t sweeps[], int n_sweeps, const char *path) {
+  FILE *out = fopen(path, "wb");
+  if (out == NULL) {
+    printf("Could not create sweep cache: %s\n", path);
+    return 1;
+  }
+  int err = sweep_write(sweeps, n_sweeps, out);
+  if (fclose(out) != 0 && !err) {
+    printf("Could not write sweep cache!\n");
+    err = 1;
+  }
+  return err;
+}
+
+static void print_hunks(const sweep_t *sweep, hunk_t hunks[], int n_hunks, format_t format) {
+  for (int i = 0; i < n_hunks; i++) {
+    if (format == FORMAT_JSONL) {
+      jsonl_t rec;
+      jsonl_begin(&rec, "hunk");
+      jsonl_str(&rec, "section", sweep->name);
+      jsonl_addr(&rec, "from", hunks[i].from);
+      jsonl_addr(&rec, "to", hunks[i].to);
+      jsonl_uint(&rec, "removed", hunks[i].removed);
+      jsonl_uint(&rec, "added", hunks[i].added);
+      jsonl_end(&rec, stdout);
+      jsonl_instr_list(stdout, &sweep->list[hunks[i].first], hunks[i].added, NULL, NULL);
+    }
+    else {
+      printf("@@ 0x%lx - 0x%lx: -%d +%d @@\n", hunks[i].from, hunks[i].to, hunks[i].removed, hunks[i].added);
+      print_instr_list(stdout, &sweep->list[hunks[i].first], hunks[i].added, NULL, NULL);
+    }
+  }
+}
+
+/**
+ * Brings sweeps of old build up to date with code regions of new one
+ *  Regions pair with old sweeps by section name, one that moved is rebased,
+ *  then only bytes that differ are re-decoded, sections that came or went
+ *  are one hunk each
+ *  Prints re-decoded runs as they read in new listing
+ *  old => matched sweeps are moved to sweeps, rest is left to caller
+ *  sweeps => malloc'd, one per region, free with free_sweeps()
+ *  return => 0 on success
+ */
+static int print_patched(sweep_t old[], int n_old, region_t regions[], int n_regions,
+                         section_t sections[], int n_sections, format_t format, sweep_t **sweeps) {
+  *sweeps = (sweep_t *)calloc(n_regions, sizeof(sweep_t));
+  bool *matched = (bool *)calloc(n_old > 0 ? n_old : 1, sizeof(bool));
+  if (*sweeps == NULL || matched == NULL) {
+    printf("Could not allocate memory for sweeps!\n");
+    free(*sweeps);
+    *sweeps = NULL;
+    free(matched);
+    return 1;
+  }
+
+  int n_patches = 0, redecoded = 0, count = 0, before = 0;
+  size_t changed = 0;
+  for (int o = 0; o < n_old; o++)
+    before += old[o].count;
+
+  int err = 0;
+  for (int r = 0; r < n_regions && !err; r++) {
+    sweep_t *sweep = &(*sweeps)[r];
+    hunk_t whole, *hunks = &whole;
+    int n_hunks = 1;
+
+    int o = 0;
+    while (o < n_old && (matched[o] || strncmp(old[o].name, regions[r].name, SWEEP_NAME_LEN - 1)))
+      o++;
+
+    if (o == n_old) {
+      // New section, re-decoded whole
+      if (sweep_decode(sweep, regions[r].name, regions[r].bytes, regions[r].vaddr, regions[r].len,
+                       sections, n_sections)) {
+        err = 1;
+        break;
+      }
+      whole = (hunk_t){ sweep->vaddr, sweep->vaddr + sweep->len, 0, 0, sweep->count };
+      n_patches++;
+      changed += sweep->len;
+      fprintf(stderr, "%s: new section\n", sweep->name);
+    }
+    else {
+      matched[o] = true;
+      *sweep = old[o];
+      memset(&old[o], 0, sizeof(sweep_t));
+      sweep->sections = sections;
+      sweep->n_sections = n_sections;
+      if (sweep->vaddr != regions[r].vaddr) {
+        fprintf(stderr, "%s: moved 0x%lx => 0x%lx\n", sweep->name, sweep->vaddr, regions[r].vaddr);
+        sweep_move(sweep, regions[r].vaddr);
+      }
+
+      patch_t *patches;
+      int n;
+      if (find_patches(sweep->bytes, sweep->len, regions[r].bytes, regions[r].len, &patches, &n)) {
+        err = 1;
+        break;
+      }
+      err = sweep_patch(sweep, regions[r].bytes, regions[r].len, patches, n, &hunks, &n_hunks);
+      n_patches += n;
+      for (int i = 0; i < n; i++)
+        changed += patches[i].to - patches[i].from;
+      free(patches);
+      if (err)
+        break;
+    }
+
+    print_hunks(sweep, hunks, n_hunks, format);
+    for (int i = 0; i < n_hunks; i++)
+      redecoded += hunks[i].added;
+    count += sweep->count;
+    if (hunks != &whole)
+      free(hunks);
+  }
+
+  // Sections that are gone
+  for (int o = 0; o < n_old && !err; o++) {
+    if (matched[o])
+      continue;
+    hunk_t whole = { old[o].vaddr, old[o].vaddr + old[o].len, 0, old[o].count, 0 };
+    print_hunks(&old[o], &whole, 1, format);
+    n_patches++;
+    changed += old[o].len;
+    fprintf(stderr, "%s: removed section\n", old[o].name);
+  }
+
+  free(matched);
+  if (err) {
+    free_sweeps(*sweeps, n_regions);
+    *sweeps = NULL;
+    return 1;
+  }
+  fprintf(stderr, "patches: %d, %zu bytes changed, %d of %d instructions re-decoded (was %d)\n",
+          n_patches, changed, redecoded, count, before);
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  bool count_only = false;
+  const char *old_path = NULL, *sweep_in = NULL, *sweep_out = NULL;
+  format_t format = FORMAT_TEXT;
+  int arg = 1;
+  for (; arg < argc - 1; arg++) {
+    if (!strcmp(argv[arg], "-n"))
+      count_only = true;
+    else if (!strcmp(argv[arg], "-u") && arg < argc - 2)
+      old_path = argv[++arg];
+    else if (!strncmp(argv[arg], "--sweep-in=", 11))
+      sweep_in = argv[arg] + 11;
+    else if (!strncmp(argv[arg], "--sweep-out=", 12))
+      sweep_out = argv[arg] + 12;
+    else if (!strncmp(argv[arg], "--format=", 9) && !parse_format(argv[arg] + 9, &format))
+      continue;
+    else
+      break;
+  }
+  bool sweep = old_path != NULL || sweep_in != NULL || sweep_out != NULL;
+  if (argc < 2 || arg != argc - 1 || (count_only && sweep) || (old_path != NULL && sweep_in != NULL)) {
+    printf("Usage: decode.elf [-n | [-u <old filename> | --sweep-in=<file>] [--sweep-out=<file>]]\n"
+           "                  [--format=text|jsonl] <filename>\n");
+    return 1;
+  }
+
+  if (format == FORMAT_JSONL)
+    set_elf_notice_out(stderr);
+
+  int fd;
+  size_t fsize;
+  byte_t *bin;
+  if (load_file(argv[argc - 1], &fd, &bin, &fsize)) {
+    return 1;
+  }
+
+  section_t sections[MAX_SECTIONS];
+  uintptr_t entry, offset, vaddr;
+  size_t size;
+  int n_sections = 0;
+  bool is_elf = false;
+
+  // Is .elf?
+  if (is_elf_file(bin, fsize)) {
+    is_elf = true;
+    if (get_elf_sections(bin, fsize, sections, &n_sections)
+        || get_elf_info(bin, sections, n_sections, &entry, &vaddr, &offset, &size)) {
+      goto ERR_CLOSE_FILE;
+    }
+    load_file_range(bin, fsize, offset, size, LOAD_POPULATE);
+  }
+  else {
+    entry = offset = vaddr = 0;
+    size = fsize;
+  }
+
+  // Count only, no listing
+  if (count_only) {
+    print_counts(bin + offset, size, format);
+    goto ERR_CLOSE_FILE;
+  }
+
+  // Only what changed since old build or its saved sweep, & saved sweep of this one
+  if (sweep) {
+    region_t regions[MAX_SECTIONS];
+    int n_regions;
+    if (get_code_regions(bin, fsize, is_elf ? sections : NULL, n_sections, regions, &n_regions))
+      goto ERR_CLOSE_FILE;
+    for (int i = 0; i < n_regions; i++)
+      load_file_range(bin, fsize, regions[i].bytes - bin, regions[i].len, LOAD_POPULATE);
+
+    sweep_t *old = NULL, *sweeps = NULL;
+    int n_old = 0, err;
+    if (old_path != NULL || sweep_in != NULL) {
+      err = (old_path != NULL ? sweep_old_file(old_path, is_elf, &old, &n_old) : load_sweeps(sweep_in, &old, &n_old))
+            || print_patched(old, n_old, regions, n_regions, is_elf ? sections : NULL, n_sections, format, &sweeps);
+    }
+    else {
+      // First build, listed from sweep of .text
+      err = sweep_regions(regions, n_regions, is_elf ? sections : NULL, n_sections, &sweeps);
+      for (int i = 0; i < n_regions && !err; i++) {
+        if (regions[i].bytes != bin + offset)
+          continue;
+        if (format == FORMAT_JSONL)
+          jsonl_instr_list(stdout, sweeps[i].list, sweeps[i].count, NULL, NULL);
+        else
+          print_instr_list(stdout, sweeps[i].list, sweeps[i].count, NULL, NULL);
+      }
+    }
+    if (!err && sweep_out != NULL)
+      save_sweeps(sweeps, n_regions, sweep_out);
+
+    free_sweeps(old, n_old);
+    free_sweeps(sweeps, n_regions);
+    goto ERR_CLOSE_FILE;
+  }
+
+  // Decode, annotate & print, pipelined
+  decode_stream(stdout, format, bin + offset, vaddr, size, is_elf ? sections : NULL, n_sections);
+
+  // Unmap file
+ERR_CLOSE_FILE:
+  close_file(bin, fd, fsize);
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "decode.h"
+#include "cfg.h"
+#include "elf.h"
+#include "func.h"
+#include "image.h"
+#include "xref.h"
+
+#define MAX_REQUEST_ARGS 3
+
+typedef struct {
+  int fd;
+  image_cache_t *cache;
+} client_t;
+
+static volatile sig_atomic_t quit = 0;
+
+static void on_signal(int sig) {
+  (void)sig;
+  quit = 1;
+}
+
+/**
+ * Resolves query (symbol, start:end, or 0x address) within image
+ *  return => 0 on success
+ */
+static int resolve(image_t *image, const char *query, uintptr_t *start, uintptr_t *end) {
+  symbol_t found;
+
+  // Single address, e.g. for callers
+  if (!strncmp(query, "0x", 2) && strchr(query, ':') == NULL) {
+    char *rest;
+    *start = strtoull(query, &rest, 16);
+    *end = *start + 1;
+    return *rest != '\0';
+  }
+
+  return get_elf_range(query, image->bin, image->sections, image->n_sections,
+                       image->n_symbols > 0 ? &image->sym_index : NULL,
+                       image->fdes, image->n_fdes, image->vaddr, image->size, start, end, &found);
+}
+
+/**
+ * return => index of first function ending after addr
+ */
+static int first_func_after(image_t *image, uintptr_t addr) {
+  int lo = 0, hi = image->n_funcs;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (image->funcs[mid].end <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Listing of every instr. within [start, end)
+ */
+static void serve_dis(FILE *out, image_t *image, uintptr_t start, uintptr_t end) {
+  for (int i = first_func_after(image, start); i < image->n_funcs && image->funcs[i].addr < end; i++) {
+    func_t *func = &image->funcs[i];
+    int from = 0, to = func->count;
+    while (from < to && func->instr[from].addr < start)
+      from++;
+    while (to > from && func->instr[to - 1].addr >= end)
+      to--;
+
+    print_instr_list(out, &func->instr[from], to - from, &image->xref, NULL);
+  }
+}
+
+/**
+ * One CFG cluster per function overlapping [start, end)
+ */
+static void serve_cfg(FILE *out, image_t *image, uintptr_t start, uintptr_t end) {
+  fprintf(out, "digraph G {\n");
+  for (int i = first_func_after(image, start); i < image->n_funcs && image->funcs[i].addr < end; i++) {
+    func_t *func = &image->funcs[i];
+    if (func->count == 0)
+      continue;
+    fprintf(out, " subgraph cluster_%d {\n", i);
+    print_bblocks(out, func->instr, func->count, NULL);
+    print_arrows(out, func->instr, func->count);
+    fprintf(out, " }\n");
+  }
+  fprintf(out, "}\n");
+}
+
+/**
+ * Every jump/call/rip-relative reference to addr, grouped by referencing function
+ */
+static void serve_callers(FILE *out, image_t *image, uintptr_t addr) {
+  const int *refs;
+  int n_refs = xref_lookup(&image->xref, addr, &refs);
+  func_t *prev_func = NULL;
+
+  for (int i = 0; i < n_refs; i++) {
+    func_t *func;
+    instr_t caller = *image_get_xref(image, refs[i], &func);
+    if (func != prev_func) {
+      print_label(out, &func->instr[0].label, func->instr[0].addr);
+      fprintf(out, ":\n");
+      prev_func = func;
+    }
+
+    caller.flags &= ~INSTR_LABEL;
+    print_instr_list(out, &caller, 1, NULL, NULL);
+  }
+}
+
+static void serve_stats(FILE *out, image_cache_t *cache) {
+  pthread_mutex_lock(&cache->lock);
+  fprintf(out, "images: %d, memory: %zu / %zu KiB\n",
+          cache->n_images, cache->mem / 1024, cache->budget / 1024);
+  for (image_t *image = cache->head; image != NULL; image = image->next) {
+    fprintf(out, "  %s: %d functions, %zu KiB%s\n", image->path, image->n_funcs,
+            image->mem / 1024, image->refs > 0 ? ", in use" : "");
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Handles one request line, response is terminated by an empty line
+ *  dis <file> <symbol|start:end>
+ *  cfg <file> <symbol|start:end>
+ *  callers <file> <symbol|0xaddr> (jumps, calls & rip-relative refs)
+ *  stats
+ */
+static void serve_request(FILE *out, image_cache_t *cache, char *line) {
+  char *argv[MAX_REQUEST_ARGS], *save;
+  int argc = 0;
+  for (char *tok = strtok_r(line, " \t\r\n", &save); tok != NULL && argc < MAX_REQUEST_ARGS;
+       tok = strtok_r(NULL, " \t\r\n", &save))
+    argv[argc++] = tok;
+
+  if (argc == 1 && !strcmp(argv[0], "stats")) {
+    serve_stats(out, cache);
+    return;
+  }
+  if (argc != 3 || (strcmp(argv[0], "dis") && strcmp(argv[0], "cfg") && strcmp(argv[0], "callers"))) {
+    fprintf(out, "error: usage: dis|cfg|callers <file> <symbol|start:end> or stats\n");
+    return;
+  }
+
+  image_t *image = cache_acquire(cache, argv[1]);
+  if (image == NULL) {
+    fprintf(out, "error: could not load %s\n", argv[1]);
+    return;
+  }
+
+  uintptr_t start, end;
+  if (resolve(image, argv[2], &start, &end)) {
+    fprintf(out, "error: could not resolve %s\n", argv[2]);
+  }
+  else if (!strcmp(argv[0], "dis")) {
+    serve_dis(out, image, start, end);
+  }
+  else if (!strcmp(argv[0], "cfg")) {
+    serve_cfg(out, image, start, end);
+  }
+  else {
+    serve_callers(out, image, start);
+  }
+
+  cache_release(cache, image);
+}
+
+static void *client_worker(void *arg) {
+  client_t *client = (client_t *)arg;
+  FILE *in = fdopen(client->fd, "r");
+  int out_fd = dup(client->fd);
+  FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+  if (in == NULL || out == NULL) {
+    if (in != NULL)
+      fclose(in);
+    else
+      close(client->fd);
+    if (out_fd >= 0)
+      close(out_fd);
+    free(client);
+    return NULL;
+  }
+
+  char *line = NULL;
+  size_t line_size = 0;
+  while (getline(&line, &line_size, in) > 0) {
+    serve_request(out, client->cache, line);
+    fprintf(out, "\n");
+    if (fflush(out) != 0)
+      break;
+  }
+
+  free(line);
+  fclose(out);
+  fclose(in);
+  free(client);
+  return NULL;
+}
+
+int main(int argc, const char *argv[]) {
+  size_t budget_mb = 1024;
+  if (argc == 4 && !strcmp(argv[1], "-m")) {
+    budget_mb = strtoull(argv[2], NULL, 10);
+  }
+  else if (argc != 2) {
+    printf("Usage: disasmd [-m <budget MiB>] <socket>\n");
+    return 1;
+  }
+  const char *socket_path = argv[argc - 1];
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    printf("Socket path is too long: %s\n", socket_path);
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0) {
+    printf("Could not create socket!\n");
+    return 1;
+  }
+
+  // Replace stale socket of earlier run, never any other file
+  struct stat st;
+  if (lstat(socket_path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      printf("Not a socket, refusing to replace: %s\n", socket_path);
+      close(server);
+      return 1;
+    }
+    unlink(socket_path);
+  }
+  if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(server, 64) < 0) {
+    printf("Could not listen on socket: %s\n", socket_path);
+    close(server);
+    return 1;
+  }
+
+  // Clients going away mid-response must not kill us,
+  // SIGINT/SIGTERM interrupt accept() so the socket gets removed
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  image_cache_t cache;
+  cache_init(&cache, budget_mb * 1024 * 1024);
+
+  while (!quit) {
+    int fd = accept(server, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    client_t *client = (client_t *)malloc(sizeof(client_t));
+    pthread_t thread;
+    if (client == NULL) {
+      close(fd);
+      continue;
+    }
+    client->fd = fd;
+    client->cache = &cache;
+    if (pthread_create(&thread, NULL, client_worker, client) != 0) {
+      close(fd);
+      free(client);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+
+  close(server);
+  unlink(socket_path);
+  cache_free(&cache);
+  return 0;
+}
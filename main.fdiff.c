@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "func.h"
+#include "image.h"
+#include "fhash.h"
+
+#define NAME_COLUMN 40
+
+/**
+ * Prints symbol name or sub_<addr>, padded to NAME_COLUMN
+ */
+static void print_func_name(const func_t *func) {
+  int len = func->name != NULL ? printf("%s", func->name) : printf("sub_%lx", func->addr);
+  printf("%*s", len < NAME_COLUMN ? NAME_COLUMN - len : 1, "");
+}
+
+/**
+ * What changed between builds, unchanged functions are only counted
+ */
+static void print_diff(image_t *old, fhash_t old_hashes[], image_t *new, fhash_t new_hashes[],
+                       match_t matches[], int n_matches) {
+  int n_kind[MATCH_ADDED + 1] = { 0 };
+
+  for (int i = 0; i < n_matches; i++) {
+    match_t *m = &matches[i];
+    n_kind[m->kind]++;
+
+    switch (m->kind) {
+      case MATCH_SAME:
+        break;
+      case MATCH_CHANGED:
+        printf("~ ");
+        print_func_name(&new->funcs[m->new]);
+        printf("0x%-10lx -> 0x%-10lx %d of %d bblocks same\n",
+               old->funcs[m->old].addr, new->funcs[m->new].addr,
+               count_same_blocks(&old_hashes[m->old], &new_hashes[m->new]), new_hashes[m->new].n_blocks);
+        break;
+      case MATCH_REMOVED:
+        printf("- ");
+        print_func_name(&old->funcs[m->old]);
+        printf("0x%lx\n", old->funcs[m->old].addr);
+        break;
+      case MATCH_ADDED:
+        printf("+ ");
+        print_func_name(&new->funcs[m->new]);
+        printf("%-16s0x%lx\n", "", new->funcs[m->new].addr);
+        break;
+    }
+  }
+
+  fprintf(stderr, "functions: %d old, %d new; %d same, %d changed, %d removed, %d added\n",
+          old->n_funcs, new->n_funcs,
+          n_kind[MATCH_SAME], n_kind[MATCH_CHANGED], n_kind[MATCH_REMOVED], n_kind[MATCH_ADDED]);
+}
+
+typedef struct {
+  int first;
+  int n_funcs;
+  long saved; // instr. that folding would drop
+} group_t;
+
+static int compare_group_saved(const void *a, const void *b) {
+  long x = ((const group_t *)a)->saved, y = ((const group_t *)b)->saved;
+  return (x < y) - (x > y);
+}
+
+/**
+ * Identical code folding candidates, biggest savings first
+ */
+static int print_groups(image_t *image, fhash_t hashes[]) {
+  int *first;
+  if (group_functions(hashes, image->n_funcs, &first))
+    return 1;
+
+  int *size = (int *)calloc(image->n_funcs > 0 ? image->n_funcs : 1, sizeof(int));
+  group_t *groups = (group_t *)malloc((image->n_funcs > 0 ? image->n_funcs : 1) * sizeof(group_t));
+  if (size == NULL || groups == NULL) {
+    printf("Could not allocate memory for grouping!\n");
+    free(first);
+    free(size);
+    free(groups);
+    return 1;
+  }
+
+  for (int i = 0; i < image->n_funcs; i++)
+    size[first[i]]++;
+
+  int n_groups = 0, n_folded = 0;
+  long saved = 0;
+  for (int i = 0; i < image->n_funcs; i++) {
+    if (first[i] != i || size[i] < 2)
+      continue;
+    groups[n_groups++] = (group_t){ i, size[i], (long)(size[i] - 1) * hashes[i].n_instr };
+    n_folded += size[i] - 1;
+    saved += (long)(size[i] - 1) * hashes[i].n_instr;
+  }
+  qsort(groups, n_groups, sizeof(group_t), compare_group_saved);
+
+  for (int g = 0; g < n_groups; g++) {
+    int f = groups[g].first;
+    printf("%016lx: %d x %d instr.\n", hashes[f].hash, groups[g].n_funcs, hashes[f].n_instr);
+    for (int i = f; i < image->n_funcs; i++) {
+      if (first[i] != f)
+        continue;
+      printf("  ");
+      print_func_name(&image->funcs[i]);
+      printf("0x%lx\n", image->funcs[i].addr);
+    }
+  }
+  fprintf(stderr, "functions: %d; %d groups, %d foldable, %ld instr. saved\n",
+          image->n_funcs, n_groups, n_folded, saved);
+
+  free(first);
+  free(size);
+  free(groups);
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  bool icf = argc == 3 && !strcmp(argv[1], "-i");
+  if (argc != 3) {
+    printf("Usage: fdiff <old filename> <new filename>\n"
+           "       fdiff -i <filename>\n");
+    return 1;
+  }
+
+  image_t *old = NULL, *new = NULL;
+  fhash_t *old_hashes = NULL, *new_hashes = NULL;
+
+  // Identical functions within one binary
+  if (icf) {
+    if (image_load(argv[2], &new) || hash_functions(new->funcs, new->n_funcs, &new_hashes))
+      goto ERR_FREE;
+    print_groups(new, new_hashes);
+    goto ERR_FREE;
+  }
+
+  // Functions changed between two
+  if (image_load(argv[1], &old) || hash_functions(old->funcs, old->n_funcs, &old_hashes)
+      || image_load(argv[2], &new) || hash_functions(new->funcs, new->n_funcs, &new_hashes))
+    goto ERR_FREE;
+
+  match_t *matches;
+  int n_matches;
+  if (!match_functions(old->funcs, old_hashes, old->n_funcs, new->funcs, new_hashes, new->n_funcs,
+                       &matches, &n_matches)) {
+    print_diff(old, old_hashes, new, new_hashes, matches, n_matches);
+    free(matches);
+  }
+
+ERR_FREE:
+  if (old_hashes != NULL)
+    free_hashes(old_hashes, old->n_funcs);
+  if (new_hashes != NULL)
+    free_hashes(new_hashes, new->n_funcs);
+  if (old != NULL)
+    image_free(old);
+  if (new != NULL)
+    image_free(new);
+
+  return 0;
+}
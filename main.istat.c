@@ -0,0 +1,26 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "decode.h"
+#include "istat.h"
+
+int main(int argc, const char *argv[]) {
+  if (argc < 2) {
+    printf("Usage: istat <filename>...\n");
+    return 1;
+  }
+
+  istat_t *stat = (istat_t *)malloc(sizeof(istat_t));
+  if (stat == NULL) {
+    printf("Could not allocate memory for statistics!\n");
+    return 1;
+  }
+
+  // One pass over all files, no listing
+  if (!istat_files(&argv[1], argc - 1, sysconf(_SC_NPROCESSORS_ONLN), stat))
+    print_istat(stdout, stat);
+
+  free(stat);
+  return 0;
+}
@@ -7,40 +7,239 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <elf.h>
+#include <unistd.h>
 
 #include "elf.h"
 #include "decode.h"
+#include "scan.h"
+#include "func.h"
+#include "jtab.h"
+#include "xref.h"
+#include "heat.h"
+#include "json.h"
+#include "worklist.h"
 
 int compare_instr_vaddr(const void *a, const void *b) {
-  return ((instr_t *)a)->addr - ((instr_t *)b)->addr;
+  addr_t x = ((const instr_t *)a)->addr, y = ((const instr_t *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Size in bytes, with optional k/m/g suffix
+ *  return => 1 if not a positive size
+ */
+static int parse_size(const char *arg, size_t *size) {
+  char *end;
+  unsigned long long value = strtoull(arg, &end, 10);
+  if (end == arg)
+    return 1;
+
+  switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+  }
+  if (*end != '\0' || value == 0)
+    return 1;
+
+  *size = value;
+  return 0;
+}
+
+/**
+ * Loads xref index saved by --xref-out= instead of building it
+ *  n_instr => instr. ids of index must be below it, same decode as saved
+ *  return => 0 on success
+ */
+static int load_xrefs(xref_t *xref, const char *path, int n_instr) {
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) {
+    printf("Could not open xref index: %s\n", path);
+    return 1;
+  }
+  int err = xref_read(xref, in);
+  fclose(in);
+  if (err)
+    return 1;
+
+  for (int i = 0; i < xref->n_refs; i++) {
+    if (xref->refs[i] >= n_instr) {
+      printf("Could not use xref index, it's not of this decode: %s\n", path);
+      xref_free(xref);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int save_xrefs(const xref_t *xref, const char *path) {
+  FILE *out = fopen(path, "wb");
+  if (out == NULL) {
+    printf("Could not create xref index: %s\n", path);
+    return 1;
+  }
+  int err = xref_write(xref, out);
+  if (fclose(out) != 0 && !err) {
+    printf("Could not write xref index!\n");
+    err = 1;
+  }
+  return err;
 }
 
 int main(int argc, const char *argv[]) {
-  if (argc != 2) {
-    printf("Usage: recfun <filename>\n");
+  bool call_targets = false, eh_frame = false, functions = false, gaps = false, xrefs = false;
+  const char *query = NULL, *samples = NULL, *xref_in = NULL, *xref_out = NULL;
+  addr_t bias = 0;
+  format_t format = FORMAT_TEXT;
+  double deadline = 0;
+  size_t max_memory = 0;
+  int arg = 1;
+  for (; arg < argc - 1; arg++) {
+    if (!strcmp(argv[arg], "-c"))
+      call_targets = true;
+    else if (!strcmp(argv[arg], "-e"))
+      eh_frame = true;
+    else if (!strcmp(argv[arg], "-f"))
+      functions = true;
+    else if (!strcmp(argv[arg], "-g"))
+      gaps = true;
+    else if (!strcmp(argv[arg], "-x"))
+      xrefs = true;
+    else if (!strcmp(argv[arg], "-q") && arg < argc - 2)
+      query = argv[++arg];
+    else if (!strcmp(argv[arg], "-p") && arg < argc - 2)
+      samples = argv[++arg];
+    else if (!strcmp(argv[arg], "-b") && arg < argc - 2)
+      bias = strtoull(argv[++arg], NULL, 16);
+    else if (!strncmp(argv[arg], "--format=", 9) && !parse_format(argv[arg] + 9, &format))
+      continue;
+    else if (!strncmp(argv[arg], "--xref-in=", 10))
+      xref_in = argv[arg] + 10;
+    else if (!strncmp(argv[arg], "--xref-out=", 11))
+      xref_out = argv[arg] + 11;
+    else if (!strncmp(argv[arg], "--deadline=", 11) && (deadline = strtod(argv[arg] + 11, NULL)) > 0)
+      continue;
+    else if (!strncmp(argv[arg], "--max-memory=", 13) && !parse_size(argv[arg] + 13, &max_memory))
+      continue;
+    else
+      break;
+  }
+  bool budgeted = deadline > 0 || max_memory > 0;
+  xrefs = xrefs || xref_in != NULL || xref_out != NULL;
+  if (argc < 2 || arg != argc - 1 || (functions && budgeted) || (xref_in != NULL && xref_out != NULL)) {
+    printf("Usage: recfun [-c] [-e] [-f] [-g] [-q <symbol|start:end>] [-x] [-p <samples> [-b <load addr>]] [--format=text|jsonl]\n"
+           "              [--xref-in=<file> | --xref-out=<file>] [--deadline=<seconds>] [--max-memory=<bytes>[k|m|g]] <filename>\n");
     return 1;
   }
 
-  int fd, fsize;
+  if (format == FORMAT_JSONL)
+    set_elf_notice_out(stderr);
+
+  int fd;
+  size_t fsize;
   byte_t *bin;
-  if (load_file(argv[1], &fd, &bin, &fsize)) {
+  if (load_file(argv[argc - 1], &fd, &bin, &fsize)) {
     return 1;
   }
 
   section_t sections[MAX_SECTIONS];
-  symbol_t symbols[MAX_SYMBOLS];
+  symbol_t *symbols = NULL;
+  fde_t *fdes = NULL;
   uintptr_t entry, offset, vaddr;
-  int size, n_sections, n_symbols;
+  size_t size;
+  int n_sections, n_symbols, n_fdes = 0;
+  heat_t heat = { .hits = NULL };
+  plt_index_t plt = { .slot = NULL };
+  reloc_index_t relocs = { NULL, 0 };
 
   // Is .elf?
-  if (bin[0] != 0x7F || bin[1] != 'E' || bin[2] != 'L' || bin[3] != 'F') {
+  if (!is_elf_file(bin, fsize)) {
     goto ERR_CLOSE_FILE;
   }
 
   // Get .elf info, parse symtab
-  if (get_elf_sections(bin, sections, &n_sections)
+  if (get_elf_sections(bin, fsize, sections, &n_sections)
       || get_elf_info(bin, sections, n_sections, &entry, &vaddr, &offset, &size)
-      || get_elf_symtab(bin, sections, n_sections, symbols, &n_symbols)) {
+      || get_elf_symtab(bin, sections, n_sections, &symbols, &n_symbols)
+      || get_elf_plt(bin, sections, n_sections, &plt)
+      || get_elf_relocs(bin, sections, n_sections, offset, &relocs)
+      || ((functions || eh_frame || query != NULL) && get_elf_fdes(bin, sections, n_sections, &fdes, &n_fdes))) {
+    goto ERR_CLOSE_FILE;
+  }
+
+  // Query => decode just one function/range, recursion stays within it
+  decode_mode_t mode = DECODE_RECURSIVE;
+  symbol_t query_sym = { .name = NULL };
+  if (query != NULL) {
+    uintptr_t start, end;
+    symbol_index_t sym_index;
+    if (n_symbols > 0 && symbol_index_init(&sym_index, symbols, n_symbols))
+      goto ERR_CLOSE_FILE;
+    int err = get_elf_range(query, bin, sections, n_sections, n_symbols > 0 ? &sym_index : NULL,
+                            fdes, n_fdes, vaddr, size, &start, &end, &query_sym);
+    if (n_symbols > 0)
+      symbol_index_free(&sym_index);
+    if (err)
+      goto ERR_CLOSE_FILE;
+
+    offset += start - vaddr;
+    vaddr = entry = start;
+    size = end - start;
+    mode = DECODE_FUNCTION;
+  }
+  load_file_range(bin, fsize, offset, size, 0);
+
+  // Sampled addresses, e.g. from `perf script -F ip`
+  if (samples != NULL) {
+    if (heat_load(&heat, samples, vaddr, size, bias))
+      goto ERR_CLOSE_FILE;
+    fprintf(stderr, "samples: %lu, %.1f%% within decoded region\n",
+            heat.total, heat.total > 0 ? 100.0 * (heat.total - heat.outside) / heat.total : 0.0);
+  }
+
+  // Discover functions, decode each as independent unit
+  if (functions) {
+    func_t *funcs;
+    int n_funcs;
+    if (find_functions(bin + offset, size, vaddr, entry, symbols, n_symbols, fdes, n_fdes, &relocs, &funcs, &n_funcs))
+      goto ERR_CLOSE_FILE;
+
+    if (!decode_functions(bin + offset, vaddr, funcs, n_funcs, &relocs, bin, sections, n_sections,
+                          sysconf(_SC_NPROCESSORS_ONLN))) {
+      for (int i = 0; i < n_funcs; i++) {
+        proc_symtab_labels(funcs[i].instr, funcs[i].count, symbols, n_symbols);
+        proc_flow_labels(funcs[i].instr, funcs[i].count);
+        proc_section_labels(funcs[i].instr, funcs[i].count, sections, n_sections);
+      }
+      proc_call_labels(funcs, n_funcs);
+      for (int i = 0; i < n_funcs; i++) {
+        proc_plt_labels(funcs[i].instr, funcs[i].count, &plt);
+        proc_reloc_labels(funcs[i].instr, funcs[i].count, &relocs);
+      }
+
+      // Instr. ids run through funcs in order, as build_func_xrefs() numbers them
+      int n_instr = 0;
+      for (int i = 0; i < n_funcs; i++)
+        n_instr += funcs[i].count;
+
+      xref_t xref;
+      bool has_xref = xrefs && (xref_in != NULL ? !load_xrefs(&xref, xref_in, n_instr)
+                                                : !build_func_xrefs(funcs, n_funcs, &xref));
+      if (has_xref && xref_out != NULL)
+        save_xrefs(&xref, xref_out);
+      for (int i = 0; i < n_funcs; i++) {
+        if (format == FORMAT_JSONL)
+          jsonl_instr_list(stdout, funcs[i].instr, funcs[i].count, has_xref ? &xref : NULL,
+                           samples != NULL ? &heat : NULL);
+        else
+          print_instr_list(stdout, funcs[i].instr, funcs[i].count, has_xref ? &xref : NULL,
+                           samples != NULL ? &heat : NULL);
+      }
+      if (has_xref)
+        xref_free(&xref);
+    }
+
+    free_functions(funcs, n_funcs);
     goto ERR_CLOSE_FILE;
   }
 
@@ -50,40 +249,127 @@ int main(int argc, const char *argv[]) {
     printf("Could not allocate memory for decoder!\n");
     goto ERR_CLOSE_FILE;
   }
+  addr_index_t index;
+  if (index_init(&index, vaddr, size)) {
+    free(list);
+    goto ERR_CLOSE_FILE;
+  }
+  index.relocs = &relocs;
+
+  // Budgeted => queue entry, symbols & seeds, decode them by priority later
+  budget_t budget;
+  worklist_t work;
+  if (budgeted) {
+    budget_init(&budget, deadline, max_memory);
+    if (worklist_init(&work, vaddr, size)) {
+      index_free(&index);
+      free(list);
+      goto ERR_CLOSE_FILE;
+    }
+
+    worklist_push(&work, TARGET_ENTRY, entry);
+    for (int i = 0; mode == DECODE_RECURSIVE && i < n_symbols; i++) {
+      if (symbols[i].type == STT_FUNC && symbols[i].shndx != SHN_UNDEF)
+        worklist_push(&work, TARGET_SYMBOL, symbols[i].value);
+    }
+  }
 
   // Decode all bblocks
-  int count = decode(list, 0, bin + offset + (entry - vaddr), entry, size, DECODE_RECURSIVE, 0);
+  int count = budgeted ? 0 : decode(list, 0, bin + offset, vaddr, size, entry, mode, 0, &index);
+
+  // Seed functions from validated call targets
+  if (call_targets) {
+    uintptr_t *targets = (uintptr_t *)malloc(size * sizeof(uintptr_t));
+    if (targets == NULL) {
+      printf("Could not allocate memory for scanner!\n");
+      if (budgeted)
+        worklist_free(&work);
+      index_free(&index);
+      free(list);
+      goto ERR_CLOSE_FILE;
+    }
 
-  // Sort by vaddr
+    int n_targets = scan_call_targets(bin + offset, size, vaddr, targets, size);
+    for (int i = 0; i < n_targets; i++) {
+      if (budgeted)
+        worklist_push(&work, TARGET_SCAN, targets[i]);
+      else
+        count = decode(list, count, bin + offset, vaddr, size, targets[i], mode, 0, &index);
+    }
+    free(targets);
+  }
+
+  // Seed functions from .eh_frame ranges
+  if (eh_frame) {
+    for (int i = 0; i < n_fdes; i++) {
+      if (budgeted)
+        worklist_push(&work, TARGET_SYMBOL, fdes[i].start);
+      else if (fdes[i].start >= vaddr && fdes[i].start - vaddr < size)
+        count = decode(list, count, bin + offset, vaddr, size, fdes[i].start, mode, 0, &index);
+    }
+  }
+
+  // Calls are queued too, nothing is decoded once out of budget
+  if (budgeted) {
+    count = decode_worklist(list, count, bin + offset, mode, &work, &index, &budget);
+    print_budget_report(stderr, &budget, &work, index_covered(&index));
+    worklist_free(&work);
+  }
+  bool out_of_budget = budgeted && budget.stop != BUDGET_OK;
+
+  // Switch jump tables, their calls aren't followed within budget
+  if (!out_of_budget) {
+    jtab_t *jtabs;
+    int n_jtabs;
+    count = decode_jump_tables(list, count, bin, sections, n_sections, bin + offset, vaddr, size,
+                               budgeted ? DECODE_FUNCTION : mode, &index, &jtabs, &n_jtabs);
+    free_jump_tables(jtabs, n_jtabs);
+  }
+
+  // Linear-sweep whatever recursion did not reach
+  if (gaps && !out_of_budget) {
+    size_t covered = index_covered(&index);
+    count = decode_gaps(list, count, bin + offset, &index);
+    fprintf(stderr, "coverage: %.1f%% recursive, %.1f%% total\n",
+            100.0 * covered / size, 100.0 * index_covered(&index) / size);
+  }
+
+  // Sort by vaddr, index gives the order directly
   //printf("Total count = %d\n", count);
-  qsort(list, count, sizeof(instr_t), compare_instr_vaddr);
+  if (index_sort(&index, list, count))
+    qsort(list, count, sizeof(instr_t), compare_instr_vaddr);
+  index_free(&index);
 
   // Xrefs
   proc_symtab_labels(list, count, symbols, n_symbols);
+  if (query_sym.name != NULL)
+    proc_symtab_labels(list, count, &query_sym, 1);
   proc_flow_labels(list, count);
+  proc_plt_labels(list, count, &plt);
   proc_section_labels(list, count, sections, n_sections);
+  proc_reloc_labels(list, count, &relocs);
 
   // Print
-  for (int i = 0; i < count; i++) {
-    if (list[i].label[0] != '\0')
-    printf("%s:\n", list[i].label);
-
-    char addr_buf[16];
-    snprintf(addr_buf, 16, "0x%x", list[i].addr);
-
-    printf("   %s:%*s %-20s    %-5s %-20s %s%s\n",
-            addr_buf,
-            (int)(7 - strlen(addr_buf)), "", // padding
-            list[i].hex_bytes,
-            list[i].mnemo_opcode,
-            list[i].mnemo_operand,
-            list[i].mnemo_notes[0] != '\0' ? "# " : "",
-            list[i].mnemo_notes);
-  }
+  xref_t xref;
+  bool has_xref = xrefs && (xref_in != NULL ? !load_xrefs(&xref, xref_in, count)
+                                            : !xref_build(&xref, &list, &count, 1));
+  if (has_xref && xref_out != NULL)
+    save_xrefs(&xref, xref_out);
+  if (format == FORMAT_JSONL)
+    jsonl_instr_list(stdout, list, count, has_xref ? &xref : NULL, samples != NULL ? &heat : NULL);
+  else
+    print_instr_list(stdout, list, count, has_xref ? &xref : NULL, samples != NULL ? &heat : NULL);
+  if (has_xref)
+    xref_free(&xref);
 
   // Unmap file & free mem
   free(list);
 ERR_CLOSE_FILE:
+  heat_free(&heat);
+  plt_index_free(&plt);
+  reloc_index_free(&relocs);
+  free(symbols);
+  free(fdes);
   close_file(bin, fd, fsize);
 
   return 0;
@@ -0,0 +1,614 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "scan.h"
+#include "patch.h"
+
+#define PATCH_GAP 16 // runs closer than longest instr. are one patch
+
+#define SWEEP_MAGIC   0x50455753 // "SWEP"
+#define SWEEP_VERSION 1
+
+static inline bool test_bit(const uint64_t mask[], size_t i) {
+  return (mask[i / 64] >> (i % 64)) & 1;
+}
+
+static inline bool ends_block(const instr_t *instr) {
+  flow_t flow = get_instr_flow(instr);
+  return flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_RET || flow == FLOW_IJMP;
+}
+
+/**
+ * return => offset of jump/call dest. within region, -1 if none
+ */
+static inline long long ref_offset(const sweep_t *sweep, const instr_t *instr) {
+  flow_t flow = get_instr_flow(instr);
+  if (flow != FLOW_JCC && flow != FLOW_JMP && flow != FLOW_CALL)
+    return -1;
+
+  addr_t dest = get_instr_dest(instr);
+  if (dest < sweep->vaddr || dest - sweep->vaddr >= sweep->len)
+    return -1;
+  return dest - sweep->vaddr;
+}
+
+/**
+ * return => index of last instr. starting at or before addr, 0 if none
+ */
+static int find_covering(instr_t list[], int count, addr_t addr) {
+  int lo = 0, hi = count - 1, found = 0;
+  while (lo <= hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (list[mid].addr <= addr) {
+      found = mid;
+      lo = mid + 1;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+/**
+ * Block label as decode() + proc_flow_labels() would set it
+ */
+static void relabel(sweep_t *sweep, int i) {
+  instr_t *instr = &sweep->list[i];
+  if (i == 0 || ends_block(&sweep->list[i - 1]) || sweep->n_refs[instr->addr - sweep->vaddr] > 0)
+    set_label(instr, NULL, sweep->vaddr);
+  else
+    instr->flags &= ~INSTR_LABEL;
+}
+
+/**
+ * Jump/call note as proc_flow_labels() would set it
+ */
+static void renote(sweep_t *sweep, int i) {
+  instr_t *instr = &sweep->list[i];
+  flow_t flow = get_instr_flow(instr);
+  if (flow != FLOW_JCC && flow != FLOW_JMP && flow != FLOW_CALL)
+    return;
+
+  instr->flags &= ~INSTR_CF_LABEL;
+  instr->mnemo_notes[0] = '\0';
+  long long off = ref_offset(sweep, instr);
+  if (off < 0 || !test_bit(sweep->bounds, off)) {
+    proc_jump_note(instr, NULL);
+    return;
+  }
+
+  label_t label = { NULL, sweep->vaddr };
+  proc_jump_note(instr, &label);
+}
+
+/**
+ * Labels, jump & value notes of list[from] - list[to - 1], freshly decoded
+ */
+static void annotate(sweep_t *sweep, int from, int to) {
+  for (int i = from; i < to; i++) {
+    relabel(sweep, i);
+    flow_t flow = get_instr_flow(&sweep->list[i]);
+    if (flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL)
+      renote(sweep, i);
+    else
+      proc_value_note(&sweep->list[i]);
+  }
+  if (sweep->sections != NULL)
+    proc_section_labels(&sweep->list[from], to - from, sweep->sections, sweep->n_sections);
+}
+
+/**
+ * Finds code decode.elf -u sweeps, every executable section of ELF
+ *  sections => NULL if not an ELF, whole file is one region then
+ *  regions => room for MAX_SECTIONS
+ *  return => 0 on success
+ */
+int get_code_regions(byte_t *bin, size_t fsize, section_t sections[], int n_sections, region_t regions[], int *n_regions) {
+  *n_regions = 0;
+  if (sections == NULL) {
+    regions[(*n_regions)++] = (region_t){ "", bin, 0, fsize };
+    return 0;
+  }
+
+  for (int i = 0; i < n_sections; i++) {
+    if ((sections[i].flags & SHF_EXECINSTR) && sections[i].type != SHT_NOBITS && sections[i].size > 0) {
+      regions[(*n_regions)++] = (region_t){ sections[i].name, bin + sections[i].elf_offset,
+                                            sections[i].vaddr, sections[i].size };
+    }
+  }
+  if (*n_regions == 0) {
+    printf("Could not find code sections!\n");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Grows list[], bounds & n_refs to room bytes of region, no instr. & refs in new ones
+ *  return => 0 on success
+ */
+static int sweep_grow(sweep_t *sweep, size_t room) {
+  size_t words = sweep->bounds != NULL ? SCAN_MASK_WORDS(sweep->room) + 1 : 0;
+  size_t new_words = SCAN_MASK_WORDS(room) + 1;
+
+  instr_t *list = (instr_t *)realloc(sweep->list, room * sizeof(instr_t));
+  if (list == NULL)
+    return 1;
+  sweep->list = list;
+  uint64_t *bounds = (uint64_t *)realloc(sweep->bounds, new_words * sizeof(uint64_t));
+  if (bounds == NULL)
+    return 1;
+  sweep->bounds = bounds;
+  int *n_refs = (int *)realloc(sweep->n_refs, room * sizeof(int));
+  if (n_refs == NULL)
+    return 1;
+  sweep->n_refs = n_refs;
+
+  memset(&bounds[words], 0, (new_words - words) * sizeof(uint64_t));
+  memset(&n_refs[sweep->room], 0, (room - sweep->room) * sizeof(int));
+  sweep->room = room;
+  return 0;
+}
+
+/**
+ * Linear sweep with labels & notes as decode.elf lists them, plus what
+ *  sweep_patch() needs to redo only the changed parts
+ *  name => of section, kept in sweep & its cache
+ *  bytes[] => must stay mapped until next sweep_patch() or sweep_free()
+ *  sweep => free with sweep_free()
+ *  return => 0 on success
+ */
+int sweep_decode(sweep_t *sweep, const char *name, byte_t bytes[], addr_t vaddr, size_t len, section_t sections[], int n_sections) {
+  memset(sweep, 0, sizeof(sweep_t));
+  snprintf(sweep->name, SWEEP_NAME_LEN, "%s", name);
+  sweep->bytes = bytes;
+  sweep->vaddr = vaddr;
+  sweep->len = len;
+  sweep->sections = sections;
+  sweep->n_sections = n_sections;
+
+  if (sweep_grow(sweep, len > 0 ? len : 1)) {
+    printf("Could not allocate memory for decoder!\n");
+    sweep_free(sweep);
+    return 1;
+  }
+
+  size_t pos = 0;
+  while (pos < len) {
+    sweep->bounds[pos / 64] |= 1ULL << (pos % 64);
+    pos += decode_instr(&sweep->list[sweep->count], bytes, vaddr, pos, vaddr);
+
+    long long off = ref_offset(sweep, &sweep->list[sweep->count]);
+    if (off >= 0)
+      sweep->n_refs[off]++;
+    sweep->count++;
+  }
+
+  annotate(sweep, 0, sweep->count);
+  return 0;
+}
+
+void sweep_free(sweep_t *sweep) {
+  free(sweep->list);
+  free(sweep->bounds);
+  free(sweep->n_refs);
+  free(sweep->data);
+  sweep->list = NULL;
+  sweep->bounds = NULL;
+  sweep->n_refs = NULL;
+  sweep->data = NULL;
+  sweep->count = 0;
+  sweep->room = 0;
+}
+
+static int add_patch(patch_t **patches, int *n_patches, int *max, size_t from, size_t to) {
+  if (*n_patches > 0 && from - (*patches)[*n_patches - 1].to < PATCH_GAP) {
+    (*patches)[*n_patches - 1].to = to;
+    return 0;
+  }
+  if (*n_patches == *max) {
+    *max *= 2;
+    patch_t *tmp = (patch_t *)realloc(*patches, *max * sizeof(patch_t));
+    if (tmp == NULL)
+      return 1;
+    *patches = tmp;
+  }
+  (*patches)[(*n_patches)++] = (patch_t){ from, to };
+  return 0;
+}
+
+/**
+ * Finds changed byte runs between two versions of region
+ *  Compares a word at a time, runs less than PATCH_GAP apart are merged,
+ *  if region grew or shrank, bytes past end of shorter version are changed
+ *  patches => malloc'd, sorted
+ *  return => 0 on success
+ */
+int find_patches(const byte_t old[], size_t old_len, const byte_t new[], size_t new_len, patch_t **patches, int *n_patches) {
+  size_t len = old_len < new_len ? old_len : new_len;
+  int max = 16;
+  *n_patches = 0;
+  *patches = (patch_t *)malloc(max * sizeof(patch_t));
+  if (*patches == NULL)
+    goto ERR_ALLOC;
+
+  size_t pos = 0;
+  while (pos < len) {
+    // Skip equal words
+    while (pos + 8 <= len) {
+      uint64_t a, b;
+      memcpy(&a, &old[pos], 8);
+      memcpy(&b, &new[pos], 8);
+      if (a != b)
+        break;
+      pos += 8;
+    }
+    while (pos < len && old[pos] == new[pos])
+      pos++;
+    if (pos == len)
+      break;
+
+    size_t from = pos;
+    while (pos < len && old[pos] != new[pos])
+      pos++;
+    if (add_patch(patches, n_patches, &max, from, pos))
+      goto ERR_ALLOC;
+  }
+
+  if (old_len != new_len && add_patch(patches, n_patches, &max, len, old_len + new_len - len))
+    goto ERR_ALLOC;
+  return 0;
+
+ERR_ALLOC:
+  printf("Could not allocate memory for patches!\n");
+  free(*patches);
+  *patches = NULL;
+  return 1;
+}
+
+/**
+ * Rebases sweep of region that moved to vaddr, bytes unchanged
+ *  Nothing is re-decoded, operands are rip-relative, so only addr.
+ *  shift, labels & notes (which may name other sections) are redone
+ */
+void sweep_move(sweep_t *sweep, addr_t vaddr) {
+  addr_t delta = vaddr - sweep->vaddr;
+  for (int i = 0; i < sweep->count; i++) {
+    sweep->list[i].addr += delta;
+    sweep->list[i].sub_addr += delta;
+  }
+  sweep->vaddr = vaddr;
+  annotate(sweep, 0, sweep->count);
+}
+
+/**
+ * Sets new len of region, refs into bytes it gained or lost are (un)counted
+ *  return => true if there were any, their notes must be redone
+ */
+static bool sweep_resize(sweep_t *sweep, size_t len) {
+  size_t lo = len < sweep->len ? len : sweep->len;
+  size_t hi = len < sweep->len ? sweep->len : len;
+  int step = len > sweep->len ? 1 : -1;
+  bool found = false;
+
+  for (int i = 0; i < sweep->count; i++) {
+    flow_t flow = get_instr_flow(&sweep->list[i]);
+    if (flow != FLOW_JCC && flow != FLOW_JMP && flow != FLOW_CALL)
+      continue;
+    addr_t dest = get_instr_dest(&sweep->list[i]);
+    if (dest >= sweep->vaddr && dest - sweep->vaddr >= lo && dest - sweep->vaddr < hi) {
+      sweep->n_refs[dest - sweep->vaddr] += step;
+      found = true;
+    }
+  }
+
+  sweep->len = len;
+  return found;
+}
+
+/**
+ * Brings sweep up to date with patched bytes[] of the same region, now len bytes
+ *  Each patch is re-decoded from the instr. boundary before it, until
+ *  decoding falls back in step with old boundaries past its end, then
+ *  labels & notes are redone for the new instr. & whatever they (or the
+ *  removed ones) jump to, list only moves if instr. count changes
+ *  Jumps from elsewhere are revisited only if a boundary they target
+ *  came or went, or if region grew or shrank under them
+ *  patches => from find_patches()
+ *  hunks => malloc'd, one per re-decoded run
+ *  return => 0 on success
+ */
+int sweep_patch(sweep_t *sweep, byte_t bytes[], size_t len, patch_t patches[], int n_patches, hunk_t **hunks, int *n_hunks) {
+  sweep->bytes = bytes;
+  *n_hunks = 0;
+  *hunks = (hunk_t *)malloc((n_patches > 0 ? n_patches : 1) * sizeof(hunk_t));
+  int *old_first = (int *)malloc((n_patches > 0 ? n_patches : 1) * sizeof(int));
+  int *tmp_first = (int *)malloc((n_patches > 0 ? n_patches : 1) * sizeof(int));
+  instr_t *tmp = NULL;
+  addr_t *touched = NULL;
+  int n_tmp = 0, max_tmp = 0, n_touched = 0;
+  if (*hunks == NULL || old_first == NULL || tmp_first == NULL
+      || (len > sweep->room && sweep_grow(sweep, len)))
+    goto ERR_ALLOC;
+  bool rescan = len != sweep->len && sweep_resize(sweep, len);
+
+  // Re-decode against old boundaries, list stays as is
+  instr_t *list = sweep->list;
+  int p = 0;
+  while (p < n_patches) {
+    int i0 = find_covering(list, sweep->count, sweep->vaddr + patches[p].from);
+    size_t pos = sweep->count > 0 ? list[i0].addr - sweep->vaddr : 0;
+    size_t end = patches[p++].to;
+    int first = n_tmp;
+
+    while (pos < sweep->len) {
+      while (p < n_patches && patches[p].from < pos) {
+        if (patches[p].to > end)
+          end = patches[p].to;
+        p++;
+      }
+      if (pos >= end && test_bit(sweep->bounds, pos))
+        break; // in step again
+
+      if (n_tmp == max_tmp) {
+        max_tmp = max_tmp > 0 ? max_tmp * 2 : 64;
+        instr_t *grown = (instr_t *)realloc(tmp, max_tmp * sizeof(instr_t));
+        if (grown == NULL)
+          goto ERR_ALLOC;
+        tmp = grown;
+      }
+      pos += decode_instr(&tmp[n_tmp++], bytes, sweep->vaddr, pos, sweep->vaddr);
+    }
+    if (pos >= sweep->len)
+      p = n_patches; // rest was cut off with end of region
+
+    int j = pos < sweep->len ? i0 : sweep->count;
+    while (j < sweep->count && list[j].addr < sweep->vaddr + pos)
+      j++;
+
+    hunk_t *hunk = &(*hunks)[(*n_hunks)++];
+    hunk->from = sweep->count > 0 ? list[i0].addr : sweep->vaddr;
+    hunk->to = sweep->vaddr + (pos < sweep->len ? pos : sweep->len);
+    hunk->removed = j - i0;
+    hunk->added = n_tmp - first;
+    old_first[*n_hunks - 1] = i0;
+    tmp_first[*n_hunks - 1] = first;
+  }
+
+  // Refs & boundaries, note who needs new labels
+  int max_touched = 0;
+  for (int h = 0; h < *n_hunks; h++)
+    max_touched += (*hunks)[h].removed + (*hunks)[h].added;
+  touched = (addr_t *)malloc((max_touched > 0 ? max_touched : 1) * sizeof(addr_t));
+  if (touched == NULL)
+    goto ERR_ALLOC;
+
+  for (int h = 0; h < *n_hunks; h++) {
+    instr_t *removed = &list[old_first[h]], *added = &tmp[tmp_first[h]];
+    int n_removed = (*hunks)[h].removed, n_added = (*hunks)[h].added;
+
+    for (int k = 0; k < n_removed; k++) {
+      long long off = ref_offset(sweep, &removed[k]);
+      if (off >= 0) {
+        sweep->n_refs[off]--;
+        touched[n_touched++] = sweep->vaddr + off;
+      }
+      size_t at = removed[k].addr - sweep->vaddr;
+      sweep->bounds[at / 64] &= ~(1ULL << (at % 64));
+    }
+    for (int k = 0; k < n_added; k++) {
+      long long off = ref_offset(sweep, &added[k]);
+      if (off >= 0) {
+        sweep->n_refs[off]++;
+        touched[n_touched++] = sweep->vaddr + off;
+      }
+      size_t at = added[k].addr - sweep->vaddr;
+      sweep->bounds[at / 64] |= 1ULL << (at % 64);
+    }
+
+    // Boundary came or went under a live ref?
+    for (int k = 0; k < n_removed && !rescan; k++) {
+      size_t at = removed[k].addr - sweep->vaddr;
+      rescan = sweep->n_refs[at] > 0 && !test_bit(sweep->bounds, at);
+    }
+    for (int k = 0, r = 0; k < n_added && !rescan; k++) {
+      while (r < n_removed && removed[r].addr < added[k].addr)
+        r++;
+      bool was_bound = r < n_removed && removed[r].addr == added[k].addr;
+      rescan = !was_bound && sweep->n_refs[added[k].addr - sweep->vaddr] > 0;
+    }
+  }
+
+  // Splice, every kept run moves at most once: left-moving runs front to
+  // back, then right-moving ones back to front, so none overwrites another
+  int *shift = old_first; // done with old indices once first is set
+  for (int h = 0, sum = 0; h < *n_hunks; h++) {
+    (*hunks)[h].first = old_first[h] + sum;
+    sum += (*hunks)[h].added - (*hunks)[h].removed;
+    shift[h] = sum; // of run after hunk h
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 0; k < *n_hunks; k++) {
+      int h = pass == 0 ? k : *n_hunks - 1 - k;
+      if (pass == 0 ? shift[h] >= 0 : shift[h] <= 0)
+        continue;
+      int from = (*hunks)[h].first - (shift[h] - (*hunks)[h].added + (*hunks)[h].removed) + (*hunks)[h].removed;
+      int to = h + 1 < *n_hunks ? (*hunks)[h + 1].first - shift[h] : sweep->count;
+      memmove(&list[from + shift[h]], &list[from], (to - from) * sizeof(instr_t));
+    }
+  }
+  for (int h = 0; h < *n_hunks; h++)
+    memcpy(&list[(*hunks)[h].first], &tmp[tmp_first[h]], (*hunks)[h].added * sizeof(instr_t));
+  if (*n_hunks > 0)
+    sweep->count += shift[*n_hunks - 1];
+
+  // Labels & notes
+  for (int h = 0; h < *n_hunks; h++) {
+    int first = (*hunks)[h].first, next = first + (*hunks)[h].added;
+    annotate(sweep, first, next);
+    if (next < sweep->count)
+      relabel(sweep, next); // previous block may end differently
+  }
+  for (int t = 0; t < n_touched; t++) {
+    int k = find_covering(list, sweep->count, touched[t]);
+    if (sweep->count > 0 && list[k].addr == touched[t])
+      relabel(sweep, k);
+  }
+  if (rescan) {
+    for (int i = 0; i < sweep->count; i++)
+      renote(sweep, i);
+  }
+
+  free(old_first);
+  free(tmp_first);
+  free(tmp);
+  free(touched);
+  return 0;
+
+ERR_ALLOC:
+  printf("Could not allocate memory for patches!\n");
+  free(*hunks);
+  *hunks = NULL;
+  free(old_first);
+  free(tmp_first);
+  free(tmp);
+  free(touched);
+  return 1;
+}
+
+/**
+ * Saves sweeps, with bytes they were brought up to date with, so that
+ *  next decode.elf -u needs neither old binary nor its decode
+ *  return => 0 on success
+ */
+int sweep_write(const sweep_t sweeps[], int n_sweeps, FILE *out) {
+  uint32_t header[4] = { SWEEP_MAGIC, SWEEP_VERSION, n_sweeps, sizeof(instr_t) };
+  bool written = fwrite(header, sizeof(header), 1, out) == 1;
+
+  for (int s = 0; written && s < n_sweeps; s++) {
+    const sweep_t *sweep = &sweeps[s];
+    uint64_t info[3] = { sweep->vaddr, sweep->len, sweep->count };
+    size_t words = SCAN_MASK_WORDS(sweep->len) + 1;
+    written = fwrite(sweep->name, SWEEP_NAME_LEN, 1, out) == 1
+           && fwrite(info, sizeof(info), 1, out) == 1
+           && fwrite(sweep->bytes, 1, sweep->len, out) == sweep->len
+           && fwrite(sweep->list, sizeof(instr_t), sweep->count, out) == (size_t)sweep->count
+           && fwrite(sweep->bounds, sizeof(uint64_t), words, out) == words
+           && fwrite(sweep->n_refs, sizeof(int), sweep->len, out) == sweep->len;
+  }
+
+  if (!written) {
+    printf("Could not write sweep cache!\n");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Checks sweep read from cache, list must be a linear sweep of region,
+ *  its strings are terminated & labels point to no names
+ */
+static bool is_valid_sweep(sweep_t *sweep) {
+  size_t n_bounds = 0;
+  for (size_t w = 0; w < SCAN_MASK_WORDS(sweep->len) + 1; w++)
+    n_bounds += __builtin_popcountll(sweep->bounds[w]);
+  if (n_bounds != (size_t)sweep->count)
+    return false;
+
+  addr_t next = sweep->vaddr;
+  for (int i = 0; i < sweep->count; i++) {
+    instr_t *instr = &sweep->list[i];
+    if (instr->addr != next || instr->addr - sweep->vaddr >= sweep->len
+        || instr->len == 0 || instr->len > MAX_INSTR_LEN || !test_bit(sweep->bounds, instr->addr - sweep->vaddr))
+      return false;
+    next = instr->addr + instr->len;
+
+    instr->mnemo_opcode[MNEMO_OPCODE_LEN - 1] = '\0';
+    instr->mnemo_operand[MNEMO_OPERAND_LEN - 1] = '\0';
+    instr->mnemo_notes[MNEMO_NOTES_LEN - 1] = '\0';
+    instr->hex_bytes[HEX_BYTES_LEN - 1] = '\0';
+    instr->label.name = NULL;
+    instr->cf_label.name = NULL;
+  }
+  if (next - sweep->vaddr < sweep->len)
+    return false; // not all of region
+
+  for (size_t i = 0; i < sweep->len; i++) {
+    if (sweep->n_refs[i] < 0)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Loads sweeps saved by sweep_write(), each owns copy of its bytes
+ *  sweeps => malloc'd, free each with sweep_free(), sections are NULL
+ *  return => 0 on success
+ */
+int sweep_read(sweep_t **sweeps, int *n_sweeps, FILE *in) {
+  uint32_t header[4];
+  *sweeps = NULL;
+  *n_sweeps = 0;
+
+  if (fread(header, sizeof(header), 1, in) != 1
+      || header[0] != SWEEP_MAGIC || header[1] != SWEEP_VERSION
+      || header[2] > MAX_SECTIONS || header[3] != sizeof(instr_t)) {
+    printf("Could not read sweep cache, bad header!\n");
+    return 1;
+  }
+
+  *sweeps = (sweep_t *)calloc(header[2] > 0 ? header[2] : 1, sizeof(sweep_t));
+  if (*sweeps == NULL) {
+    printf("Could not allocate memory for sweep cache!\n");
+    return 1;
+  }
+
+  for (uint32_t s = 0; s < header[2]; s++) {
+    sweep_t *sweep = &(*sweeps)[(*n_sweeps)++];
+    uint64_t info[3];
+    if (fread(sweep->name, SWEEP_NAME_LEN, 1, in) != 1 || fread(info, sizeof(info), 1, in) != 1
+        || info[2] > info[1] || info[2] > INT32_MAX) {
+      printf("Could not read sweep cache!\n");
+      goto ERR_FREE;
+    }
+    sweep->name[SWEEP_NAME_LEN - 1] = '\0';
+    sweep->vaddr = info[0];
+    sweep->len = info[1];
+    sweep->count = info[2];
+
+    sweep->data = (byte_t *)malloc(sweep->len > 0 ? sweep->len : 1);
+    if (sweep->data == NULL || sweep_grow(sweep, sweep->len > 0 ? sweep->len : 1)) {
+      printf("Could not allocate memory for sweep cache!\n");
+      goto ERR_FREE;
+    }
+    sweep->bytes = sweep->data;
+
+    size_t words = SCAN_MASK_WORDS(sweep->len) + 1;
+    if (fread(sweep->data, 1, sweep->len, in) != sweep->len
+        || fread(sweep->list, sizeof(instr_t), sweep->count, in) != (size_t)sweep->count
+        || fread(sweep->bounds, sizeof(uint64_t), words, in) != words
+        || fread(sweep->n_refs, sizeof(int), sweep->len, in) != sweep->len) {
+      printf("Could not read sweep cache!\n");
+      goto ERR_FREE;
+    }
+    if (!is_valid_sweep(sweep)) {
+      printf("Could not read sweep cache, corrupted cache!\n");
+      goto ERR_FREE;
+    }
+  }
+  return 0;
+
+ERR_FREE:
+  for (int s = 0; s < *n_sweeps; s++)
+    sweep_free(&(*sweeps)[s]);
+  free(*sweeps);
+  *sweeps = NULL;
+  *n_sweeps = 0;
+  return 1;
+}
@@ -0,0 +1,58 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include "decode.h"
+#include "elf.h"
+
+// Changed bytes of region, offsets [from, to)
+typedef struct {
+  size_t from, to;
+} patch_t;
+
+// Re-decoded run, list[first] - list[first + added - 1] took place of removed instr.
+typedef struct {
+  addr_t from, to; // re-decoded bytes
+  int first;
+  int removed, added;
+} hunk_t;
+
+#define SWEEP_NAME_LEN 64
+
+// Code of a binary swept on its own, an executable section or whole raw file
+typedef struct {
+  const char *name; // "" if not an ELF
+  byte_t *bytes;
+  addr_t vaddr;
+  size_t len;
+} region_t;
+
+// Linear sweep of region, kept current across patches
+typedef struct {
+  char name[SWEEP_NAME_LEN];
+  byte_t *bytes;
+  byte_t *data; // copy of bytes[] owned by sweep, NULL if mapped
+  addr_t vaddr;
+  size_t len;
+  section_t *sections; // for notes, NULL if not an ELF
+  int n_sections;
+
+  instr_t *list; // by addr
+  int count;
+  size_t room;      // list[], bounds & n_refs hold that many bytes of region
+  uint64_t *bounds; // instr. starts
+  int *n_refs;      // jumps & calls to each byte
+} sweep_t;
+
+int get_code_regions(byte_t *bin, size_t fsize, section_t sections[], int n_sections, region_t regions[], int *n_regions);
+
+int sweep_decode(sweep_t *sweep, const char *name, byte_t bytes[], addr_t vaddr, size_t len, section_t sections[], int n_sections);
+void sweep_free(sweep_t *sweep);
+
+int find_patches(const byte_t old[], size_t old_len, const byte_t new[], size_t new_len, patch_t **patches, int *n_patches);
+void sweep_move(sweep_t *sweep, addr_t vaddr);
+int sweep_patch(sweep_t *sweep, byte_t bytes[], size_t len, patch_t patches[], int n_patches, hunk_t **hunks, int *n_hunks);
+
+int sweep_write(const sweep_t sweeps[], int n_sweeps, FILE *out);
+int sweep_read(sweep_t **sweeps, int *n_sweeps, FILE *in);
+
+#endif
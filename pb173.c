@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+#include "decode.h"
+#include "cfg.h"
+#include "elf.h"
+#include "pb173.h"
+
+struct pb173_ctx {
+  pb173_allocator_t allocator;
+  instr_t instr; // scratch for single instr. decoding
+};
+
+// Bounds & targets of one buffer, bit per byte
+typedef struct {
+  const byte_t *bytes;
+  size_t len;
+  uint64_t vaddr;
+  uint64_t *bounds;  // instr. starts
+  uint64_t *targets; // jump/call destinations
+  size_t *work;      // recursive mode worklist
+  size_t n_work, max_work;
+} layout_t;
+
+static void *default_alloc(void *user, size_t size) {
+  (void)user;
+  return malloc(size);
+}
+
+static void default_free(void *user, void *ptr) {
+  (void)user;
+  free(ptr);
+}
+
+static inline void *ctx_alloc(pb173_ctx_t *ctx, size_t size) {
+  return ctx->allocator.alloc(ctx->allocator.user, size > 0 ? size : 1);
+}
+
+static inline void ctx_free(pb173_ctx_t *ctx, void *ptr) {
+  if (ptr != NULL)
+    ctx->allocator.free(ctx->allocator.user, ptr);
+}
+
+static inline bool test_bit(const uint64_t mask[], size_t i) {
+  return (mask[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void set_bit(uint64_t mask[], size_t i) {
+  mask[i / 64] |= 1ULL << (i % 64);
+}
+
+unsigned pb173_version(void) {
+  return PB173_API_VERSION;
+}
+
+const char *pb173_strerror(int status) {
+  switch (status) {
+    case PB173_OK:          return "success";
+    case PB173_ERR_ARG:     return "invalid argument";
+    case PB173_ERR_NOMEM:   return "out of memory";
+    case PB173_ERR_FULL:    return "output buffer is full";
+    case PB173_ERR_NOT_ELF: return "not an x86-64 ELF image with .text";
+    default:                return "unknown error";
+  }
+}
+
+/**
+ * Creates decoder context
+ *  allocator => used for every allocation of this context, NULL for malloc/free
+ *  return => NULL if out of memory
+ */
+pb173_ctx_t *pb173_create(const pb173_allocator_t *allocator) {
+  pb173_allocator_t a = { default_alloc, default_free, NULL };
+  if (allocator != NULL) {
+    if (allocator->alloc == NULL || allocator->free == NULL)
+      return NULL;
+    a = *allocator;
+  }
+
+  pb173_ctx_t *ctx = (pb173_ctx_t *)a.alloc(a.user, sizeof(pb173_ctx_t));
+  if (ctx == NULL)
+    return NULL;
+  memset(ctx, 0, sizeof(pb173_ctx_t));
+  ctx->allocator = a;
+  return ctx;
+}
+
+void pb173_destroy(pb173_ctx_t *ctx) {
+  if (ctx != NULL)
+    ctx->allocator.free(ctx->allocator.user, ctx);
+}
+
+static void layout_free(pb173_ctx_t *ctx, layout_t *l) {
+  ctx_free(ctx, l->bounds);
+  ctx_free(ctx, l->targets);
+  ctx_free(ctx, l->work);
+}
+
+/**
+ * return => PB173_OK, or PB173_ERR_NOMEM
+ */
+static int layout_init(pb173_ctx_t *ctx, layout_t *l, const uint8_t *buf, size_t len, uint64_t vaddr) {
+  size_t size = (len / 64 + 1) * sizeof(uint64_t);
+  memset(l, 0, sizeof(layout_t));
+  l->bytes = buf;
+  l->len = len;
+  l->vaddr = vaddr;
+  l->bounds = (uint64_t *)ctx_alloc(ctx, size);
+  l->targets = (uint64_t *)ctx_alloc(ctx, size);
+  if (l->bounds == NULL || l->targets == NULL) {
+    layout_free(ctx, l);
+    return PB173_ERR_NOMEM;
+  }
+  memset(l->bounds, 0, size);
+  memset(l->targets, 0, size);
+  return PB173_OK;
+}
+
+/**
+ * return => true if dest is within buffer, *pos = its offset
+ */
+static bool in_buffer(const layout_t *l, uint64_t dest, size_t *pos) {
+  if (dest < l->vaddr || dest - l->vaddr >= l->len)
+    return false;
+  *pos = dest - l->vaddr;
+  return true;
+}
+
+/**
+ * Length-only linear sweep, targets are kept only when on a boundary
+ */
+static void layout_linear(layout_t *l) {
+  size_t pos = 0;
+  while (pos < l->len) {
+    flow_t flow;
+    long long rel;
+    int n = decode_length(&l->bytes[pos], l->len - pos, &flow, &rel);
+    set_bit(l->bounds, pos);
+    if (n == 0)
+      break; // truncated
+    pos += n;
+  }
+
+  pos = 0;
+  while (pos < l->len) {
+    flow_t flow;
+    long long rel;
+    size_t dest;
+    int n = decode_length(&l->bytes[pos], l->len - pos, &flow, &rel);
+    if (n == 0)
+      break;
+
+    if ((flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL)
+        && in_buffer(l, l->vaddr + pos + n + rel, &dest) && test_bit(l->bounds, dest))
+      set_bit(l->targets, dest);
+    pos += n;
+  }
+}
+
+static int work_push(pb173_ctx_t *ctx, layout_t *l, size_t pos) {
+  if (l->n_work == l->max_work) {
+    size_t max = l->max_work > 0 ? l->max_work * 2 : 64;
+    size_t *work = (size_t *)ctx_alloc(ctx, max * sizeof(size_t));
+    if (work == NULL)
+      return PB173_ERR_NOMEM;
+    if (l->n_work > 0)
+      memcpy(work, l->work, l->n_work * sizeof(size_t));
+    ctx_free(ctx, l->work);
+    l->work = work;
+    l->max_work = max;
+  }
+  l->work[l->n_work++] = pos;
+  return PB173_OK;
+}
+
+/**
+ * Length-only traversal from entry, same paths as decode() in recursive modes
+ *  Jumps into the middle of an instr. yield overlapping records
+ *  return => PB173_OK, or PB173_ERR_NOMEM
+ */
+static int layout_recursive(pb173_ctx_t *ctx, layout_t *l, size_t entry, bool follow_calls) {
+  int err = work_push(ctx, l, entry);
+  set_bit(l->targets, entry);
+
+  while (err == PB173_OK && l->n_work > 0) {
+    size_t pos = l->work[--l->n_work];
+
+    while (pos < l->len && !test_bit(l->bounds, pos)) {
+      flow_t flow;
+      long long rel;
+      size_t dest;
+      int n = decode_length(&l->bytes[pos], l->len - pos, &flow, &rel);
+      set_bit(l->bounds, pos);
+      if (n == 0)
+        break; // truncated
+
+      if ((flow == FLOW_JCC || flow == FLOW_JMP || (flow == FLOW_CALL && follow_calls))
+          && in_buffer(l, l->vaddr + pos + n + rel, &dest)) {
+        set_bit(l->targets, dest);
+        if (!test_bit(l->bounds, dest) && (err = work_push(ctx, l, dest)) != PB173_OK)
+          break;
+      }
+      if (flow == FLOW_JMP || flow == FLOW_RET || flow == FLOW_IJMP)
+        break;
+      pos += n;
+    }
+  }
+
+  return err;
+}
+
+/**
+ * Decodes instr. at pos into ctx->instr
+ *  return => false if it runs past end of buffer (nothing decoded)
+ */
+static bool decode_at(pb173_ctx_t *ctx, const layout_t *l, size_t pos) {
+  flow_t flow;
+  long long rel;
+  if (decode_length(&l->bytes[pos], l->len - pos, &flow, &rel) == 0)
+    return false;
+
+  // decode_single() reads exactly the bytes decode_length() counted
+  decode_instr(&ctx->instr, (byte_t *)l->bytes, l->vaddr, pos, l->vaddr);
+  return true;
+}
+
+static void fill_record(const layout_t *l, const instr_t *instr, pb173_instr_t *rec) {
+  flow_t flow = get_instr_flow(instr);
+  size_t pos;
+
+  memset(rec, 0, sizeof(pb173_instr_t));
+  rec->addr = instr->addr;
+  rec->len = instr->len;
+  rec->flow = flow; // pb173_flow_t follows flow_t
+  rec->value = instr->value;
+  rec->opcode = instr->has_ext_opcode ? 0x0F00 | instr->opcode : instr->opcode;
+  if (instr->has_modrm)
+    rec->modrm = (instr->modrm.mod << 6) | (instr->modrm.reg << 3) | instr->modrm.rm;
+  if (instr->has_rex)
+    rec->rex = 0x40 | (instr->rex.w << 3) | (instr->rex.r << 2) | (instr->rex.x << 1) | instr->rex.b;
+  if (!strcmp(instr->mnemo_opcode, "unknown"))
+    rec->flags |= PB173_INSTR_UNKNOWN;
+
+  if (flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL) {
+    rec->dest = get_instr_dest(instr);
+    if (in_buffer(l, rec->dest, &pos) && test_bit(l->bounds, pos))
+      rec->flags |= PB173_INSTR_TARGET;
+  }
+  else if (is_instr_rip_relative(instr)) {
+    rec->dest = get_instr_dest(instr);
+    rec->flags |= PB173_INSTR_RIP;
+  }
+}
+
+/**
+ * Decodes buf (mapped at vaddr) into caller-owned records, sorted by addr
+ *  entry => start of recursive modes, ignored in PB173_LINEAR
+ *  Blocks start at entry/first instr., after jumps & returns, at jump/call targets
+ *  return => PB173_OK, PB173_ERR_FULL if max_out records were not enough
+ */
+int pb173_decode(pb173_ctx_t *ctx, const uint8_t *buf, size_t len, uint64_t vaddr,
+                 uint64_t entry, pb173_mode_t mode,
+                 pb173_instr_t out[], size_t max_out, size_t *n_out) {
+  layout_t l;
+  size_t entry_pos = 0;
+  int err;
+
+  if (n_out != NULL)
+    *n_out = 0;
+  if (ctx == NULL || n_out == NULL || (buf == NULL && len > 0) || (out == NULL && max_out > 0))
+    return PB173_ERR_ARG;
+  if (mode != PB173_LINEAR) {
+    if (entry < vaddr || entry - vaddr >= len)
+      return PB173_ERR_ARG;
+    entry_pos = entry - vaddr;
+  }
+
+  if ((err = layout_init(ctx, &l, buf, len, vaddr)) != PB173_OK)
+    return err;
+  if (mode == PB173_LINEAR)
+    layout_linear(&l);
+  else
+    err = layout_recursive(ctx, &l, entry_pos, mode == PB173_RECURSIVE);
+
+  bool block_pending = true;
+  size_t next = 0; // end of previous record
+  for (size_t w = 0; err == PB173_OK && w < len / 64 + 1; w++) {
+    for (uint64_t bits = l.bounds[w]; bits != 0; bits &= bits - 1) {
+      size_t pos = w * 64 + __builtin_ctzll(bits);
+      if (*n_out == max_out) {
+        err = PB173_ERR_FULL;
+        break;
+      }
+
+      pb173_instr_t *rec = &out[(*n_out)++];
+      if (decode_at(ctx, &l, pos)) {
+        fill_record(&l, &ctx->instr, rec);
+      }
+      else {
+        memset(rec, 0, sizeof(pb173_instr_t));
+        rec->addr = vaddr + pos;
+        rec->len = len - pos;
+        rec->flags = PB173_INSTR_UNKNOWN | PB173_INSTR_TRUNCATED;
+      }
+
+      if (block_pending || pos != next || test_bit(l.targets, pos))
+        rec->flags |= PB173_INSTR_BLOCK;
+      block_pending = rec->flow == FLOW_JCC || rec->flow == FLOW_JMP
+          || rec->flow == FLOW_RET || rec->flow == FLOW_IJMP;
+      next = pos + rec->len;
+    }
+  }
+
+  layout_free(ctx, &l);
+  return err;
+}
+
+/**
+ * AT&T text of instr. previously decoded from the same buffer, e.g. "mov %rsp, %rbp"
+ *  return => PB173_OK, text is truncated to size
+ */
+int pb173_format(pb173_ctx_t *ctx, const uint8_t *buf, size_t len, uint64_t vaddr,
+                 const pb173_instr_t *instr, char *text, size_t size) {
+  if (ctx == NULL || buf == NULL || instr == NULL || text == NULL || size == 0
+      || instr->addr < vaddr || instr->addr - vaddr >= len)
+    return PB173_ERR_ARG;
+
+  if (instr->flags & PB173_INSTR_TRUNCATED) {
+    snprintf(text, size, "(bad)");
+    return PB173_OK;
+  }
+
+  layout_t l = { .bytes = buf, .len = len, .vaddr = vaddr };
+  if (!decode_at(ctx, &l, instr->addr - vaddr))
+    return PB173_ERR_ARG;
+
+  if (ctx->instr.mnemo_operand[0] != '\0')
+    snprintf(text, size, "%s %s", ctx->instr.mnemo_opcode, ctx->instr.mnemo_operand);
+  else
+    snprintf(text, size, "%s", ctx->instr.mnemo_opcode);
+  return PB173_OK;
+}
+
+/**
+ * Linear-mode CFG of buf in DOT format, same graph as cfg
+ *  Truncated last instr. is left out
+ *  return => PB173_OK on success
+ */
+int pb173_write_dot(pb173_ctx_t *ctx, const uint8_t *buf, size_t len, uint64_t vaddr, FILE *out) {
+  layout_t l;
+  int err;
+
+  if (ctx == NULL || out == NULL || (buf == NULL && len > 0))
+    return PB173_ERR_ARG;
+  if ((err = layout_init(ctx, &l, buf, len, vaddr)) != PB173_OK)
+    return err;
+  layout_linear(&l);
+
+  size_t count = 0;
+  for (size_t w = 0; w < len / 64 + 1; w++)
+    count += __builtin_popcountll(l.bounds[w]);
+
+  instr_t *list = (instr_t *)ctx_alloc(ctx, count * sizeof(instr_t));
+  if (list == NULL) {
+    layout_free(ctx, &l);
+    return PB173_ERR_NOMEM;
+  }
+
+  // Labels as proc_flow_labels() would place them
+  int n = 0;
+  bool label_pending = true;
+  for (size_t pos = 0; pos < len && decode_at(ctx, &l, pos); pos += list[n++].len) {
+    instr_t *instr = &list[n];
+    *instr = ctx->instr;
+    if (label_pending || test_bit(l.targets, pos))
+      set_label(instr, NULL, vaddr);
+
+    flow_t flow = get_instr_flow(instr);
+    label_pending = flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_RET || flow == FLOW_IJMP;
+    if (flow != FLOW_JCC && flow != FLOW_JMP && flow != FLOW_CALL) {
+      proc_value_note(instr);
+      continue;
+    }
+
+    size_t dest;
+    if (!in_buffer(&l, get_instr_dest(instr), &dest) || !test_bit(l.bounds, dest)) {
+      proc_jump_note(instr, NULL);
+      continue;
+    }
+
+    label_t label = { NULL, vaddr };
+    proc_jump_note(instr, &label);
+  }
+
+  fprintf(out, "digraph G {\n");
+  print_bblocks(out, list, n, NULL);
+  print_arrows(out, list, n);
+  fprintf(out, "}\n");
+
+  ctx_free(ctx, list);
+  layout_free(ctx, &l);
+  return PB173_OK;
+}
+
+/**
+ * Finds .text of ELF image held in memory, nothing is copied
+ *  Malformed section tables are also reported on stdout by the ELF parser
+ *  return => PB173_OK, or PB173_ERR_NOT_ELF
+ */
+int pb173_elf_text(pb173_ctx_t *ctx, const uint8_t *image, size_t size, pb173_text_t *text) {
+  if (ctx == NULL || image == NULL || text == NULL)
+    return PB173_ERR_ARG;
+
+  byte_t *bin = (byte_t *)image;
+  if (!is_elf_file(bin, size) || ((Elf64_Ehdr *)bin)->e_machine != EM_X86_64)
+    return PB173_ERR_NOT_ELF;
+
+  section_t *sections = (section_t *)ctx_alloc(ctx, MAX_SECTIONS * sizeof(section_t));
+  if (sections == NULL)
+    return PB173_ERR_NOMEM;
+
+  int n_sections, err = PB173_ERR_NOT_ELF;
+  uintptr_t entry, vaddr, offset;
+  size_t text_size;
+  if (!get_elf_sections(bin, size, sections, &n_sections)
+      && !get_elf_info(bin, sections, n_sections, &entry, &vaddr, &offset, &text_size)) {
+    text->vaddr = vaddr;
+    text->entry = entry;
+    text->offset = offset;
+    text->size = text_size;
+    err = PB173_OK;
+  }
+
+  ctx_free(ctx, sections);
+  return err;
+}
@@ -0,0 +1,106 @@
+#ifndef PB173_H
+#define PB173_H
+
+/**
+ * libpb173, x86-64 decoder & CFG library
+ *  Reentrant: no global state, every call works on its own context,
+ *  contexts are not shared between threads without external locking
+ *  All memory comes from the allocator passed to pb173_create()
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PB173_API_VERSION 1
+
+#if defined(__GNUC__) && defined(PB173_BUILD)
+#define PB173_API __attribute__((visibility("default")))
+#else
+#define PB173_API
+#endif
+
+typedef struct pb173_ctx pb173_ctx_t; // opaque
+
+typedef struct {
+  void *(*alloc)(void *user, size_t size); // NULL on failure
+  void (*free)(void *user, void *ptr);
+  void *user;
+} pb173_allocator_t;
+
+typedef enum {
+  PB173_OK = 0,
+  PB173_ERR_ARG,     // bad argument
+  PB173_ERR_NOMEM,   // allocator failed
+  PB173_ERR_FULL,    // out[] too small, *n_out = records written
+  PB173_ERR_NOT_ELF, // not a 64-bit x86-64 ELF, or no .text
+} pb173_status_t;
+
+typedef enum {
+  PB173_FLOW_NONE,
+  PB173_FLOW_JCC,  // conditional rel. jump
+  PB173_FLOW_JMP,  // unconditional rel. jump
+  PB173_FLOW_CALL, // rel. call
+  PB173_FLOW_RET,
+  PB173_FLOW_IJMP  // indirect jump
+} pb173_flow_t;
+
+typedef enum {
+  PB173_LINEAR,    // every byte of buffer
+  PB173_RECURSIVE, // reachable from entry, following jumps & calls
+  PB173_FUNCTION   // recursive, but calls are not followed
+} pb173_mode_t;
+
+// pb173_instr_t.flags
+#define PB173_INSTR_UNKNOWN   0x01 // opcode not supported by the decoder
+#define PB173_INSTR_BLOCK     0x02 // starts a basic block
+#define PB173_INSTR_TARGET    0x04 // dest is an instr. within buffer
+#define PB173_INSTR_RIP       0x08 // has disp32(%rip) operand, dest is its address
+#define PB173_INSTR_TRUNCATED 0x10 // runs past end of buffer, len = bytes left
+
+// Compact decoded instr., 32 bytes
+typedef struct {
+  uint64_t addr;
+  uint64_t dest;   // jump/call target or rip-relative address, 0 if none
+  int64_t value;   // immediate or displacement
+  uint16_t opcode; // 0x0Fxx for two-byte opcodes
+  uint8_t len;
+  uint8_t flow;    // pb173_flow_t
+  uint8_t flags;   // PB173_INSTR_*
+  uint8_t modrm;   // raw ModR/M byte, 0 if none
+  uint8_t rex;     // raw REX byte, 0 if none
+  uint8_t reserved;
+} pb173_instr_t;
+
+// .text of ELF image held in memory
+typedef struct {
+  uint64_t vaddr;
+  uint64_t entry;
+  size_t offset; // of .text within image
+  size_t size;
+} pb173_text_t;
+
+PB173_API unsigned pb173_version(void);
+PB173_API const char *pb173_strerror(int status);
+
+PB173_API pb173_ctx_t *pb173_create(const pb173_allocator_t *allocator);
+PB173_API void pb173_destroy(pb173_ctx_t *ctx);
+
+PB173_API int pb173_decode(pb173_ctx_t *ctx, const uint8_t *buf, size_t len, uint64_t vaddr,
+                           uint64_t entry, pb173_mode_t mode,
+                           pb173_instr_t out[], size_t max_out, size_t *n_out);
+PB173_API int pb173_format(pb173_ctx_t *ctx, const uint8_t *buf, size_t len, uint64_t vaddr,
+                           const pb173_instr_t *instr, char *text, size_t size);
+PB173_API int pb173_write_dot(pb173_ctx_t *ctx, const uint8_t *buf, size_t len, uint64_t vaddr, FILE *out);
+
+PB173_API int pb173_elf_text(pb173_ctx_t *ctx, const uint8_t *image, size_t size, pb173_text_t *text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
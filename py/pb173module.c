@@ -0,0 +1,359 @@
+/**
+ * pb173 Python module, decoder over any buffer-protocol object
+ *  >>> import mmap, pb173
+ *  >>> data = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+ *  >>> vaddr, entry, offset, size = pb173.elf_text(data)
+ *  >>> instrs = pb173.decode(memoryview(data)[offset:offset + size], vaddr)
+ *  >>> numpy.asarray(instrs)['addr']  # structured array, no copy
+ *  Source buffer is held (not copied) until the result is freed
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include "../pb173.h"
+
+// PEP 3118 layout of pb173_instr_t, numpy reads it as a structured dtype
+#define INSTR_FORMAT "T{<Q:addr:<Q:dest:<q:value:<H:opcode:B:len:B:flow:B:flags:B:modrm:B:rex:x}"
+
+typedef struct {
+  PyObject_HEAD
+  Py_buffer src;          // decoded bytes, held for text()
+  pb173_instr_t *instr;
+  Py_ssize_t count;
+  unsigned long long vaddr;
+  Py_ssize_t shape[1];
+  Py_ssize_t strides[1];
+} instrs_t;
+
+static PyTypeObject InstrsType;
+static PyTypeObject InstrType;
+
+static PyStructSequence_Field instr_fields[] = {
+  { "addr", NULL }, { "len", NULL }, { "flow", NULL }, { "flags", NULL },
+  { "opcode", NULL }, { "dest", NULL }, { "value", NULL },
+  { "modrm", NULL }, { "rex", NULL },
+  { NULL, NULL }
+};
+
+static PyStructSequence_Desc instr_desc = {
+  "pb173.Instr", "Single decoded instruction", instr_fields, 9
+};
+
+static void *raw_alloc(void *user, size_t size) {
+  (void)user;
+  return PyMem_RawMalloc(size);
+}
+
+static void raw_free(void *user, void *ptr) {
+  (void)user;
+  PyMem_RawFree(ptr);
+}
+
+// PyMem_Raw* need no GIL, decoding runs without it
+static const pb173_allocator_t allocator = { raw_alloc, raw_free, NULL };
+
+static void instrs_dealloc(instrs_t *self) {
+  PyMem_RawFree(self->instr);
+  if (self->src.obj != NULL)
+    PyBuffer_Release(&self->src);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t instrs_len(instrs_t *self) {
+  return self->count;
+}
+
+/**
+ * Builds Instr on access, the records themselves stay packed
+ */
+static PyObject *instrs_item(instrs_t *self, Py_ssize_t i) {
+  if (i < 0 || i >= self->count) {
+    PyErr_SetString(PyExc_IndexError, "instruction index out of range");
+    return NULL;
+  }
+
+  const pb173_instr_t *rec = &self->instr[i];
+  PyObject *item = PyStructSequence_New(&InstrType);
+  if (item == NULL)
+    return NULL;
+
+  PyObject *values[] = {
+    PyLong_FromUnsignedLongLong(rec->addr), PyLong_FromLong(rec->len),
+    PyLong_FromLong(rec->flow), PyLong_FromLong(rec->flags),
+    PyLong_FromLong(rec->opcode), PyLong_FromUnsignedLongLong(rec->dest),
+    PyLong_FromLongLong(rec->value),
+    PyLong_FromLong(rec->modrm), PyLong_FromLong(rec->rex),
+  };
+  for (int j = 0; j < 9; j++) {
+    if (values[j] == NULL) {
+      for (int k = j + 1; k < 9; k++)
+        Py_XDECREF(values[k]);
+      Py_DECREF(item);
+      return NULL;
+    }
+    PyStructSequence_SET_ITEM(item, j, values[j]);
+  }
+  return item;
+}
+
+/**
+ * instrs[i] or instrs[a:b:c], slices are lists of Instr
+ */
+static PyObject *instrs_subscript(instrs_t *self, PyObject *key) {
+  if (PyIndex_Check(key)) {
+    Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+    if (i == -1 && PyErr_Occurred())
+      return NULL;
+    return instrs_item(self, i < 0 ? i + self->count : i);
+  }
+  if (!PySlice_Check(key)) {
+    PyErr_SetString(PyExc_TypeError, "instruction index must be integer or slice");
+    return NULL;
+  }
+
+  Py_ssize_t start, stop, step;
+  if (PySlice_Unpack(key, &start, &stop, &step) < 0)
+    return NULL;
+  Py_ssize_t n = PySlice_AdjustIndices(self->count, &start, &stop, step);
+  PyObject *list = PyList_New(n);
+  if (list == NULL)
+    return NULL;
+  for (Py_ssize_t i = 0; i < n; i++) {
+    PyObject *item = instrs_item(self, start + i * step);
+    if (item == NULL) {
+      Py_DECREF(list);
+      return NULL;
+    }
+    PyList_SET_ITEM(list, i, item);
+  }
+  return list;
+}
+
+static int instrs_getbuffer(instrs_t *self, Py_buffer *view, int flags) {
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "instructions are read-only");
+    return -1;
+  }
+
+  view->obj = (PyObject *)self;
+  Py_INCREF(self);
+  view->buf = self->instr;
+  view->len = self->count * sizeof(pb173_instr_t);
+  view->readonly = 1;
+  view->itemsize = sizeof(pb173_instr_t);
+  view->format = (flags & PyBUF_FORMAT) ? INSTR_FORMAT : NULL;
+  view->ndim = 1;
+  view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+  view->strides = (flags & PyBUF_STRIDES) ? self->strides : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+  return 0;
+}
+
+static PyObject *instrs_text(instrs_t *self, PyObject *arg) {
+  Py_ssize_t i = PyLong_AsSsize_t(arg);
+  if (i == -1 && PyErr_Occurred())
+    return NULL;
+  if (i < 0 || i >= self->count) {
+    PyErr_SetString(PyExc_IndexError, "instruction index out of range");
+    return NULL;
+  }
+
+  char text[128];
+  pb173_ctx_t *ctx = pb173_create(&allocator);
+  if (ctx == NULL)
+    return PyErr_NoMemory();
+  int err = pb173_format(ctx, self->src.buf, self->src.len, self->vaddr, &self->instr[i], text, sizeof(text));
+  pb173_destroy(ctx);
+
+  if (err != PB173_OK) {
+    PyErr_SetString(PyExc_ValueError, pb173_strerror(err));
+    return NULL;
+  }
+  return PyUnicode_FromString(text);
+}
+
+static PyMethodDef instrs_methods[] = {
+  { "text", (PyCFunction)instrs_text, METH_O, "text(i) -> AT&T text of i-th instruction" },
+  { NULL }
+};
+
+static PyMemberDef instrs_members[] = {
+  { "vaddr", T_ULONGLONG, offsetof(instrs_t, vaddr), READONLY, "address of first byte" },
+  { NULL }
+};
+
+static PySequenceMethods instrs_as_sequence = {
+  .sq_length = (lenfunc)instrs_len,
+  .sq_item = (ssizeargfunc)instrs_item,
+};
+
+static PyMappingMethods instrs_as_mapping = {
+  .mp_length = (lenfunc)instrs_len,
+  .mp_subscript = (binaryfunc)instrs_subscript,
+};
+
+static PyBufferProcs instrs_as_buffer = {
+  .bf_getbuffer = (getbufferproc)instrs_getbuffer,
+};
+
+static PyTypeObject InstrsType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "pb173.Instructions",
+  .tp_doc = "Packed decoded instructions, a sequence of Instr and a buffer of DTYPE records",
+  .tp_basicsize = sizeof(instrs_t),
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor)instrs_dealloc,
+  .tp_as_sequence = &instrs_as_sequence,
+  .tp_as_mapping = &instrs_as_mapping,
+  .tp_as_buffer = &instrs_as_buffer,
+  .tp_methods = instrs_methods,
+  .tp_members = instrs_members,
+};
+
+static PyObject *raise_status(int err) {
+  if (err == PB173_ERR_NOMEM)
+    return PyErr_NoMemory();
+  PyErr_SetString(PyExc_ValueError, pb173_strerror(err));
+  return NULL;
+}
+
+static PyObject *pb173_py_decode(PyObject *module, PyObject *args, PyObject *kwargs) {
+  static char *keywords[] = { "data", "vaddr", "entry", "mode", NULL };
+  unsigned long long vaddr = 0;
+  PyObject *entry_obj = Py_None;
+  const char *mode_name = "linear";
+  pb173_mode_t mode;
+
+  instrs_t *self = PyObject_New(instrs_t, &InstrsType);
+  if (self == NULL)
+    return NULL;
+  self->instr = NULL;
+  self->count = 0;
+  self->src.obj = NULL;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|KOs", keywords,
+                                   &self->src, &vaddr, &entry_obj, &mode_name))
+    goto ERR_FREE;
+
+  if (!strcmp(mode_name, "linear"))
+    mode = PB173_LINEAR;
+  else if (!strcmp(mode_name, "recursive"))
+    mode = PB173_RECURSIVE;
+  else if (!strcmp(mode_name, "function"))
+    mode = PB173_FUNCTION;
+  else {
+    PyErr_SetString(PyExc_ValueError, "mode must be 'linear', 'recursive' or 'function'");
+    goto ERR_FREE;
+  }
+
+  unsigned long long entry = vaddr;
+  if (entry_obj != Py_None && (entry = PyLong_AsUnsignedLongLong(entry_obj)) == (unsigned long long)-1
+      && PyErr_Occurred())
+    goto ERR_FREE;
+
+  // Room for one record per byte, unused part is given back below
+  size_t len = self->src.len, n = 0;
+  self->vaddr = vaddr;
+  self->instr = (pb173_instr_t *)PyMem_RawMalloc((len > 0 ? len : 1) * sizeof(pb173_instr_t));
+  pb173_ctx_t *ctx = pb173_create(&allocator);
+  if (self->instr == NULL || ctx == NULL) {
+    pb173_destroy(ctx);
+    PyErr_NoMemory();
+    goto ERR_FREE;
+  }
+
+  int err;
+  Py_BEGIN_ALLOW_THREADS
+  err = pb173_decode(ctx, self->src.buf, len, vaddr, entry, mode, self->instr, len, &n);
+  Py_END_ALLOW_THREADS
+  pb173_destroy(ctx);
+  if (err != PB173_OK) {
+    raise_status(err);
+    goto ERR_FREE;
+  }
+
+  pb173_instr_t *shrunk = (pb173_instr_t *)PyMem_RawRealloc(self->instr, (n > 0 ? n : 1) * sizeof(pb173_instr_t));
+  if (shrunk != NULL)
+    self->instr = shrunk;
+  self->count = n;
+  self->shape[0] = n;
+  self->strides[0] = sizeof(pb173_instr_t);
+  return (PyObject *)self;
+
+ERR_FREE:
+  Py_DECREF(self);
+  return NULL;
+}
+
+static PyObject *pb173_py_elf_text(PyObject *module, PyObject *arg) {
+  Py_buffer image;
+  pb173_text_t text;
+
+  if (PyObject_GetBuffer(arg, &image, PyBUF_SIMPLE) < 0)
+    return NULL;
+
+  pb173_ctx_t *ctx = pb173_create(&allocator);
+  int err = ctx != NULL ? pb173_elf_text(ctx, image.buf, image.len, &text) : PB173_ERR_NOMEM;
+  pb173_destroy(ctx);
+  PyBuffer_Release(&image);
+
+  if (err != PB173_OK)
+    return raise_status(err);
+  return Py_BuildValue("(KKnn)", (unsigned long long)text.vaddr, (unsigned long long)text.entry,
+                       (Py_ssize_t)text.offset, (Py_ssize_t)text.size);
+}
+
+static PyMethodDef pb173_methods[] = {
+  { "decode", (PyCFunction)(void (*)(void))pb173_py_decode, METH_VARARGS | METH_KEYWORDS,
+    "decode(data, vaddr=0, entry=vaddr, mode='linear') -> Instructions\n"
+    "data is any buffer (bytes, mmap, memoryview), it is not copied" },
+  { "elf_text", pb173_py_elf_text, METH_O,
+    "elf_text(image) -> (vaddr, entry, offset, size) of .text" },
+  { NULL }
+};
+
+static struct PyModuleDef pb173_module = {
+  PyModuleDef_HEAD_INIT, "pb173", "x86-64 decoder", -1, pb173_methods
+};
+
+PyMODINIT_FUNC PyInit_pb173(void) {
+  if (PyType_Ready(&InstrsType) < 0)
+    return NULL;
+  if (InstrType.tp_name == NULL && PyStructSequence_InitType2(&InstrType, &instr_desc) < 0)
+    return NULL;
+
+  PyObject *m = PyModule_Create(&pb173_module);
+  if (m == NULL)
+    return NULL;
+
+  // numpy.frombuffer(instrs, dtype=pb173.DTYPE)
+  PyObject *dtype = Py_BuildValue("[(ss)(ss)(ss)(ss)(ss)(ss)(ss)(ss)(ss)(ss)]",
+                                  "addr", "<u8", "dest", "<u8", "value", "<i8", "opcode", "<u2",
+                                  "len", "u1", "flow", "u1", "flags", "u1", "modrm", "u1",
+                                  "rex", "u1", "reserved", "u1");
+  Py_INCREF(&InstrsType);
+  Py_INCREF(&InstrType);
+  if (dtype == NULL
+      || PyModule_AddObject(m, "DTYPE", dtype) < 0
+      || PyModule_AddObject(m, "Instructions", (PyObject *)&InstrsType) < 0
+      || PyModule_AddObject(m, "Instr", (PyObject *)&InstrType) < 0
+      || PyModule_AddIntConstant(m, "FLOW_NONE", PB173_FLOW_NONE) < 0
+      || PyModule_AddIntConstant(m, "FLOW_JCC", PB173_FLOW_JCC) < 0
+      || PyModule_AddIntConstant(m, "FLOW_JMP", PB173_FLOW_JMP) < 0
+      || PyModule_AddIntConstant(m, "FLOW_CALL", PB173_FLOW_CALL) < 0
+      || PyModule_AddIntConstant(m, "FLOW_RET", PB173_FLOW_RET) < 0
+      || PyModule_AddIntConstant(m, "FLOW_IJMP", PB173_FLOW_IJMP) < 0
+      || PyModule_AddIntConstant(m, "INSTR_UNKNOWN", PB173_INSTR_UNKNOWN) < 0
+      || PyModule_AddIntConstant(m, "INSTR_BLOCK", PB173_INSTR_BLOCK) < 0
+      || PyModule_AddIntConstant(m, "INSTR_TARGET", PB173_INSTR_TARGET) < 0
+      || PyModule_AddIntConstant(m, "INSTR_RIP", PB173_INSTR_RIP) < 0
+      || PyModule_AddIntConstant(m, "INSTR_TRUNCATED", PB173_INSTR_TRUNCATED) < 0) {
+    Py_DECREF(m);
+    return NULL;
+  }
+
+  return m;
+}
@@ -274,6 +274,38 @@ __TESTS_SINGLE_INSTR_BASIC = [
     ("48 8B 48 1A",         r"mov 0x1a(%rax), %rcx"),
     ("48 8B 82 23 01 00 00",r"mov 0x123(%rdx), %rax"),
     ("49 8B 82 23 01 00 00",r"mov 0x123(%r10), %rax"), # rex.b
+
+    #
+    # ADD
+    #
+    # reg/mem64,reg64     direct     mod = 0b11
+    ("01 C2",               r"add %eax, %edx"),
+    ("48 01 D0",            r"add %rdx, %rax"),
+    ("49 01 D0",            r"add %rdx, %r8"), # rex.b
+    # reg/mem64,reg64     indirect   mod < 0b11
+    ("48 01 40 1A",         r"add %rax, 0x1a(%rax)"),
+    ("48 01 05 12 34 56 78",r"add %rax, 0x78563412(%rip)"),
+    # reg64,reg/mem64
+    ("48 03 C2",            r"add %rdx, %rax"),
+    ("48 03 04 24",         r"add 0x0(%rsp), %rax"),
+    ("4C 03 82 23 01 00 00",r"add 0x123(%rdx), %r8"), # rex.r
+
+    #
+    # MOVSXD
+    #
+    ("48 63 C1",            r"movslq %ecx, %rax"),
+    ("4C 63 C1",            r"movslq %ecx, %r8"), # rex.r
+    ("48 63 04 82",         r"movslq 0x0(%rdx,%rax,4), %rax"), # SIB
+    ("49 63 04 82",         r"movslq 0x0(%r10,%rax,4), %rax"), # rex.b
+
+    #
+    # LEA
+    #
+    ("48 8D 05 00 00 00 00",r"lea 0x0(%rip), %rax"),
+    ("48 8D 15 12 34 56 78",r"lea 0x78563412(%rip), %rdx"),
+    ("48 8D 44 24 08",      r"lea 0x8(%rsp), %rax"),
+    ("8D 04 76",            r"lea 0x0(%rsi,%rsi,2), %eax"),
+    ("48 8D 04 B5 00 00 00 00",r"lea 0x0(,%rsi,4), %rax"), # no base
 ]
 
 __TESTS_SINGLE_INSTR_NEGATIVE = [
@@ -0,0 +1,126 @@
+import subprocess, os, json, tempfile
+
+__DIR = os.path.dirname(__file__)
+__BIN = __DIR + "/../../"
+
+# Fixed .text address, listings do not depend on linker defaults
+__GCC_ARG = ["-static", "-Wl,-Ttext=0x401000", "-Wl,--build-id=none"]
+__GCC_ARG_HIGH = ["-static", "-Wl,-Ttext=0xffffffff81000000", "-Wl,--build-id=none"]
+
+#
+# (asm files, gcc args, command, expected txt)
+#  {0}, {1}, .. => ELF of each asm file
+#  {tmp}        => scratch dir, kept for all test-cases
+#  jsonl output must also parse line by line
+#
+__TESTS = [
+    (["/hw6/xref.s"], __GCC_ARG, "recfun -x {0}", "/hw6/xref.txt"),
+    (["/hw6/xref.s"], __GCC_ARG, "recfun --xref-out={tmp}/xref.idx {0}", "/hw6/xref.txt"),
+    (["/hw6/xref.s"], __GCC_ARG, "recfun --xref-in={tmp}/xref.idx {0}", "/hw6/xref.txt"),
+    (["/hw6/order.s"], __GCC_ARG_HIGH, "recfun {0}", "/hw6/order.txt"),
+    (["/hw6/order.s"], __GCC_ARG_HIGH, "recfun -e {0}", "/hw6/order.txt"),
+    (["/hw6/order.s"], __GCC_ARG_HIGH, "recfun -f {0}", "/hw6/order.txt"),
+    (["/hw6/broken.s"], __GCC_ARG_HIGH, "recfun {0}", "/hw6/broken.txt"),
+    (["/hw6/jtab.s"], __GCC_ARG, "recfun {0}", "/hw6/jtab.txt"),
+    (["/hw6/jtab.s"], __GCC_ARG, "recfun -e {0}", "/hw6/jtab.txt"),
+    (["/hw6/jtab.s"], __GCC_ARG, "recfun -f {0}", "/hw6/jtab.txt"),
+    (["/hw6/jtab.s"], __GCC_ARG, "cfg.elf {0}", "/hw6/jtab_cfg.txt"),
+    (["/hw6/jtab.s"], __GCC_ARG, "cfg.elf -f {0}", "/hw6/jtab_cfg_f.txt"),
+    (["/hw6/patch_old.s", "/hw6/patch_new.s"], __GCC_ARG, "decode.elf -u {0} {1}", "/hw6/patch.txt"),
+    (["/hw6/patch_old.s", "/hw6/patch_new.s"], __GCC_ARG, "decode.elf -u {1} {0}", "/hw6/unpatch.txt"),
+    (["/hw6/fdiff_old.s", "/hw6/fdiff_new.s"], __GCC_ARG, "fdiff {0} {1} 2>&1", "/hw6/fdiff.txt"),
+    (["/hw6/fdiff_old.s"], __GCC_ARG, "fdiff -i {0} 2>&1", "/hw6/fdiff_i.txt"),
+    (["/hw6/jsonl.s"], __GCC_ARG, "recfun -x --format=jsonl {0}", "/hw6/jsonl_recfun.txt"),
+    (["/hw6/jsonl.s"], __GCC_ARG, "recfun -f --format=jsonl {0}", "/hw6/jsonl_recfun_f.txt"),
+    (["/hw6/jsonl.s"], __GCC_ARG, "decode.elf --format=jsonl {0}", "/hw6/jsonl_decode.txt"),
+    (["/hw6/jsonl.s"], __GCC_ARG, "cfg.elf -l --format=jsonl {0}", "/hw6/jsonl_cfg.txt"),
+    (["/hw6/patch_old.s", "/hw6/patch_new.s"], __GCC_ARG, "decode.elf --format=jsonl -u {0} {1}", "/hw6/jsonl_patch.txt"),
+    (["/hw6/shift_old.s", "/hw6/shift_new.s"], __GCC_ARG, "decode.elf -u {0} {1} 2>&1", "/hw6/shift.txt"),
+    (["/hw6/shift_old.s"], __GCC_ARG, "decode.elf --sweep-out={tmp}/shift.swp {0}", "/hw6/shift_full.txt"),
+    (["/hw6/shift_old.s", "/hw6/shift_new.s"], __GCC_ARG, "decode.elf --sweep-in={tmp}/shift.swp --sweep-out={tmp}/shift.swp {1} 2>&1", "/hw6/shift.txt"),
+    (["/hw6/shift_old.s", "/hw6/shift_new.s"], __GCC_ARG, "decode.elf --sweep-in={tmp}/shift.swp {1} 2>&1", "/hw6/shift_same.txt")
+]
+
+#
+# (asm files, gcc args, command, full command)
+#  instr. lines of command must read as in output of full command, in order
+#
+__TESTS_WITHIN = [
+    (["/hw6/patch_old.s", "/hw6/patch_new.s"], __GCC_ARG, "decode.elf -u {0} {1}", "decode.elf {1}"),
+    (["/hw6/patch_old.s", "/hw6/patch_new.s"], __GCC_ARG, "decode.elf -u {1} {0}", "decode.elf {0}"),
+    (["/hw6/patch_old.s", "/hw6/patch_new.s"], __GCC_ARG, "decode.elf --sweep-out={tmp}/patch.swp {0}", "decode.elf {0}"),
+    (["/hw6/patch_old.s", "/hw6/patch_new.s"], __GCC_ARG, "decode.elf --sweep-in={tmp}/patch.swp {1}", "decode.elf {1}")
+]
+
+def asm2elf(asmfile, gcc_arg):
+    out = asmfile.replace(".s", ".out")
+
+    arg = ["gcc", asmfile, "-o", out, "-nostdlib"]
+    if len(gcc_arg) > 0:
+        arg += gcc_arg
+
+    subprocess.run(arg)
+    if os.path.isfile(out):
+        return out
+
+def check_jsonl(lines):
+    for line in lines:
+        if len(line.strip()) == 0:
+            continue
+        try:
+            json.loads(line)
+        except ValueError:
+            return line
+
+def run():
+    with tempfile.TemporaryDirectory() as tmp:
+        if run_tests(tmp):
+            print("All tests completed SUCCESSFULLY!")
+
+def instr_lines(cmd):
+    lines = subprocess.check_output(cmd, shell=True).decode("ascii").split("\n")
+    return [line.strip() for line in lines if line.strip().startswith("0x")]
+
+def run_tests(tmp):
+    for (paths, gcc_arg, cmd, txt) in __TESTS:
+        # Cvt
+        test_files = [asm2elf(__DIR + path, gcc_arg) for path in paths]
+        cmd = __BIN + cmd.format(*test_files, tmp=tmp)
+
+        f = open(__DIR + txt, "r")
+        expected = ''.join(map(str.strip, f.readlines()))
+        f.close()
+
+        lines = subprocess.check_output(cmd, shell=True).decode("ascii").split("\n")
+        result = ''.join(map(str.strip, lines))
+
+        if "--format=jsonl" in cmd:
+            bad = check_jsonl(lines)
+            if bad is not None:
+                print("Test-case " + cmd + " failed, not JSON:")
+                print(bad)
+                return False
+
+        if result != expected:
+            print("Test-case " + cmd + " failed!")
+            print(result)
+            print("~~~~~~~~~~~~~~~")
+            print(expected)
+            return False
+
+    for (paths, gcc_arg, cmd, full_cmd) in __TESTS_WITHIN:
+        test_files = [asm2elf(__DIR + path, gcc_arg) for path in paths]
+        cmd = __BIN + cmd.format(*test_files, tmp=tmp)
+        full_cmd = __BIN + full_cmd.format(*test_files, tmp=tmp)
+
+        full = iter(instr_lines(full_cmd))
+        for line in instr_lines(cmd):
+            if line not in full:
+                print("Test-case " + cmd + " failed, differs from " + full_cmd + ":")
+                print(line)
+                return False
+
+    return True
+
+if __name__== "__main__":
+    run()
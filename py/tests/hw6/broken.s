@@ -0,0 +1,13 @@
+#
+# Jumps past end of .text, far above 2^63
+#  destinations print unsigned
+#
+.globl _start
+.type _start, @function
+_start:
+    cmp %rax, %rdi
+    je .out
+    jmp _start + 0x100000
+.out:
+    call _start + 0x200000
+    ret
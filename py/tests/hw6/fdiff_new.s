@@ -0,0 +1,72 @@
+#
+# New build of fdiff_old.s, functions moved by added code
+#
+.globl _start
+.type _start, @function
+_start:
+    call added
+    call keep
+    call change
+    call rename_new
+    call twin_a
+    call twin_b
+    ret
+
+.globl added
+.type added, @function
+added:
+    push %rdx
+    mov %rdi, %rdx
+    mov %rdx, %rax
+    pop %rdx
+    ret
+
+.globl keep
+.type keep, @function
+keep:
+    push %rbx
+    mov %rdi, %rbx
+    cmp %rbx, %rax
+    je .keep_out
+    mov %rbx, %rax
+.keep_out:
+    pop %rbx
+    ret
+
+.globl change
+.type change, @function
+change:
+    mov %rdi, %rax
+    cmp %rsi, %rax
+    je .change_out
+    push %rsi
+    pop %rax
+.change_out:
+    ret
+
+.globl rename_new
+.type rename_new, @function
+rename_new:
+    push %rbp
+    mov %rsp, %rbp
+    mov %rdx, %rax
+    pop %rbp
+    ret
+
+.globl twin_a
+.type twin_a, @function
+twin_a:
+    push %rcx
+    mov %rsi, %rcx
+    mov %rcx, %rax
+    pop %rcx
+    ret
+
+.globl twin_b
+.type twin_b, @function
+twin_b:
+    push %rcx
+    mov %rsi, %rcx
+    mov %rcx, %rax
+    pop %rcx
+    ret
@@ -0,0 +1,69 @@
+#
+# Old build, fdiff_new.s keeps, changes, renames & removes functions
+#  twin_a & twin_b are identical code
+#
+.globl _start
+.type _start, @function
+_start:
+    call keep
+    call change
+    call rename_old
+    call gone
+    call twin_a
+    call twin_b
+    ret
+
+.globl keep
+.type keep, @function
+keep:
+    push %rbx
+    mov %rdi, %rbx
+    cmp %rbx, %rax
+    je .keep_out
+    mov %rbx, %rax
+.keep_out:
+    pop %rbx
+    ret
+
+.globl change
+.type change, @function
+change:
+    mov %rdi, %rax
+    cmp %rsi, %rax
+    jne .change_out
+    mov %rsi, %rax
+.change_out:
+    ret
+
+.globl rename_old
+.type rename_old, @function
+rename_old:
+    push %rbp
+    mov %rsp, %rbp
+    mov %rdx, %rax
+    pop %rbp
+    ret
+
+.globl gone
+.type gone, @function
+gone:
+    mov %rcx, %rax
+    ret
+
+.globl twin_a
+.type twin_a, @function
+twin_a:
+    push %rcx
+    mov %rsi, %rcx
+    mov %rcx, %rax
+    pop %rcx
+    ret
+
+.globl twin_b
+.type twin_b, @function
+twin_b:
+    push %rcx
+    mov %rsi, %rcx
+    mov %rcx, %rax
+    pop %rcx
+    ret
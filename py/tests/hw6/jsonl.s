@@ -0,0 +1,22 @@
+#
+# Loop for cfg.elf -l, symbol name with a backslash JSON has to escape
+#
+.globl _start
+.type _start, @function
+_start:
+    mov %rdi, %rcx
+.loop:
+    cmp %rcx, %rax
+    je .out
+    call .Lodd
+    jmp .loop
+.out:
+    ret
+
+.globl "odd\\path fn"
+.type "odd\\path fn", @function
+"odd\\path fn":
+.Lodd:
+    push %rax
+    pop %rax
+    ret
@@ -0,0 +1,71 @@
+#
+# Switch jump tables, 32b entries rel. to table
+#  bounded => cmp/ja gives 3 entries, 4th is never read
+#  unbounded => no cmp/ja, table ends at entry within an instr.
+#  decoy => lea loads other register than jmp uses, no table
+#
+.globl _start
+.type _start, @function
+_start:
+    call bounded
+    call unbounded
+    call decoy
+    ret
+
+.globl bounded
+.type bounded, @function
+bounded:
+    cmp $2, %rdi
+    ja .b_default
+    lea .Lb_tab(%rip), %rdx
+    movslq (%rdx,%rdi,4), %rax
+    add %rdx, %rax
+    jmp *%rax
+.b_0:
+    mov %rsi, %rax
+    ret
+.b_1:
+    push %rsi
+    pop %rax
+    ret
+.b_2:
+    mov %rdx, %rax
+    ret
+.b_default:
+    mov %rdi, %rax
+    ret
+
+.globl unbounded
+.type unbounded, @function
+unbounded:
+    lea .Lu_tab(%rip), %rcx
+    mov %rdi, %rax
+    movslq (%rcx,%rax,4), %rdx
+    add %rcx, %rdx
+    jmp *%rdx
+.u_0:
+    mov %rsi, %rax
+    ret
+.u_1:
+    mov %rdi, %rax
+    ret
+
+.globl decoy
+.type decoy, @function
+decoy:
+    lea .Lb_tab(%rip), %rcx
+    mov %rsi, %rax
+    jmp *%rax
+
+.section .rodata
+.align 4
+.Lb_tab:
+    .long .b_0 - .Lb_tab
+    .long .b_1 - .Lb_tab
+    .long .b_2 - .Lb_tab
+    .long .b_2 + 1 - .Lb_tab
+.Lu_tab:
+    .long .u_0 - .Lu_tab
+    .long .u_1 - .Lu_tab
+    .long .u_1 + 1 - .Lu_tab
+    .long .u_0 - .Lu_tab
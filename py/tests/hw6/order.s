@@ -0,0 +1,28 @@
+#
+# Callees placed before their callers, each call is decoded
+#  ahead of lower addresses, .text far above 2^63
+#
+.globl leaf
+.type leaf, @function
+leaf:
+    mov %rdi, %rax
+    ret
+
+.globl middle
+.type middle, @function
+middle:
+    push %rbx
+    call leaf
+    pop %rbx
+    ret
+
+.globl _start
+.type _start, @function
+_start:
+    call middle
+    cmp %rax, %rdi
+    je .tail
+    call leaf
+.tail:
+    call middle
+    ret
@@ -0,0 +1,53 @@
+#
+# After patch, same size as patch_old.s
+#  je -> jne, a mov split into push/pop/nop, nops into a call
+#
+.globl _start
+.type _start, @function
+_start:
+    push %rbp
+    mov %rsp, %rbp
+    cmp %rax, %rbx
+    jne .skip
+    mov %rdi, %rax
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+.skip:
+    call helper
+    push %rcx
+    pop %rdx
+    nop
+    pop %rbp
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    ret
+
+.globl helper
+.type helper, @function
+helper:
+    mov %rdi, %rax
+    call .helper_out
+.helper_out:
+    ret
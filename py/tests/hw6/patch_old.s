@@ -0,0 +1,53 @@
+#
+# Before patch, same size as patch_new.s
+#
+.globl _start
+.type _start, @function
+_start:
+    push %rbp
+    mov %rsp, %rbp
+    cmp %rax, %rbx
+    je .skip
+    mov %rdi, %rax
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+.skip:
+    call helper
+    mov %rcx, %rdx
+    pop %rbp
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    nop
+    ret
+
+.globl helper
+.type helper, @function
+helper:
+    mov %rdi, %rax
+    nop
+    nop
+    nop
+    nop
+    nop
+    ret
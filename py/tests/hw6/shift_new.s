@@ -0,0 +1,33 @@
+#
+# After rebuild, helper grew, .fresh was added
+#
+.globl _start
+.type _start, @function
+_start:
+    push %rbp
+    mov %rsp, %rbp
+    call helper
+    pop %rbp
+    ret
+
+.type helper, @function
+helper:
+    mov %rdi, %rax
+    nop
+    nop
+    nop
+    ret
+
+.section .hot, "ax"
+hot:
+    cmp %rax, %rbx
+    je .Lhot_done
+    call helper
+.Lhot_done:
+    ret
+
+.section .fresh, "ax"
+fresh:
+    push %rbx
+    pop %rbx
+    ret
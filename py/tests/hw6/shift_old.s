@@ -0,0 +1,29 @@
+#
+# Before rebuild, .text grows, so .hot moves, .gone is dropped
+#
+.globl _start
+.type _start, @function
+_start:
+    push %rbp
+    mov %rsp, %rbp
+    call helper
+    pop %rbp
+    ret
+
+.type helper, @function
+helper:
+    mov %rdi, %rax
+    ret
+
+.section .hot, "ax"
+hot:
+    cmp %rax, %rbx
+    je .Lhot_done
+    call helper
+.Lhot_done:
+    ret
+
+.section .gone, "ax"
+gone:
+    nop
+    ret
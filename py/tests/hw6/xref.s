@@ -0,0 +1,34 @@
+#
+# square & twice called from several places,
+#  xrefs of each count all of them
+#
+.globl _start
+.type _start, @function
+_start:
+    push %rbp
+    mov %rsp, %rbp
+    call square
+    call square
+    call twice
+    cmp %rax, %rbx
+    je .done
+    call twice
+.done:
+    pop %rbp
+    ret
+
+.globl square
+.type square, @function
+square:
+    mov %rdi, %rax
+    ret
+
+.globl twice
+.type twice, @function
+twice:
+    call square
+    cmp %rax, %rdi
+    jne .twice_out
+    mov %rdi, %rax
+.twice_out:
+    ret
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define SCAN_SIMD
+#include <immintrin.h>
+#endif
+
+#include "decode.h"
+#include "scan.h"
+
+/**
+ * Checks if byte at bytes[0] may begin a rel. branch/call
+ *  E8 (call), E9/EB (jmp), 7x (jcc rel8), 0F 8x (jcc rel32)
+ */
+static bool is_branch_candidate(const byte_t bytes[], size_t left) {
+  return bytes[0] == 0xE8 || bytes[0] == 0xE9 || bytes[0] == 0xEB
+      || (bytes[0] & 0xF0) == 0x70
+      || (bytes[0] == 0x0F && left > 1 && (bytes[1] & 0xF0) == 0x80);
+}
+
+static void scan_scalar(const byte_t bytes[], size_t from, size_t len, uint64_t cand[]) {
+  for (size_t i = from; i < len; i++) {
+    if (is_branch_candidate(&bytes[i], len - i))
+      cand[i / 64] |= 1ULL << (i % 64);
+  }
+}
+
+#ifdef SCAN_SIMD
+/**
+ * SSE2, 4x16 bytes => one bitmap word per iteration
+ *  return => num. of bytes scanned
+ */
+static size_t scan_sse2(const byte_t bytes[], size_t len, uint64_t cand[]) {
+  const __m128i e8 = _mm_set1_epi8((char)0xE8), e9 = _mm_set1_epi8((char)0xE9);
+  const __m128i eb = _mm_set1_epi8((char)0xEB), of = _mm_set1_epi8(0x0F);
+  const __m128i hi = _mm_set1_epi8((char)0xF0);
+  const __m128i x7 = _mm_set1_epi8(0x70), x8 = _mm_set1_epi8((char)0x80);
+  size_t i = 0;
+
+  // +1 byte lookahead for 0F 8x
+  for (; i + 64 < len; i += 64) {
+    uint64_t word = 0;
+    for (int k = 0; k < 4; k++) {
+      __m128i v  = _mm_loadu_si128((const __m128i *)&bytes[i + k * 16]);
+      __m128i v1 = _mm_loadu_si128((const __m128i *)&bytes[i + k * 16 + 1]);
+      __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, e8), _mm_cmpeq_epi8(v, e9)),
+                               _mm_cmpeq_epi8(v, eb));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_and_si128(v, hi), x7));
+      m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(v, of),
+                                        _mm_cmpeq_epi8(_mm_and_si128(v1, hi), x8)));
+      word |= (uint64_t)(uint16_t)_mm_movemask_epi8(m) << (k * 16);
+    }
+    cand[i / 64] = word;
+  }
+
+  return i;
+}
+
+/**
+ * AVX2, 2x32 bytes => one bitmap word per iteration
+ *  return => num. of bytes scanned
+ */
+__attribute__((target("avx2")))
+static size_t scan_avx2(const byte_t bytes[], size_t len, uint64_t cand[]) {
+  const __m256i e8 = _mm256_set1_epi8((char)0xE8), e9 = _mm256_set1_epi8((char)0xE9);
+  const __m256i eb = _mm256_set1_epi8((char)0xEB), of = _mm256_set1_epi8(0x0F);
+  const __m256i hi = _mm256_set1_epi8((char)0xF0);
+  const __m256i x7 = _mm256_set1_epi8(0x70), x8 = _mm256_set1_epi8((char)0x80);
+  size_t i = 0;
+
+  // +1 byte lookahead for 0F 8x
+  for (; i + 64 < len; i += 64) {
+    uint64_t word = 0;
+    for (int k = 0; k < 2; k++) {
+      __m256i v  = _mm256_loadu_si256((const __m256i *)&bytes[i + k * 32]);
+      __m256i v1 = _mm256_loadu_si256((const __m256i *)&bytes[i + k * 32 + 1]);
+      __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, e8), _mm256_cmpeq_epi8(v, e9)),
+                                  _mm256_cmpeq_epi8(v, eb));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_and_si256(v, hi), x7));
+      m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpeq_epi8(v, of),
+                                              _mm256_cmpeq_epi8(_mm256_and_si256(v1, hi), x8)));
+      word |= (uint64_t)(uint32_t)_mm256_movemask_epi8(m) << (k * 32);
+    }
+    cand[i / 64] = word;
+  }
+
+  return i;
+}
+#endif
+
+/**
+ * Marks all bytes that may begin a rel. branch/call
+ *  cand[] = bitmap of SCAN_MASK_WORDS(len) words, bit i => bytes[i]
+ */
+void scan_branch_candidates(const byte_t bytes[], size_t len, uint64_t cand[]) {
+  size_t done = 0;
+
+  memset(cand, 0, SCAN_MASK_WORDS(len) * sizeof(uint64_t));
+
+#ifdef SCAN_SIMD
+  if (__builtin_cpu_supports("avx2"))
+    done = scan_avx2(bytes, len, cand);
+  else
+    done = scan_sse2(bytes, len, cand);
+#endif
+
+  scan_scalar(bytes, done, len, cand);
+}
+
+/**
+ * Marks all rel. branches/calls on linear-sweep instr. boundaries
+ *  return => num. of branch sites
+ */
+size_t scan_branches(const byte_t bytes[], size_t len, uint64_t sites[]) {
+  size_t words = SCAN_MASK_WORDS(len), count = 0;
+
+  uint64_t *bounds = (uint64_t *)malloc(words * sizeof(uint64_t));
+  if (bounds == NULL) {
+    printf("Could not allocate memory for scanner!\n");
+    return 0;
+  }
+
+  scan_branch_candidates(bytes, len, sites);
+  decode_boundaries(bytes, len, bounds);
+
+  for (size_t w = 0; w < words; w++) {
+    sites[w] &= bounds[w];
+    count += __builtin_popcountll(sites[w]);
+  }
+
+  free(bounds);
+  return count;
+}
+
+static int compare_uintptr(const void *a, const void *b) {
+  uintptr_t x = *(const uintptr_t *)a, y = *(const uintptr_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Collects unique targets of all validated rel. calls (E8)
+ *  Only targets within vaddr - vaddr+len are kept
+ *  return => num. of targets, sorted by address
+ */
+int scan_call_targets(const byte_t bytes[], size_t len, uintptr_t vaddr, uintptr_t targets[], size_t max) {
+  int count = 0;
+
+  uint64_t *sites = (uint64_t *)malloc(SCAN_MASK_WORDS(len) * sizeof(uint64_t));
+  if (sites == NULL) {
+    printf("Could not allocate memory for scanner!\n");
+    return 0;
+  }
+
+  scan_branches(bytes, len, sites);
+
+  for (size_t w = 0; w < SCAN_MASK_WORDS(len); w++) {
+    for (uint64_t m = sites[w]; m != 0 && (size_t)count < max; m &= m - 1) {
+      size_t i = w * 64 + __builtin_ctzll(m);
+      if (bytes[i] != OP_CALL || i + 5 > len)
+        continue;
+
+      long long rel = (int32_t)(bytes[i + 1] | bytes[i + 2] << 8 |
+                                bytes[i + 3] << 16 | (uint32_t)bytes[i + 4] << 24);
+      long long dest = (long long)i + 5 + rel;
+      if (dest >= 0 && dest < (long long)len)
+        targets[count++] = vaddr + dest;
+    }
+  }
+  free(sites);
+
+  // Sort & drop duplicates
+  qsort(targets, count, sizeof(uintptr_t), compare_uintptr);
+  int n = 0;
+  for (int i = 0; i < count; i++) {
+    if (n == 0 || targets[n - 1] != targets[i])
+      targets[n++] = targets[i];
+  }
+
+  return n;
+}
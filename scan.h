@@ -0,0 +1,17 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decode.h"
+
+// Bitmap words needed for len bytes, 1 bit per byte
+#define SCAN_MASK_WORDS(len) (((len) + 63) / 64)
+
+void scan_branch_candidates(const byte_t bytes[], size_t len, uint64_t cand[]);
+size_t scan_branches(const byte_t bytes[], size_t len, uint64_t sites[]);
+int scan_call_targets(const byte_t bytes[], size_t len, uintptr_t vaddr, uintptr_t targets[], size_t max);
+
+#endif
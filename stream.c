@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "scan.h"
+#include "stream.h"
+
+// Single-producer single-consumer ring of batch ids
+typedef struct {
+  int slot[STREAM_POOL];
+  size_t head; // written by producer only
+  size_t tail; // written by consumer only
+} ring_t;
+
+typedef struct {
+  instr_t instr[STREAM_BATCH];
+  int count; // 0 => end of stream
+} batch_t;
+
+typedef struct {
+  byte_t *bytes;
+  addr_t vaddr;
+  size_t len;
+  section_t *sections;
+  int n_sections;
+
+  uint64_t *bounds;  // instr. starts
+  uint64_t *targets; // valid jump/call destinations
+
+  batch_t *pool;
+  ring_t free;      // print -> decode
+  ring_t decoded;   // decode -> annotate
+  ring_t annotated; // annotate -> print
+} stream_t;
+
+static inline bool test_bit(const uint64_t mask[], size_t i) {
+  return (mask[i / 64] >> (i % 64)) & 1;
+}
+
+static void wait_spin(int *spins) {
+  if (++(*spins) > 64)
+    sched_yield();
+}
+
+static void ring_push(ring_t *ring, int id) {
+  int spins = 0;
+  while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == STREAM_POOL)
+    wait_spin(&spins);
+  ring->slot[ring->head % STREAM_POOL] = id;
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+static int ring_pop(ring_t *ring) {
+  int spins = 0;
+  while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+    wait_spin(&spins);
+  int id = ring->slot[ring->tail % STREAM_POOL];
+  __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+  return id;
+}
+
+/**
+ * Length-only pre-pass, finds every label before anything is printed
+ *  Backward jumps may target any already printed instr., so no bounded
+ *  window can place their labels, this pass is ~10x cheaper than decode
+ */
+static void scan_labels(stream_t *s) {
+  size_t pos = 0;
+  while (pos < s->len) {
+    flow_t flow;
+    long long rel;
+    int n = decode_length(&s->bytes[pos], s->len - pos, &flow, &rel);
+    s->bounds[pos / 64] |= 1ULL << (pos % 64);
+    if (n == 0)
+      break; // truncated, decode() still decodes it
+    pos += n;
+  }
+
+  pos = 0;
+  while (pos < s->len) {
+    flow_t flow;
+    long long rel;
+    int n = decode_length(&s->bytes[pos], s->len - pos, &flow, &rel);
+    if (n == 0)
+      break;
+
+    if (flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_CALL) {
+      addr_t dest = s->vaddr + pos + n + rel;
+      if (dest >= s->vaddr && dest - s->vaddr < s->len && test_bit(s->bounds, dest - s->vaddr))
+        s->targets[(dest - s->vaddr) / 64] |= 1ULL << ((dest - s->vaddr) % 64);
+    }
+    pos += n;
+  }
+}
+
+/**
+ * Stage 1: linear decode into batches, block labels as decode() sets them
+ */
+static void *decode_stage(void *arg) {
+  stream_t *s = (stream_t *)arg;
+  size_t pos = 0;
+  bool label_pending = true;
+
+  while (pos < s->len) {
+    batch_t *batch = &s->pool[ring_pop(&s->free)];
+    batch->count = 0;
+
+    while (pos < s->len && batch->count < STREAM_BATCH) {
+      instr_t *instr = &batch->instr[batch->count++];
+      pos += decode_instr(instr, s->bytes, s->vaddr, pos, s->vaddr);
+
+      if (label_pending) {
+        set_label(instr, NULL, s->vaddr);
+        label_pending = false;
+      }
+
+      flow_t flow = get_instr_flow(instr);
+      label_pending = flow == FLOW_JCC || flow == FLOW_JMP || flow == FLOW_RET || flow == FLOW_IJMP;
+    }
+
+    ring_push(&s->decoded, batch - s->pool);
+  }
+
+  // End of stream
+  batch_t *batch = &s->pool[ring_pop(&s->free)];
+  batch->count = 0;
+  ring_push(&s->decoded, batch - s->pool);
+  return NULL;
+}
+
+/**
+ * Stage 2: same labels & notes as proc_flow_labels() + proc_section_labels()
+ */
+static void *annotate_stage(void *arg) {
+  stream_t *s = (stream_t *)arg;
+
+  for (;;) {
+    int id = ring_pop(&s->decoded);
+    batch_t *batch = &s->pool[id];
+
+    for (int i = 0; i < batch->count; i++) {
+      instr_t *instr = &batch->instr[i];
+      if (!has_label(instr) && test_bit(s->targets, instr->addr - s->vaddr))
+        set_label(instr, NULL, s->vaddr);
+
+      flow_t flow = get_instr_flow(instr);
+      if (flow != FLOW_JCC && flow != FLOW_JMP && flow != FLOW_CALL) {
+        proc_value_note(instr);
+        continue;
+      }
+
+      addr_t dest = get_instr_dest(instr);
+      if (dest < s->vaddr || dest - s->vaddr >= s->len || !test_bit(s->bounds, dest - s->vaddr)) {
+        proc_jump_note(instr, NULL);
+        continue;
+      }
+
+      label_t label = { NULL, s->vaddr };
+      proc_jump_note(instr, &label);
+    }
+
+    if (s->sections != NULL)
+      proc_section_labels(batch->instr, batch->count, s->sections, s->n_sections);
+
+    ring_push(&s->annotated, id);
+    if (batch->count == 0)
+      return NULL;
+  }
+}
+
+/**
+ * Linear-mode decode.elf listing, decode/annotate/print run on own threads
+ *  sections => for section notes, NULL if not an ELF
+ *  Output is identical to decode() + proc_*_labels() + print (or jsonl_instr())
+ *  return => 0 on success
+ */
+int decode_stream(FILE *out, format_t format, byte_t bytes[], addr_t vaddr, size_t len, section_t sections[], int n_sections) {
+  stream_t s = { bytes, vaddr, len, sections, n_sections };
+  s.bounds = (uint64_t *)calloc(SCAN_MASK_WORDS(len), sizeof(uint64_t));
+  s.targets = (uint64_t *)calloc(SCAN_MASK_WORDS(len), sizeof(uint64_t));
+  s.pool = (batch_t *)malloc(STREAM_POOL * sizeof(batch_t));
+  if (s.bounds == NULL || s.targets == NULL || s.pool == NULL) {
+    printf("Could not allocate memory for decoder!\n");
+    free(s.bounds);
+    free(s.targets);
+    free(s.pool);
+    return 1;
+  }
+
+  scan_labels(&s);
+  for (int i = 0; i < STREAM_POOL; i++)
+    ring_push(&s.free, i);
+
+  pthread_t decoder, annotator;
+  if (pthread_create(&decoder, NULL, decode_stage, &s) != 0) {
+    printf("Could not start decoder thread!\n");
+    goto ERR_FREE;
+  }
+  if (pthread_create(&annotator, NULL, annotate_stage, &s) != 0) {
+    printf("Could not start annotator thread!\n");
+    // Drain decoder, then give up
+    int id;
+    while (s.pool[id = ring_pop(&s.decoded)].count > 0)
+      ring_push(&s.free, id);
+    pthread_join(decoder, NULL);
+    goto ERR_FREE;
+  }
+
+  // Stage 3: print on this thread
+  for (;;) {
+    int id = ring_pop(&s.annotated);
+    batch_t *batch = &s.pool[id];
+    if (batch->count == 0)
+      break;
+
+    for (int i = 0; i < batch->count; i++) {
+      instr_t *instr = &batch->instr[i];
+      if (format == FORMAT_JSONL) {
+        jsonl_instr(out, instr, 0, 0);
+        continue;
+      }
+
+      if (has_label(instr)) {
+        print_label(out, &instr->label, instr->addr);
+        fprintf(out, ":\n");
+      }
+
+      char addr_buf[24];
+      snprintf(addr_buf, sizeof(addr_buf), "0x%lx", instr->addr);
+
+      fprintf(out, "   %s:%*s %-20s    %-5s %-20s ",
+              addr_buf,
+              (int)(strlen(addr_buf) < 7 ? 7 - strlen(addr_buf) : 0), "", // padding
+              instr->hex_bytes,
+              instr->mnemo_opcode,
+              instr->mnemo_operand);
+      print_instr_note(out, instr);
+      fprintf(out, "\n");
+    }
+    ring_push(&s.free, id);
+  }
+
+  pthread_join(decoder, NULL);
+  pthread_join(annotator, NULL);
+  free(s.bounds);
+  free(s.targets);
+  free(s.pool);
+  return 0;
+
+ERR_FREE:
+  free(s.bounds);
+  free(s.targets);
+  free(s.pool);
+  return 1;
+}
@@ -0,0 +1,15 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+
+#include "decode.h"
+#include "elf.h"
+#include "json.h"
+
+#define STREAM_BATCH 1024 // instr. per batch
+#define STREAM_POOL  32   // batches in flight
+
+int decode_stream(FILE *out, format_t format, byte_t bytes[], addr_t vaddr, size_t len, section_t sections[], int n_sections);
+
+#endif
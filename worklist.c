@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decode.h"
+#include "worklist.h"
+
+/**
+ * Worklist of region [vaddr, vaddr + len), targets outside are never queued
+ *  return => 0 on success
+ */
+int worklist_init(worklist_t *work, addr_t vaddr, size_t len) {
+  memset(work, 0, sizeof(worklist_t));
+  work->vaddr = vaddr;
+  work->len = len;
+  work->queued = (byte_t *)calloc(len > 0 ? len : 1, sizeof(byte_t));
+  if (work->queued == NULL) {
+    printf("Could not allocate memory for worklist!\n");
+    return 1;
+  }
+  return 0;
+}
+
+void worklist_free(worklist_t *work) {
+  for (int p = 0; p < TARGET_PRIOS; p++)
+    free(work->targets[p]);
+  free(work->queued);
+}
+
+/**
+ * Queues addr, unless outside region or queued already
+ *  return => 0 on success
+ */
+int worklist_push(worklist_t *work, target_prio_t prio, addr_t addr) {
+  if (addr < work->vaddr || addr - work->vaddr >= work->len || work->queued[addr - work->vaddr])
+    return 0;
+
+  if (work->n[prio] == work->cap[prio]) {
+    int cap = work->cap[prio] > 0 ? 2 * work->cap[prio] : 64;
+    addr_t *tmp = (addr_t *)realloc(work->targets[prio], cap * sizeof(addr_t));
+    if (tmp == NULL) {
+      printf("Could not allocate memory for worklist!\n");
+      return 1;
+    }
+    work->targets[prio] = tmp;
+    work->cap[prio] = cap;
+  }
+
+  work->targets[prio][work->n[prio]++] = addr;
+  work->queued[addr - work->vaddr] = 1;
+  return 0;
+}
+
+void budget_init(budget_t *budget, double deadline, size_t max_memory) {
+  budget->deadline = deadline;
+  budget->max_memory = max_memory;
+  budget->used = 0;
+  budget->stop = BUDGET_OK;
+  clock_gettime(CLOCK_MONOTONIC, &budget->start);
+}
+
+/**
+ * return => seconds since budget_init()
+ */
+double budget_elapsed(const budget_t *budget) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - budget->start.tv_sec) + (now.tv_nsec - budget->start.tv_nsec) / 1e9;
+}
+
+/**
+ * Bytes held by decoder, instr. decoded so far, address index & worklist
+ */
+static size_t decoder_memory(int count, const worklist_t *work, const addr_index_t *index) {
+  size_t used = count * sizeof(instr_t) + index->len * sizeof(int) + work->len;
+  for (int p = 0; p < TARGET_PRIOS; p++)
+    used += work->cap[p] * sizeof(addr_t);
+  return used;
+}
+
+/**
+ * return => true if deadline passed or memory over limit, budget->stop says which
+ */
+static bool budget_exceeded(budget_t *budget, int count, const worklist_t *work, const addr_index_t *index) {
+  budget->used = decoder_memory(count, work, index);
+  if (budget->max_memory > 0 && budget->used > budget->max_memory)
+    budget->stop = BUDGET_MEMORY;
+  else if (budget->deadline > 0 && budget_elapsed(budget) >= budget->deadline)
+    budget->stop = BUDGET_DEADLINE;
+  return budget->stop != BUDGET_OK;
+}
+
+/**
+ * Decodes queued targets one function at a time, highest priority first
+ *  Recursive mode queues calls of each decoded function, rather than
+ *  following them right away, function mode only decodes the targets
+ *  Stops before next target once budget is exceeded, instr[] then holds
+ *  all functions decoded so far
+ *  bytes[] = whole region of worklist, index must cover it
+ *  return => total num. of decoded instr. in instr[] array
+ */
+int decode_worklist(instr_t instr[], int instr_pos, byte_t bytes[], decode_mode_t mode,
+                    worklist_t *work, addr_index_t *index, budget_t *budget) {
+  int count = instr_pos;
+
+  for (;;) {
+    int prio = 0;
+    while (prio < TARGET_PRIOS && work->head[prio] == work->n[prio])
+      prio++;
+    if (prio == TARGET_PRIOS)
+      break;
+
+    // Covered by earlier function, e.g. tail of it, costs nothing
+    addr_t addr = work->targets[prio][work->head[prio]];
+    if (index_lookup(index, addr) >= 0) {
+      work->head[prio]++;
+      continue;
+    }
+    if (budget_exceeded(budget, count, work, index))
+      return count;
+    work->head[prio]++;
+
+    int from = count;
+    count = decode(instr, count, bytes, work->vaddr, work->len, addr, DECODE_FUNCTION, 0, index);
+
+    if (mode == DECODE_RECURSIVE) {
+      for (int i = from; i < count; i++) {
+        if (get_instr_flow(&instr[i]) == FLOW_CALL)
+          worklist_push(work, TARGET_CALL, get_instr_dest(&instr[i]));
+      }
+    }
+  }
+
+  budget->used = decoder_memory(count, work, index);
+  return count;
+}
+
+/**
+ * Why decoding stopped, targets done per priority & bytes covered
+ */
+void print_budget_report(FILE *out, const budget_t *budget, const worklist_t *work, size_t covered) {
+  static const char *stops[] = {
+    [BUDGET_OK]       = "completed",
+    [BUDGET_DEADLINE] = "deadline reached",
+    [BUDGET_MEMORY]   = "memory limit reached"
+  };
+  static const char *prios[TARGET_PRIOS] = {
+    [TARGET_ENTRY]  = "entry",
+    [TARGET_SYMBOL] = "symbol",
+    [TARGET_CALL]   = "call",
+    [TARGET_SCAN]   = "scan"
+  };
+
+  fprintf(out, "budget: %s after %.2f s, %.1f MiB used\n",
+          stops[budget->stop], budget_elapsed(budget), budget->used / (1024.0 * 1024.0));
+  fprintf(out, "targets:");
+  for (int p = 0; p < TARGET_PRIOS; p++)
+    fprintf(out, "%s %s %d/%d", p > 0 ? "," : "", prios[p], work->head[p], work->n[p]);
+  fprintf(out, " done\n");
+  fprintf(out, "coverage: %.1f%% recursive\n", work->len > 0 ? 100.0 * covered / work->len : 0.0);
+}
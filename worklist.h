@@ -0,0 +1,55 @@
+#ifndef WORKLIST_H
+#define WORKLIST_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "decode.h"
+
+typedef enum {
+  TARGET_ENTRY,
+  TARGET_SYMBOL, // function symbols & .eh_frame starts
+  TARGET_CALL,   // call dest. found while decoding
+  TARGET_SCAN,   // validated call targets of scan_call_targets()
+  TARGET_PRIOS
+} target_prio_t;
+
+// Pending decode targets, FIFO per priority, lower priority first
+typedef struct {
+  addr_t vaddr;
+  size_t len;
+  byte_t *queued; // queued[addr - vaddr], target pushed already
+  addr_t *targets[TARGET_PRIOS];
+  int n[TARGET_PRIOS], cap[TARGET_PRIOS];
+  int head[TARGET_PRIOS]; // next to take, targets before it are done
+} worklist_t;
+
+typedef enum {
+  BUDGET_OK,
+  BUDGET_DEADLINE,
+  BUDGET_MEMORY
+} budget_stop_t;
+
+// Limits of recursive decoding, checked between targets, 0 => unlimited
+//  Memory counts decoded instr., address index & worklist
+typedef struct {
+  double deadline;   // seconds since budget_init()
+  size_t max_memory; // bytes
+  struct timespec start;
+  size_t used;       // memory at last check
+  budget_stop_t stop;
+} budget_t;
+
+int worklist_init(worklist_t *work, addr_t vaddr, size_t len);
+void worklist_free(worklist_t *work);
+int worklist_push(worklist_t *work, target_prio_t prio, addr_t addr);
+
+void budget_init(budget_t *budget, double deadline, size_t max_memory);
+double budget_elapsed(const budget_t *budget);
+
+int decode_worklist(instr_t instr[], int instr_pos, byte_t bytes[], decode_mode_t mode,
+                    worklist_t *work, addr_index_t *index, budget_t *budget);
+void print_budget_report(FILE *out, const budget_t *budget, const worklist_t *work, size_t covered);
+
+#endif
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "xref.h"
+
+#define XREF_MAGIC   0x46455258 // "XREF"
+#define XREF_VERSION 1
+
+#define RADIX_BITS 16
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+typedef struct {
+  addr_t target;
+  int ref;
+} xref_pair_t;
+
+/**
+ * Returns address referenced by instr., jumps & calls & disp32(%rip) operands
+ *  return => false if instr. references nothing
+ */
+static bool get_xref_dest(const instr_t *instr, addr_t *dest) {
+  switch (get_instr_flow(instr)) {
+    case FLOW_JCC:
+    case FLOW_JMP:
+    case FLOW_CALL:
+      *dest = get_instr_dest(instr);
+      return true;
+    default:
+      break;
+  }
+
+  if (is_instr_rip_relative(instr)) {
+    *dest = get_instr_dest(instr);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * LSD radix sort of pairs by target, stable => refs stay in instr. order
+ *  Digits equal across all pairs (high address bits, usually) are skipped
+ *  return => sorted array, either pairs or tmp
+ */
+static xref_pair_t *radix_sort(xref_pair_t *pairs, xref_pair_t *tmp, int n, size_t *count) {
+  addr_t all_or = 0, all_and = ~(addr_t)0;
+  for (int i = 0; i < n; i++) {
+    all_or |= pairs[i].target;
+    all_and &= pairs[i].target;
+  }
+
+  for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+    if ((((all_or ^ all_and) >> shift) & (RADIX_SIZE - 1)) == 0)
+      continue; // every pair has the same digit
+
+    memset(count, 0, RADIX_SIZE * sizeof(size_t));
+    for (int i = 0; i < n; i++)
+      count[(pairs[i].target >> shift) & (RADIX_SIZE - 1)]++;
+
+    size_t sum = 0;
+    for (int d = 0; d < RADIX_SIZE; d++) {
+      size_t c = count[d];
+      count[d] = sum;
+      sum += c;
+    }
+
+    for (int i = 0; i < n; i++)
+      tmp[count[(pairs[i].target >> shift) & (RADIX_SIZE - 1)]++] = pairs[i];
+
+    xref_pair_t *swap = pairs;
+    pairs = tmp;
+    tmp = swap;
+  }
+
+  return pairs;
+}
+
+/**
+ * Builds reverse index over instr. lists, in time linear to instr. count
+ *  Instr. id = position in concatenation of lists (lists[0][0] = 0, ...)
+ *  return => 0 on success
+ */
+int xref_build(xref_t *xref, instr_t *lists[], int counts[], int n_lists) {
+  memset(xref, 0, sizeof(xref_t));
+
+  int total = 0;
+  for (int l = 0; l < n_lists; l++)
+    total += counts[l];
+
+  xref_pair_t *pairs = (xref_pair_t *)malloc((total > 0 ? total : 1) * sizeof(xref_pair_t));
+  xref_pair_t *tmp = (xref_pair_t *)malloc((total > 0 ? total : 1) * sizeof(xref_pair_t));
+  size_t *count = (size_t *)malloc(RADIX_SIZE * sizeof(size_t));
+  if (pairs == NULL || tmp == NULL || count == NULL)
+    goto ERR_FREE;
+
+  // Collect (target, ref) pairs
+  int n = 0, id = 0;
+  for (int l = 0; l < n_lists; l++) {
+    for (int i = 0; i < counts[l]; i++, id++) {
+      if (get_xref_dest(&lists[l][i], &pairs[n].target))
+        pairs[n++].ref = id;
+    }
+  }
+
+  xref_pair_t *sorted = radix_sort(pairs, tmp, n, count);
+
+  int n_targets = 0;
+  for (int i = 0; i < n; i++) {
+    if (i == 0 || sorted[i].target != sorted[i - 1].target)
+      n_targets++;
+  }
+
+  xref->targets = (addr_t *)malloc((n_targets > 0 ? n_targets : 1) * sizeof(addr_t));
+  xref->offsets = (int *)malloc((n_targets + 1) * sizeof(int));
+  xref->refs = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+  if (xref->targets == NULL || xref->offsets == NULL || xref->refs == NULL) {
+    xref_free(xref);
+    goto ERR_FREE;
+  }
+
+  // Compress runs of equal targets into rows
+  int t = -1;
+  for (int i = 0; i < n; i++) {
+    if (i == 0 || sorted[i].target != sorted[i - 1].target) {
+      xref->targets[++t] = sorted[i].target;
+      xref->offsets[t] = i;
+    }
+    xref->refs[i] = sorted[i].ref;
+  }
+  xref->offsets[n_targets] = n;
+  xref->n_targets = n_targets;
+  xref->n_refs = n;
+
+  free(pairs);
+  free(tmp);
+  free(count);
+  return 0;
+
+ERR_FREE:
+  printf("Could not allocate memory for xref index!\n");
+  free(pairs);
+  free(tmp);
+  free(count);
+  return 1;
+}
+
+void xref_free(xref_t *xref) {
+  free(xref->targets);
+  free(xref->offsets);
+  free(xref->refs);
+  memset(xref, 0, sizeof(xref_t));
+}
+
+/**
+ * Serializes index as header + raw arrays (host byte order)
+ *  return => 0 on success
+ */
+int xref_write(const xref_t *xref, FILE *out) {
+  uint32_t header[4] = { XREF_MAGIC, XREF_VERSION, xref->n_targets, xref->n_refs };
+
+  if (fwrite(header, sizeof(header), 1, out) != 1
+      || fwrite(xref->targets, sizeof(addr_t), xref->n_targets, out) != (size_t)xref->n_targets
+      || fwrite(xref->offsets, sizeof(int), xref->n_targets + 1, out) != (size_t)xref->n_targets + 1
+      || fwrite(xref->refs, sizeof(int), xref->n_refs, out) != (size_t)xref->n_refs) {
+    printf("Could not write xref index!\n");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Loads index written by xref_write(), free with xref_free()
+ *  return => 0 on success
+ */
+int xref_read(xref_t *xref, FILE *in) {
+  uint32_t header[4];
+  memset(xref, 0, sizeof(xref_t));
+
+  if (fread(header, sizeof(header), 1, in) != 1
+      || header[0] != XREF_MAGIC || header[1] != XREF_VERSION
+      || header[2] > INT32_MAX - 1 || header[3] > INT32_MAX) {
+    printf("Could not read xref index, bad header!\n");
+    return 1;
+  }
+
+  int n_targets = header[2], n_refs = header[3];
+  xref->targets = (addr_t *)malloc((n_targets > 0 ? n_targets : 1) * sizeof(addr_t));
+  xref->offsets = (int *)malloc((n_targets + 1) * sizeof(int));
+  xref->refs = (int *)malloc((n_refs > 0 ? n_refs : 1) * sizeof(int));
+  if (xref->targets == NULL || xref->offsets == NULL || xref->refs == NULL
+      || fread(xref->targets, sizeof(addr_t), n_targets, in) != (size_t)n_targets
+      || fread(xref->offsets, sizeof(int), n_targets + 1, in) != (size_t)n_targets + 1
+      || fread(xref->refs, sizeof(int), n_refs, in) != (size_t)n_refs) {
+    printf("Could not read xref index!\n");
+    xref_free(xref);
+    return 1;
+  }
+
+  // Offsets must be monotonic & within refs[], xref_lookup() needs targets sorted & unique
+  bool valid = xref->offsets[0] == 0 && xref->offsets[n_targets] == n_refs;
+  for (int i = 0; valid && i < n_targets; i++) {
+    valid = xref->offsets[i] <= xref->offsets[i + 1]
+         && (i == 0 || xref->targets[i - 1] < xref->targets[i]);
+  }
+  for (int i = 0; valid && i < n_refs; i++)
+    valid = xref->refs[i] >= 0;
+  if (!valid) {
+    printf("Could not read xref index, corrupted index!\n");
+    xref_free(xref);
+    return 1;
+  }
+
+  xref->n_targets = n_targets;
+  xref->n_refs = n_refs;
+  return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef XREF_H
+#define XREF_H
+
+#include <stdio.h>
+
+#include "decode.h"
+
+// Reverse references, CSR layout:
+//  refs[offsets[t] .. offsets[t + 1]) reference targets[t]
+//  refs[] are instr. ids, in order of the lists passed to xref_build()
+typedef struct xref {
+  int n_targets;
+  int n_refs;
+  addr_t *targets; // sorted, unique
+  int *offsets;    // n_targets + 1
+  int *refs;
+} xref_t;
+
+/**
+ * Finds all references to target
+ *  refs => points into xref, valid until xref_free()
+ *  return => num. of refs
+ */
+static inline int xref_lookup(const xref_t *xref, addr_t target, const int **refs) {
+  int lo = 0, hi = xref->n_targets - 1;
+  while (lo <= hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (xref->targets[mid] == target) {
+      *refs = &xref->refs[xref->offsets[mid]];
+      return xref->offsets[mid + 1] - xref->offsets[mid];
+    }
+    if (xref->targets[mid] < target)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+
+  *refs = NULL;
+  return 0;
+}
+
+int xref_build(xref_t *xref, instr_t *lists[], int counts[], int n_lists);
+void xref_free(xref_t *xref);
+
+int xref_write(const xref_t *xref, FILE *out);
+int xref_read(xref_t *xref, FILE *in);
+
+#endif